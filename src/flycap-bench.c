@@ -0,0 +1,442 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015-2016 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ *
+ */
+/*
+ * Micro-benchmark for the flycapsrc pixel kernels, no camera needed.
+ *
+ * Synthetic fc2Image frames are made for each sensor size and binning mode, as the camera would
+ * deliver them, and every copy kernel specialisation is timed along with the luminance histogram,
+ * frame averaging, the calibration, hot pixel and preview downscale passes and the LUT calculation.
+ * Results are ns per frame, GB/s of memory traffic and cycles per output pixel.
+ *
+ * Usage: flycap-bench [--json] [--size WxH] [--iterations N]
+ *  --size adds an arbitrary sensor size to the built in 1288x964 and 808x608.
+ *  --json prints one JSON document, for tracking results over time.
+ * FLYCAP_BENCH_ITERATIONS in the environment sets the default iterations, 'make check' runs a few.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "FlyCapture2_C.h"
+
+#include "gstflycapkernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC
+#endif
+
+#define BENCH_DEFAULT_ITERATIONS 200
+
+typedef struct
+{
+	guint width;    // sensor
+	guint height;
+	guint raw_width[3];   // camera image for binning 1, 2, 4
+	guint raw_height[3];
+} BenchSensor;
+
+typedef struct
+{
+	gboolean json;
+	gboolean first;   // no comma before the first JSON result
+	guint iterations;
+} BenchOptions;
+
+static guint64
+bench_now_ns (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (guint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static guint64
+bench_cycles (void)
+{
+#ifdef BENCH_HAVE_TSC
+	return __rdtsc ();
+#else
+	return 0;
+#endif
+}
+
+/* A camera frame as fc2RetrieveBuffer would leave it, filled with a repeatable pattern */
+static void
+bench_make_image (fc2Image *image, guint width, guint height, guint bpp)
+{
+	guint i;
+
+	memset (image, 0, sizeof (*image));
+	image->cols = width;
+	image->rows = height;
+	image->stride = width * bpp;
+	image->dataSize = image->stride * height;
+	image->receivedDataSize = image->dataSize;
+	image->format = FC2_PIXEL_FORMAT_RGB8;
+	image->pData = g_malloc (image->dataSize);
+
+	for (i = 0; i < image->dataSize; i++)
+		image->pData[i] = (guint8) (i * 2654435761u >> 24);
+}
+
+static void
+bench_report (BenchOptions *opt, const gchar *kernel, guint width, guint height, guint binning,
+		guint bpp, guint ops, guint64 ns, guint64 cycles, guint64 bytes, guint64 pixels)
+{
+	gdouble ns_frame = (gdouble) ns / opt->iterations;
+	gdouble gbs = ns ? (gdouble) bytes * opt->iterations / ns : 0.0;   // bytes per ns is GB/s
+	gdouble cpp = (cycles && pixels) ? (gdouble) cycles / opt->iterations / pixels : 0.0;
+
+	if (opt->json) {
+		printf ("%s\n    {\"kernel\": \"%s\", \"width\": %u, \"height\": %u, \"binning\": %u, \"bpp\": %u, \"ops\": %u, "
+				"\"ns_per_frame\": %.0f, \"gb_per_s\": %.3f, \"cycles_per_pixel\": %.3f}",
+				opt->first ? "" : ",", kernel, width, height, binning, bpp, ops, ns_frame, gbs, cpp);
+		opt->first = FALSE;
+	}
+	else {
+		printf ("%-10s %4ux%-4u bin %u bpp %u ops 0x%02x %12.0f ns/frame %8.3f GB/s %8.3f cycles/pixel\n",
+				kernel, width, height, binning, bpp, ops, ns_frame, gbs, cpp);
+	}
+}
+
+static void
+bench_copy_kernels (BenchOptions *opt, const BenchSensor *sensor)
+{
+	static const guint binnings[3] = { 1, 2, 4 };
+	static const guint bpps[2] = { 3, 4 };   // 3 is the specialised RGB path, 4 the run time one
+	guint32 hist[3][256];
+	guint b, p, ops, n;
+
+	for (b = 0; b < 3; b++) {
+		for (p = 0; p < 2; p++) {
+			fc2Image image;
+			guint bpp = bpps[p];
+			guint8 *dst = g_malloc (sensor->width * sensor->height * bpp);
+
+			bench_make_image (&image, sensor->raw_width[b], sensor->raw_height[b], bpp);
+
+			for (ops = 0; ops <= FLYCAP_KERNEL_OP_ALL; ops++) {
+				FlycapKernelFrame frame;
+				FlycapKernelFunc kernel = flycap_kernel_select (binnings[b], bpp, ops);
+				guint64 t0, t1, c0, c1;
+				gboolean transpose = (ops & FLYCAP_KERNEL_OP_TRANSPOSE) != 0;
+
+				frame.src = image.pData;
+				frame.src_stride = image.stride;
+				frame.src_width = image.cols;
+				frame.src_height = image.rows;
+				frame.dst = dst;
+				frame.dst_width = transpose ? sensor->height : sensor->width;
+				frame.dst_height = transpose ? sensor->width : sensor->height;
+				frame.dst_stride = frame.dst_width * bpp;
+				frame.bytes_per_pixel = bpp;
+				frame.hist = hist;
+
+				kernel (&frame);   // warm up
+				memset (hist, 0, sizeof (hist));
+
+				t0 = bench_now_ns ();
+				c0 = bench_cycles ();
+				for (n = 0; n < opt->iterations; n++)
+					kernel (&frame);
+				c1 = bench_cycles ();
+				t1 = bench_now_ns ();
+
+				bench_report (opt, "copy", sensor->width, sensor->height, binnings[b], bpp, ops,
+						t1 - t0, c1 - c0, image.dataSize + (guint64) frame.dst_stride * frame.dst_height,
+						(guint64) sensor->width * sensor->height);
+			}
+
+			g_free (image.pData);
+			g_free (dst);
+		}
+	}
+}
+
+static void
+bench_luma_histogram (BenchOptions *opt, const BenchSensor *sensor)
+{
+	static const guint binnings[3] = { 1, 2, 4 };
+	guint32 hist[256];
+	guint b, n, counted = 0;
+
+	for (b = 0; b < 3; b++) {
+		fc2Image image;
+		guint64 t0, t1, c0, c1;
+
+		bench_make_image (&image, sensor->raw_width[b], sensor->raw_height[b], 3);
+
+		t0 = bench_now_ns ();
+		c0 = bench_cycles ();
+		for (n = 0; n < opt->iterations; n++)
+			counted = flycap_kernel_luma_histogram (image.pData, image.stride, image.cols, image.rows, 3, 4, hist);
+		c1 = bench_cycles ();
+		t1 = bench_now_ns ();
+
+		// Traffic is the subsampled rows, memory is read a cache line at a time
+		bench_report (opt, "luma-hist", sensor->width, sensor->height, binnings[b], 3, 0,
+				t1 - t0, c1 - c0, (guint64) image.stride * image.rows / 4, counted);
+
+		g_free (image.pData);
+	}
+}
+
+/* Frame averaging, the accumulate is per camera frame and the average once per output frame */
+static void
+bench_accumulate (BenchOptions *opt, const BenchSensor *sensor)
+{
+	static const guint binnings[3] = { 1, 2, 4 };
+	guint b, n;
+
+	for (b = 0; b < 3; b++) {
+		fc2Image image;
+		guint row_bytes, size;
+		guint16 *acc;
+		guint8 *avg;
+		guint64 t0, t1, c0, c1;
+
+		bench_make_image (&image, sensor->raw_width[b], sensor->raw_height[b], 3);
+		row_bytes = image.cols * 3;
+		size = row_bytes * image.rows;
+		acc = g_new (guint16, size);
+		avg = g_malloc (size);
+
+		t0 = bench_now_ns ();
+		c0 = bench_cycles ();
+		for (n = 0; n < opt->iterations; n++)
+			flycap_kernel_accumulate (acc, image.pData, image.stride, row_bytes, image.rows, (n % 16) == 0);
+		c1 = bench_cycles ();
+		t1 = bench_now_ns ();
+
+		bench_report (opt, "accumulate", sensor->width, sensor->height, binnings[b], 3, 0,
+				t1 - t0, c1 - c0, (guint64) size * 5, size / 3);
+
+		t0 = bench_now_ns ();
+		c0 = bench_cycles ();
+		for (n = 0; n < opt->iterations; n++)
+			flycap_kernel_average (avg, row_bytes, acc, row_bytes, image.rows, 16);
+		c1 = bench_cycles ();
+		t1 = bench_now_ns ();
+
+		bench_report (opt, "average", sensor->width, sensor->height, binnings[b], 3, 0,
+				t1 - t0, c1 - c0, (guint64) size * 3, size / 3);
+
+		g_free (avg);
+		g_free (acc);
+		g_free (image.pData);
+	}
+}
+
+/* Dark and flat field correction, in place on the camera image before the copy */
+static void
+bench_calibrate (BenchOptions *opt, const BenchSensor *sensor)
+{
+	static const guint binnings[3] = { 1, 2, 4 };
+	guint b, i, n;
+
+	for (b = 0; b < 3; b++) {
+		fc2Image image;
+		guint row_bytes, size;
+		guint8 *dark;
+		guint16 *gain;
+		guint64 t0, t1, c0, c1;
+
+		bench_make_image (&image, sensor->raw_width[b], sensor->raw_height[b], 3);
+		row_bytes = image.cols * 3;
+		size = row_bytes * image.rows;
+		dark = g_malloc (size);
+		gain = g_new (guint16, size);
+		for (i = 0; i < size; i++) {
+			dark[i] = (guint8) (i & 7);
+			gain[i] = 4096 + (guint16) (i & 255);
+		}
+
+		t0 = bench_now_ns ();
+		c0 = bench_cycles ();
+		for (n = 0; n < opt->iterations; n++)
+			flycap_kernel_calibrate (image.pData, image.stride, row_bytes, image.rows, dark, gain);
+		c1 = bench_cycles ();
+		t1 = bench_now_ns ();
+
+		// Frame read and written, dark read, gain read at 2 bytes a sample
+		bench_report (opt, "calibrate", sensor->width, sensor->height, binnings[b], 3, 0,
+				t1 - t0, c1 - c0, (guint64) size * 5, size / 3);
+
+		g_free (gain);
+		g_free (dark);
+		g_free (image.pData);
+	}
+}
+
+/* Hot pixel patching, 1 in 1000 pixels listed, the cost is per defect */
+static void
+bench_patch_defects (BenchOptions *opt, const BenchSensor *sensor)
+{
+	fc2Image image;
+	guint32 *defects;
+	guint n_defects, i, n;
+	guint64 t0, t1, c0, c1;
+
+	bench_make_image (&image, sensor->raw_width[0], sensor->raw_height[0], 3);
+	n_defects = image.cols * image.rows / 1000;
+	defects = g_new (guint32, MAX (n_defects, 1));
+	for (i = 0; i < n_defects; i++)
+		defects[i] = i * 1000 + (i * 7 % 1000);
+
+	t0 = bench_now_ns ();
+	c0 = bench_cycles ();
+	for (n = 0; n < opt->iterations; n++)
+		flycap_kernel_patch_defects (image.pData, image.stride, image.cols, image.rows, 3, defects, n_defects);
+	c1 = bench_cycles ();
+	t1 = bench_now_ns ();
+
+	// Each defect reads its two neighbours and writes itself, a cache line each
+	bench_report (opt, "defects", sensor->width, sensor->height, 1, 3, 0,
+			t1 - t0, c1 - c0, (guint64) n_defects * 3 * 64, n_defects);
+
+	g_free (defects);
+	g_free (image.pData);
+}
+
+/* Preview box filter of the full camera image, the binning column is the downscale factor */
+static void
+bench_box_downscale (BenchOptions *opt, const BenchSensor *sensor)
+{
+	static const guint factors[3] = { 2, 4, 8 };
+	fc2Image image;
+	guint16 *row_acc;
+	guint8 *dst;
+	guint f, n;
+
+	bench_make_image (&image, sensor->raw_width[0], sensor->raw_height[0], 3);
+	row_acc = g_new (guint16, image.cols * 3);
+
+	for (f = 0; f < 3; f++) {
+		guint dst_width = image.cols / factors[f], dst_height = image.rows / factors[f];
+		guint64 t0, t1, c0, c1;
+
+		dst = g_malloc (dst_width * 3 * dst_height);
+
+		t0 = bench_now_ns ();
+		c0 = bench_cycles ();
+		for (n = 0; n < opt->iterations; n++)
+			flycap_kernel_box_downscale (dst, dst_width * 3, image.pData, image.stride,
+					image.cols, image.rows, 3, factors[f], row_acc);
+		c1 = bench_cycles ();
+		t1 = bench_now_ns ();
+
+		bench_report (opt, "box-down", sensor->width, sensor->height, factors[f], 3, 0,
+				t1 - t0, c1 - c0, (guint64) image.stride * image.rows + dst_width * 3 * dst_height,
+				dst_width * dst_height);
+
+		g_free (dst);
+	}
+
+	g_free (row_acc);
+	g_free (image.pData);
+}
+
+static void
+bench_lut (BenchOptions *opt)
+{
+	unsigned int lut[512];
+	guint64 t0, t1, c0, c1;
+	guint n;
+
+	t0 = bench_now_ns ();
+	c0 = bench_cycles ();
+	for (n = 0; n < opt->iterations; n++)
+		flycap_kernel_compute_lut (lut, n & 15, 0.45, 1.099, 4.5, 9, 0.099);
+	c1 = bench_cycles ();
+	t1 = bench_now_ns ();
+
+	bench_report (opt, "lut", 512, 1, 1, 4, 0, t1 - t0, c1 - c0, sizeof (lut), 512);
+}
+
+int
+main (int argc, char *argv[])
+{
+	BenchSensor sensors[3] = {
+		// Binned sizes as in get_image_size_for_camera_and_mode()
+		{ 1288, 964, { 1288, 644, 320 }, { 964, 482, 240 } },
+		{ 808, 608, { 808, 404, 200 }, { 608, 304, 122 } },
+	};
+	guint n_sensors = 2, i;
+	BenchOptions opt = { FALSE, TRUE, BENCH_DEFAULT_ITERATIONS };
+	const gchar *env = g_getenv ("FLYCAP_BENCH_ITERATIONS");
+
+	if (env)
+		opt.iterations = MAX (1, atoi (env));
+
+	for (i = 1; i < (guint) argc; i++) {
+		guint w, h;
+
+		if (strcmp (argv[i], "--json") == 0)
+			opt.json = TRUE;
+		else if (strcmp (argv[i], "--iterations") == 0 && i + 1 < (guint) argc) {
+			gint iterations = atoi (argv[++i]);
+			opt.iterations = MAX (1, iterations);
+		}
+		else if (strcmp (argv[i], "--size") == 0 && i + 1 < (guint) argc && sscanf (argv[++i], "%ux%u", &w, &h) == 2
+				&& w >= 4 && h >= 4) {
+			BenchSensor *s = &sensors[2];
+			s->width = w;
+			s->height = h;
+			s->raw_width[0] = w;
+			s->raw_height[0] = h;
+			s->raw_width[1] = w/2;
+			s->raw_height[1] = h/2;
+			s->raw_width[2] = w/4;
+			s->raw_height[2] = h/4;
+			n_sensors = 3;
+		}
+		else {
+			fprintf (stderr, "Usage: %s [--json] [--size WxH] [--iterations N]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (opt.json)
+		printf ("{\n  \"iterations\": %u,\n  \"results\": [", opt.iterations);
+
+	for (i = 0; i < n_sensors; i++) {
+		bench_copy_kernels (&opt, &sensors[i]);
+		bench_luma_histogram (&opt, &sensors[i]);
+		bench_accumulate (&opt, &sensors[i]);
+		bench_calibrate (&opt, &sensors[i]);
+		bench_patch_defects (&opt, &sensors[i]);
+		bench_box_downscale (&opt, &sensors[i]);
+	}
+	bench_lut (&opt);
+
+	if (opt.json)
+		printf ("\n  ]\n}\n");
+
+	return 0;
+}
@@ -0,0 +1,87 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015-2016 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ *
+ */
+/*
+ * Check of the frame interval estimate flycapsrc uses for buffer durations and timestamps, run by 'make check'.
+ * Frame arrival times are fed in as the camera would deliver them: a lost frame must not move the estimate,
+ * a real change of rate, more than the window allows, must be followed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include "gstflycaplatency.h"
+
+static gint failures = 0;
+
+// Feed n frames delta apart, return the estimate after them
+static GstClockTime
+feed (GstClockTime interval, GstClockTime delta, guint n, guint *outliers)
+{
+	guint i;
+
+	for (i = 0; i < n; i++)
+		interval = flycap_latency_interval_update (interval, delta, outliers);
+
+	return interval;
+}
+
+static void
+check (const gchar *what, GstClockTime got, GstClockTime want)
+{
+	GstClockTimeDiff err = (GstClockTimeDiff) got - (GstClockTimeDiff) want;
+
+	// 1% of the interval
+	if (ABS (err) * 100 > (GstClockTimeDiff) want) {
+		printf ("FAIL %s: %" G_GUINT64_FORMAT " ns, expected %" G_GUINT64_FORMAT " ns\n", what, got, want);
+		failures++;
+	}
+	else
+		printf ("ok   %s: %" G_GUINT64_FORMAT " ns\n", what, got);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GstClockTime interval = 10 * GST_MSECOND;   // FC2_FRAME_RATE says 100 fps
+	guint outliers = 0;
+
+	// Small jitter is averaged
+	interval = feed (interval, 11 * GST_MSECOND, 200, &outliers);
+	check ("jitter within the window", interval, 11 * GST_MSECOND);
+
+	// A lost frame, and the burst after a stall, are left out
+	interval = flycap_latency_interval_update (interval, 22 * GST_MSECOND, &outliers);
+	interval = flycap_latency_interval_update (interval, 1 * GST_MSECOND, &outliers);
+	check ("lost frame and burst", interval, 11 * GST_MSECOND);
+	interval = feed (interval, 11 * GST_MSECOND, 4, &outliers);
+
+	// The bus only delivers at a third of the rate the camera reports
+	interval = feed (interval, 33 * GST_MSECOND, FLYCAP_INTERVAL_RESEED + 50, &outliers);
+	check ("rate step down to a third", interval, 33 * GST_MSECOND);
+
+	// And back up, faster than the window again
+	interval = feed (interval, 5 * GST_MSECOND, FLYCAP_INTERVAL_RESEED + 50, &outliers);
+	check ("rate step up sixfold", interval, 5 * GST_MSECOND);
+
+	return failures ? 1 : 0;
+}
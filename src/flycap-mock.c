@@ -0,0 +1,1253 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015-2016 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ *
+ */
+/*
+ * Stand in for the FlyCapture2 C library, so the element can be run without a camera.
+ *
+ * Implements the fc2 calls that gstflycapsrc.c makes against a simulated camera: properties, Format7,
+ * LUT, registers and memory channels are remembered, fc2RetrieveBuffer delivers synthetic RGB frames
+ * from a free running sensor clock. Configure with ./configure --enable-flycap-mock and set FLYCAP_MOCK, e.g.
+ *
+ *   FLYCAP_MOCK="fps=60,latency=3,jitter=1,drop=0.01,error=0.001,report=1" gst-launch-1.0 flycapsrc ! fakesink
+ *
+ * Options, comma separated:
+ *  sensor=WxH   sensor resolution, 1288x964 (default) or 808x608 as the element knows
+ *  fps=F        fixed frame rate, otherwise it follows the FC2_FRAME_RATE property or the shutter
+ *  max-fps=F    fastest the sensor can go when following the shutter, default 30
+ *  latency=MS   time from the end of exposure until the frame can be retrieved, default 0
+ *  jitter=MS    extra random delivery delay, 0..MS per frame, default 0
+ *  drop=P       probability a frame is lost on the bus and never delivered
+ *  error=P      probability fc2RetrieveBuffer fails with FC2_ERROR_IMAGE_CONSISTENCY_ERROR
+ *  cameras=N    number of cameras fc2GetNumOfCameras reports, default 1
+ *  unplug=S     the camera drops off the bus S seconds after capture first starts, once, and comes
+ *               back power cycled with its settings lost
+ *  bus-reset=S  as unplug, but the camera keeps its settings
+ *  replug=MS    how long it stays away before it can be found and connected again, default 2000
+ *  control=MS   time each control read or write takes, as a bus round trip, default 0
+ *  settle=N     frames before a shutter or gain change reaches the embedded image information, default 2
+ *  seed=N       random seed for drops, errors and jitter, default 1
+ *  report=1     print frame and CPU counts to stderr at fc2Disconnect
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <glib.h>
+
+#include "FlyCapture2_C.h"
+
+#define MOCK_N_PROPERTIES (FC2_UNSPECIFIED_PROPERTY_TYPE)
+#define MOCK_N_REGISTERS 0x800     // quadlets, covers 0x0000-0x1FFC
+#define MOCK_ROI_BASE 0x1A80       // where the AE ROI block lives in the register space
+#define MOCK_LUT_ENTRIES 512
+#define MOCK_SERIAL 12345678
+#define MOCK_N_CHANNELS 2          // user memory channels, 0 holds the factory defaults
+
+// What a memory channel keeps, it survives a power cycle
+typedef struct
+{
+	gboolean saved;
+	fc2Property properties[MOCK_N_PROPERTIES];
+	fc2Format7ImageSettings format7;
+	unsigned int packet_size;
+	fc2StrobeControl strobe;
+} MockChannel;
+
+typedef struct
+{
+	// configuration from FLYCAP_MOCK
+	guint sensor_w, sensor_h;
+	gdouble fps, max_fps;
+	gint64 latency_us, jitter_us;
+	gdouble drop, error;
+	guint cameras;
+	guint32 seed;
+	gboolean report;
+	gint64 unplug_us, replug_us;
+	gboolean keep_settings;
+	gint64 control_us;
+	gint64 settle;
+
+	GMutex lock;
+	gboolean connected;
+	gboolean capturing;
+	gint64 unplug_at;         // when the camera drops off the bus, 0 if it never does
+	gboolean lost;            // the connection died with the unplug, only a new fc2Connect recovers
+	fc2BusEventCallback arrival_callback, removal_callback;
+	void *arrival_data, *removal_data;
+	GThread *arrival_thread;  // announces the camera when it is back
+
+	// camera state
+	fc2Property properties[MOCK_N_PROPERTIES];
+	unsigned int registers[MOCK_N_REGISTERS];
+	fc2Format7ImageSettings format7;
+	unsigned int packet_size;
+	BOOL lut_on;
+	unsigned int lut_bank;
+	unsigned int lut[2][3][MOCK_LUT_ENTRIES];
+	fc2StrobeControl strobe;
+	fc2Config config;
+	MockChannel channels[MOCK_N_CHANNELS + 1];
+	fc2EmbeddedImageInfo embedded;
+
+	// frames before shutter_from were exposed with shutter_old, the register value, likewise gain
+	unsigned int shutter_old, gain_old;
+	gint64 shutter_from, gain_from;
+
+	// sensor clock, frame k finishes exposure at start_time + k*period
+	guint8 *pattern;          // 2 x rows of test pattern, frames are a scrolling window into it
+	gint64 start_time;
+	gint64 period_us;
+	gint64 next_frame;
+
+	// counters for the report
+	guint64 n_delivered, n_dropped, n_skipped, n_errors;
+	guint64 n_reads, n_writes;    // control transactions
+	gint64 latency_sum_us;
+} MockCamera;
+
+static const char *
+mock_option (const char *options, const char *key)
+{
+	size_t len = strlen (key);
+	const char *p = options;
+
+	while (p && *p) {
+		if (strncmp (p, key, len) == 0 && p[len] == '=')
+			return p + len + 1;
+		p = strchr (p, ',');
+		if (p)
+			p++;
+	}
+	return NULL;
+}
+
+static void
+mock_parse_options (MockCamera *cam)
+{
+	const char *options = g_getenv ("FLYCAP_MOCK");
+	const char *val;
+
+	cam->sensor_w = 1288;
+	cam->sensor_h = 964;
+	cam->fps = 0.0;
+	cam->max_fps = 30.0;
+	cam->cameras = 1;
+	cam->seed = 1;
+	cam->replug_us = 2000000;
+	cam->settle = 2;
+
+	if (!options)
+		return;
+
+	if ((val = mock_option (options, "sensor")))
+		sscanf (val, "%ux%u", &cam->sensor_w, &cam->sensor_h);
+	if ((val = mock_option (options, "fps")))
+		cam->fps = g_ascii_strtod (val, NULL);
+	if ((val = mock_option (options, "max-fps")))
+		cam->max_fps = g_ascii_strtod (val, NULL);
+	if ((val = mock_option (options, "latency")))
+		cam->latency_us = (gint64) (g_ascii_strtod (val, NULL) * 1000);
+	if ((val = mock_option (options, "jitter")))
+		cam->jitter_us = (gint64) (g_ascii_strtod (val, NULL) * 1000);
+	if ((val = mock_option (options, "drop")))
+		cam->drop = CLAMP (g_ascii_strtod (val, NULL), 0.0, 0.99);
+	if ((val = mock_option (options, "error")))
+		cam->error = g_ascii_strtod (val, NULL);
+	if ((val = mock_option (options, "cameras")))
+		cam->cameras = atoi (val);
+	if ((val = mock_option (options, "seed")))
+		cam->seed = atoi (val);
+	if ((val = mock_option (options, "unplug")))
+		cam->unplug_us = (gint64) (g_ascii_strtod (val, NULL) * 1000000);
+	if ((val = mock_option (options, "bus-reset"))) {
+		cam->unplug_us = (gint64) (g_ascii_strtod (val, NULL) * 1000000);
+		cam->keep_settings = TRUE;
+	}
+	if ((val = mock_option (options, "replug")))
+		cam->replug_us = (gint64) (g_ascii_strtod (val, NULL) * 1000);
+	if ((val = mock_option (options, "control")))
+		cam->control_us = (gint64) (g_ascii_strtod (val, NULL) * 1000);
+	if ((val = mock_option (options, "settle")))
+		cam->settle = atoi (val);
+	if ((val = mock_option (options, "report")))
+		cam->report = atoi (val) != 0;
+}
+
+/* Repeatable per frame random number in [0,1), so a frame's fate does not depend on when it is asked about */
+static gdouble
+mock_random (MockCamera *cam, gint64 frame, guint32 stream)
+{
+	guint64 x = (guint64) frame * 0x9E3779B97F4A7C15ull ^ ((guint64) cam->seed << 32) ^ stream;
+
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDull;
+	x ^= x >> 33;
+	x *= 0xC4CEB9FE1A85EC53ull;
+	x ^= x >> 33;
+
+	return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* The camera is off the bus between unplug and replug, and cannot be found */
+static gboolean
+mock_unplugged (MockCamera *cam)
+{
+	gint64 now = g_get_monotonic_time ();
+
+	return cam->unplug_at && now >= cam->unplug_at && now < cam->unplug_at + cam->replug_us;
+}
+
+/* Every control read or write is one transaction on the bus */
+static void
+mock_transaction (MockCamera *cam, gboolean write)
+{
+	if (write)
+		cam->n_writes++;
+	else
+		cam->n_reads++;
+	if (cam->control_us > 0)
+		g_usleep (cam->control_us);
+}
+
+static gpointer
+mock_arrival_thread (gpointer data)
+{
+	MockCamera *cam = data;
+	gint64 wait = cam->unplug_at + cam->replug_us - g_get_monotonic_time ();
+
+	if (wait > 0)
+		g_usleep (wait);
+	if (cam->arrival_callback)
+		cam->arrival_callback (cam->arrival_data, MOCK_SERIAL);
+
+	return NULL;
+}
+
+static gint64
+mock_frame_ready_time (MockCamera *cam, gint64 frame)
+{
+	return cam->start_time + frame * cam->period_us + cam->latency_us
+			+ (gint64) (mock_random (cam, frame, 1) * cam->jitter_us);
+}
+
+/* Frame rate from the fixed rate, the frame rate property or the shutter, as the camera would run */
+static gdouble
+mock_frame_rate (MockCamera *cam)
+{
+	fc2Property *rate = &cam->properties[FC2_FRAME_RATE];
+	fc2Property *shutter = &cam->properties[FC2_SHUTTER];
+	gdouble fps = cam->max_fps;
+
+	if (cam->fps > 0.0)
+		fps = cam->fps;
+	else {
+		if (rate->onOff && rate->absValue > 0.0f)
+			fps = MIN (fps, rate->absValue);
+		if (shutter->absValue > 0.0f)
+			fps = MIN (fps, 1000.0 / shutter->absValue);
+	}
+
+	return MAX (fps, 0.1);
+}
+
+/* The camera's register value for an absolute shutter (10 us steps) or gain (0.1 dB steps) */
+static unsigned int
+mock_raw_value (fc2PropertyType type, float value)
+{
+	gdouble step = type == FC2_SHUTTER ? 0.01 : 0.1;
+
+	return (unsigned int) CLAMP (value / step + 0.5, 0, 0xFFF);
+}
+
+/* The embedded image information the camera writes over the first pixels, a big endian word for
+ * each field that is on in register order. Shutter and gain changes show settle frames after they
+ * were written. */
+static void
+mock_embed_info (MockCamera *cam, guint8 *data, gint64 frame)
+{
+	gint64 exposed = cam->start_time + frame * cam->period_us;
+	guint32 words[10];
+	guint n = 0, i;
+
+	g_mutex_lock (&cam->lock);
+	if (cam->embedded.timestamp.onOff)     // 1394 cycle time, seconds, 8 kHz cycles and offset
+		words[n++] = (guint32) ((exposed / 1000000 % 128) << 25 | (exposed % 1000000 / 125) << 12);
+	if (cam->embedded.gain.onOff)
+		words[n++] = 0x82000000 | (frame < cam->gain_from ? cam->gain_old : cam->properties[FC2_GAIN].valueA);
+	if (cam->embedded.shutter.onOff)
+		words[n++] = 0x82000000 | (frame < cam->shutter_from ? cam->shutter_old : cam->properties[FC2_SHUTTER].valueA);
+	if (cam->embedded.brightness.onOff)
+		words[n++] = 0x82000000 | (cam->properties[FC2_BRIGHTNESS].valueA & 0xFFF);
+	if (cam->embedded.exposure.onOff)
+		words[n++] = 0x82000000 | (cam->properties[FC2_AUTO_EXPOSURE].valueA & 0xFFF);
+	if (cam->embedded.whiteBalance.onOff)
+		words[n++] = cam->registers[0x80C / 4];
+	if (cam->embedded.frameCounter.onOff)
+		words[n++] = (guint32) frame;
+	if (cam->embedded.strobePattern.onOff)
+		words[n++] = 0;
+	if (cam->embedded.GPIOPinState.onOff)
+		words[n++] = 0;
+	if (cam->embedded.ROIPosition.onOff)
+		words[n++] = 0;
+	g_mutex_unlock (&cam->lock);
+
+	for (i = 0; i < n; i++)
+		words[i] = GUINT32_TO_BE (words[i]);
+	memcpy (data, words, n * sizeof (guint32));
+}
+
+static void
+mock_update_period (MockCamera *cam)
+{
+	cam->period_us = (gint64) (1000000.0 / mock_frame_rate (cam));
+}
+
+static void
+mock_make_pattern (MockCamera *cam)
+{
+	guint bpp = 3, x, y;
+	guint stride = cam->format7.width * bpp;
+
+	g_free (cam->pattern);
+	cam->pattern = g_malloc ((gsize) stride * cam->format7.height * 2);
+
+	for (y = 0; y < cam->format7.height * 2; y++) {
+		guint8 *p = cam->pattern + (gsize) y * stride;
+		for (x = 0; x < cam->format7.width; x++) {
+			p[0] = (guint8) (x * 255 / cam->format7.width);
+			p[1] = (guint8) (y * 255 / cam->format7.height);
+			p[2] = (guint8) ((x / 32 + y / 32) & 1 ? 192 : 64);
+			p += bpp;
+		}
+	}
+}
+
+static void
+mock_save_channel (MockCamera *cam, MockChannel *channel)
+{
+	g_mutex_lock (&cam->lock);
+	memcpy (channel->properties, cam->properties, sizeof (cam->properties));
+	channel->format7 = cam->format7;
+	channel->packet_size = cam->packet_size;
+	channel->strobe = cam->strobe;
+	channel->saved = TRUE;
+	g_mutex_unlock (&cam->lock);
+}
+
+static void
+mock_reset_camera (MockCamera *cam)
+{
+	guint i;
+
+	memset (cam->properties, 0, sizeof (cam->properties));
+	for (i = 0; i < MOCK_N_PROPERTIES; i++) {
+		cam->properties[i].type = i;
+		cam->properties[i].present = TRUE;
+		cam->properties[i].absControl = TRUE;
+		cam->properties[i].onOff = TRUE;
+	}
+	cam->properties[FC2_SHUTTER].absValue = 10.0f;      // ms
+	cam->properties[FC2_SHUTTER].valueA = mock_raw_value (FC2_SHUTTER, 10.0f);
+	cam->properties[FC2_GAIN].absValue = 0.0f;          // dB
+	cam->properties[FC2_GAMMA].absValue = 1.0f;
+	cam->properties[FC2_FRAME_RATE].absValue = 30.0f;
+	cam->properties[FC2_WHITE_BALANCE].valueA = 512;
+	cam->properties[FC2_WHITE_BALANCE].valueB = 512;
+	cam->properties[FC2_TEMPERATURE].valueA = 3000;     // 0.1 K
+
+	memset (cam->registers, 0, sizeof (cam->registers));
+	cam->registers[0x80C / 4] = 0x82000000 | (512 << 12) | 512;      // white balance, present and on
+	cam->registers[0x1054 / 4] = 0x80000000;                          // mirror image, present
+	cam->registers[0x1A70 / 4] = 0x80000000;                          // AE ROI, present
+	cam->registers[0x1A74 / 4] = (0xF00000 + MOCK_ROI_BASE) / 4;
+	cam->registers[MOCK_ROI_BASE / 4] = (4 << 16) | 2;                // left and top units
+	cam->registers[MOCK_ROI_BASE / 4 + 1] = (8 << 16) | 2;            // width and height units
+	cam->registers[MOCK_ROI_BASE / 4 + 3] = (cam->sensor_w << 16) | cam->sensor_h;
+
+	memset (&cam->format7, 0, sizeof (cam->format7));
+	cam->format7.mode = FC2_MODE_0;
+	cam->format7.width = cam->sensor_w;
+	cam->format7.height = cam->sensor_h;
+	cam->format7.pixelFormat = FC2_PIXEL_FORMAT_RGB8;
+	cam->packet_size = 4096;
+	cam->lut_on = FALSE;
+	cam->lut_bank = 0;
+	memset (cam->lut, 0, sizeof (cam->lut));
+	memset (&cam->strobe, 0, sizeof (cam->strobe));
+	memset (&cam->embedded, 0, sizeof (cam->embedded));
+	cam->shutter_from = cam->gain_from = 0;
+
+	memset (&cam->config, 0, sizeof (cam->config));
+	cam->config.numBuffers = 4;
+	cam->config.grabMode = FC2_DROP_FRAMES;
+	cam->config.grabTimeout = FC2_TIMEOUT_INFINITE;
+
+	// Channel 0 holds what the camera powers up with
+	if (!cam->channels[0].saved)
+		mock_save_channel (cam, &cam->channels[0]);
+}
+
+const char *
+fc2ErrorToDescription (fc2Error error)
+{
+	switch (error) {
+	case FC2_ERROR_OK:
+		return "Ok. (mock)";
+	case FC2_ERROR_NOT_CONNECTED:
+		return "Camera is not connected. (mock)";
+	case FC2_ERROR_INVALID_PARAMETER:
+		return "Invalid parameter. (mock)";
+	case FC2_ERROR_NOT_FOUND:
+		return "Camera not found. (mock)";
+	case FC2_ERROR_ISOCH_NOT_STARTED:
+		return "Isochronous transfer not started. (mock)";
+	case FC2_ERROR_TIMEOUT:
+		return "Timeout. (mock)";
+	case FC2_ERROR_IMAGE_CONSISTENCY_ERROR:
+		return "Image consistency error, injected. (mock)";
+	default:
+		return "Undefined error. (mock)";
+	}
+}
+
+fc2Error
+fc2CreateContext (fc2Context *pContext)
+{
+	MockCamera *cam;
+
+	if (!pContext)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	cam = g_new0 (MockCamera, 1);
+	g_mutex_init (&cam->lock);
+	mock_parse_options (cam);
+	mock_reset_camera (cam);
+	*pContext = cam;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2DestroyContext (fc2Context context)
+{
+	MockCamera *cam = context;
+
+	if (!cam)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	if (cam->arrival_thread)
+		g_thread_join (cam->arrival_thread);
+	g_mutex_clear (&cam->lock);
+	g_free (cam->pattern);
+	g_free (cam);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2GetNumOfCameras (fc2Context context, unsigned int *pNumCameras)
+{
+	MockCamera *cam = context;
+
+	*pNumCameras = cam->cameras;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2GetCameraFromIndex (fc2Context context, unsigned int index, fc2PGRGuid *pGuid)
+{
+	MockCamera *cam = context;
+
+	if (index >= cam->cameras || mock_unplugged (cam))
+		return FC2_ERROR_NOT_FOUND;
+
+	memset (pGuid, 0, sizeof (*pGuid));
+	pGuid->value[0] = MOCK_SERIAL + index;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2GetCameraFromSerialNumber (fc2Context context, unsigned int serialNumber, fc2PGRGuid *pGuid)
+{
+	MockCamera *cam = context;
+
+	if (serialNumber < MOCK_SERIAL || serialNumber >= MOCK_SERIAL + cam->cameras)
+		return FC2_ERROR_NOT_FOUND;
+
+	return fc2GetCameraFromIndex (context, serialNumber - MOCK_SERIAL, pGuid);
+}
+
+fc2Error
+fc2Connect (fc2Context context, fc2PGRGuid *guid)
+{
+	MockCamera *cam = context;
+
+	if (cam->cameras == 0 || mock_unplugged (cam))
+		return FC2_ERROR_NOT_FOUND;
+
+	g_mutex_lock (&cam->lock);
+	if (cam->lost) {
+		if (!cam->keep_settings)
+			mock_reset_camera (cam);    // it has been power cycled, everything has to be set again
+		cam->lost = FALSE;
+	}
+	cam->connected = TRUE;
+	cam->n_delivered = cam->n_dropped = cam->n_skipped = cam->n_errors = 0;
+	cam->latency_sum_us = 0;
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2Disconnect (fc2Context context)
+{
+	MockCamera *cam = context;
+
+	if (cam->report && cam->connected) {
+		struct rusage usage;
+		gdouble elapsed = (g_get_monotonic_time () - cam->start_time) / 1e6;
+
+		getrusage (RUSAGE_SELF, &usage);
+		fprintf (stderr, "flycap-mock: %" G_GUINT64_FORMAT " delivered, %" G_GUINT64_FORMAT " dropped, %"
+				G_GUINT64_FORMAT " skipped by a slow consumer, %" G_GUINT64_FORMAT " errors\n",
+				cam->n_delivered, cam->n_dropped, cam->n_skipped, cam->n_errors);
+		fprintf (stderr, "flycap-mock: %.2f fps delivered (camera %.2f fps), mean retrieve latency %.3f ms\n",
+				elapsed > 0 ? cam->n_delivered / elapsed : 0.0, 1e6 / cam->period_us,
+				cam->n_delivered ? cam->latency_sum_us / 1000.0 / cam->n_delivered : 0.0);
+		fprintf (stderr, "flycap-mock: %" G_GUINT64_FORMAT " control reads, %" G_GUINT64_FORMAT " writes\n",
+				cam->n_reads, cam->n_writes);
+		fprintf (stderr, "flycap-mock: process cpu user %ld.%03lds sys %ld.%03lds\n",
+				(long) usage.ru_utime.tv_sec, (long) usage.ru_utime.tv_usec / 1000,
+				(long) usage.ru_stime.tv_sec, (long) usage.ru_stime.tv_usec / 1000);
+	}
+
+	g_mutex_lock (&cam->lock);
+	cam->connected = FALSE;
+	cam->capturing = FALSE;
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2GetCameraInfo (fc2Context context, fc2CameraInfo *pCameraInfo)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+
+	memset (pCameraInfo, 0, sizeof (*pCameraInfo));
+	pCameraInfo->serialNumber = MOCK_SERIAL;
+	pCameraInfo->isColorCamera = TRUE;
+	pCameraInfo->interfaceType = FC2_INTERFACE_USB_3;
+	g_strlcpy (pCameraInfo->modelName, "Mock Camera", sizeof (pCameraInfo->modelName));
+	g_strlcpy (pCameraInfo->vendorName, "flycap-mock", sizeof (pCameraInfo->vendorName));
+	g_snprintf (pCameraInfo->sensorInfo, sizeof (pCameraInfo->sensorInfo), "Synthetic RGB %ux%u", cam->sensor_w, cam->sensor_h);
+	g_snprintf (pCameraInfo->sensorResolution, sizeof (pCameraInfo->sensorResolution), "%ux%u", cam->sensor_w, cam->sensor_h);
+	g_strlcpy (pCameraInfo->firmwareVersion, "0.0.0", sizeof (pCameraInfo->firmwareVersion));
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2GetConfiguration (fc2Context context, fc2Config *config)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+
+	*config = cam->config;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2SetConfiguration (fc2Context context, fc2Config *config)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+
+	g_mutex_lock (&cam->lock);
+	cam->config = *config;
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+/* Skipped frames are what the SDK counts as dropped, bus losses as dropped by the driver */
+fc2Error
+fc2GetStats (fc2Context context, fc2CameraStats *pStats)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+
+	memset (pStats, 0, sizeof (*pStats));
+	g_mutex_lock (&cam->lock);
+	pStats->imageDropped = cam->n_skipped;
+	pStats->imageDriverDropped = cam->n_dropped;
+	pStats->imageCorrupt = cam->n_errors;
+	pStats->cameraPowerUp = TRUE;
+	pStats->temperature = cam->properties[FC2_TEMPERATURE].valueA;
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2StartCapture (fc2Context context)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+
+	g_mutex_lock (&cam->lock);
+	mock_update_period (cam);
+	mock_make_pattern (cam);
+	cam->start_time = g_get_monotonic_time ();
+	cam->next_frame = 1;    // frame 0 would be ready at once, a camera needs one exposure first
+	if (cam->unplug_us && !cam->unplug_at)
+		cam->unplug_at = cam->start_time + cam->unplug_us;
+	cam->capturing = TRUE;
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2StopCapture (fc2Context context)
+{
+	MockCamera *cam = context;
+
+	if (!cam->capturing)
+		return FC2_ERROR_ISOCH_NOT_STARTED;
+
+	g_mutex_lock (&cam->lock);
+	cam->capturing = FALSE;
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+/* Wait for the next frame that makes it across the bus, or the newest one if the caller has fallen behind (FC2_DROP_FRAMES).
+ * Gives up with FC2_ERROR_TIMEOUT after grabTimeout, as the SDK does. */
+fc2Error
+fc2RetrieveBuffer (fc2Context context, fc2Image *pImage)
+{
+	MockCamera *cam = context;
+	gint64 frame, now, ready, timeout_us;
+	guint stride, size;
+
+	if (!cam->capturing)
+		return FC2_ERROR_ISOCH_NOT_STARTED;
+
+	timeout_us = cam->config.grabTimeout >= 0 ? (gint64) cam->config.grabTimeout * 1000 : G_MAXINT64;
+
+	// Once the camera has dropped off the bus nothing more arrives on this connection
+	if (cam->unplug_us && cam->unplug_at && g_get_monotonic_time () >= cam->unplug_at) {
+		cam->lost = TRUE;
+		cam->unplug_us = 0;     // it only happens once
+		if (cam->removal_callback)
+			cam->removal_callback (cam->removal_data, MOCK_SERIAL);
+		cam->arrival_thread = g_thread_new ("flycap-mock", mock_arrival_thread, cam);
+	}
+	if (cam->lost) {
+		if (timeout_us == G_MAXINT64)
+			return FC2_ERROR_NOT_CONNECTED;   // rather than hang for ever
+		g_usleep (timeout_us);
+		return FC2_ERROR_TIMEOUT;
+	}
+
+	g_mutex_lock (&cam->lock);
+
+	frame = cam->next_frame;
+	now = g_get_monotonic_time ();
+
+	// Skip frames the caller was too slow for, the driver would have overwritten them
+	while (mock_frame_ready_time (cam, frame + 1) <= now) {
+		frame++;
+		cam->n_skipped++;
+	}
+
+	// Skip frames lost on the bus
+	while (mock_random (cam, frame, 2) < cam->drop) {
+		frame++;
+		cam->n_dropped++;
+	}
+
+	ready = mock_frame_ready_time (cam, frame);
+	if (ready - now > timeout_us) {
+		cam->next_frame = frame;
+		g_mutex_unlock (&cam->lock);
+		g_usleep (timeout_us);
+		return FC2_ERROR_TIMEOUT;
+	}
+	cam->next_frame = frame + 1;
+	g_mutex_unlock (&cam->lock);
+
+	if (ready > now)
+		g_usleep (ready - now);
+
+	if (mock_random (cam, frame, 3) < cam->error) {
+		cam->n_errors++;
+		return FC2_ERROR_IMAGE_CONSISTENCY_ERROR;
+	}
+
+	stride = cam->format7.width * 3;
+	size = stride * cam->format7.height;
+	if (pImage->dataSize < size) {
+		g_free (pImage->pData);
+		pImage->pData = g_malloc (size);
+		pImage->dataSize = size;
+	}
+	pImage->rows = cam->format7.height;
+	pImage->cols = cam->format7.width;
+	pImage->stride = stride;
+	pImage->receivedDataSize = size;
+	pImage->format = cam->format7.pixelFormat;
+	pImage->bayerFormat = FC2_BT_NONE;
+
+	// The copy is the cost a real driver has too, scroll the pattern so frames differ
+	memcpy (pImage->pData, cam->pattern + (gsize) (frame % cam->format7.height) * stride, size);
+	mock_embed_info (cam, pImage->pData, frame);
+
+	cam->n_delivered++;
+	cam->latency_sum_us += g_get_monotonic_time () - (cam->start_time + frame * cam->period_us);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2CreateImage (fc2Image *pImage)
+{
+	memset (pImage, 0, sizeof (*pImage));
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2DestroyImage (fc2Image *image)
+{
+	g_free (image->pData);
+	memset (image, 0, sizeof (*image));
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2SetImageDimensions (fc2Image *pImage, unsigned int rows, unsigned int cols, unsigned int stride,
+		fc2PixelFormat pixelFormat, fc2BayerTileFormat bayerFormat)
+{
+	pImage->rows = rows;
+	pImage->cols = cols;
+	pImage->stride = stride;
+	pImage->format = pixelFormat;
+	pImage->bayerFormat = bayerFormat;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2ConvertImageTo (fc2PixelFormat format, fc2Image *pImageIn, fc2Image *pImageOut)
+{
+	// Frames are already RGB8, a straight copy is the only conversion supported
+	if (format != pImageIn->format)
+		return FC2_ERROR_NOT_IMPLEMENTED;
+
+	if (pImageOut->dataSize < pImageIn->receivedDataSize) {
+		g_free (pImageOut->pData);
+		pImageOut->pData = g_malloc (pImageIn->receivedDataSize);
+		pImageOut->dataSize = pImageIn->receivedDataSize;
+	}
+	memcpy (pImageOut->pData, pImageIn->pData, pImageIn->receivedDataSize);
+	pImageOut->rows = pImageIn->rows;
+	pImageOut->cols = pImageIn->cols;
+	pImageOut->stride = pImageIn->stride;
+	pImageOut->receivedDataSize = pImageIn->receivedDataSize;
+	pImageOut->format = pImageIn->format;
+	pImageOut->bayerFormat = pImageIn->bayerFormat;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2DetermineBitsPerPixel (fc2PixelFormat format, unsigned int *pBitsPerPixel)
+{
+	switch (format) {
+	case FC2_PIXEL_FORMAT_RGB8:
+		*pBitsPerPixel = 24;
+		break;
+	case FC2_PIXEL_FORMAT_RAW8:
+	case FC2_PIXEL_FORMAT_MONO8:
+		*pBitsPerPixel = 8;
+		break;
+	default:
+		return FC2_ERROR_NOT_IMPLEMENTED;
+	}
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2GetProperty (fc2Context context, fc2Property *prop)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, FALSE);
+	if ((unsigned int) prop->type >= MOCK_N_PROPERTIES)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	g_mutex_lock (&cam->lock);
+	*prop = cam->properties[prop->type];
+	if (prop->type == FC2_FRAME_RATE)
+		prop->absValue = (float) mock_frame_rate (cam);   // the rate it runs at, as the camera reports
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2SetProperty (fc2Context context, fc2Property *prop)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, TRUE);
+	if ((unsigned int) prop->type >= MOCK_N_PROPERTIES)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	g_mutex_lock (&cam->lock);
+	// Frames already exposed, and those for the next settle frames, keep the old value
+	if (prop->type == FC2_SHUTTER && cam->capturing) {
+		if (cam->next_frame >= cam->shutter_from)
+			cam->shutter_old = cam->properties[FC2_SHUTTER].valueA;
+		cam->shutter_from = cam->next_frame + cam->settle;
+	}
+	if (prop->type == FC2_GAIN && cam->capturing) {
+		if (cam->next_frame >= cam->gain_from)
+			cam->gain_old = cam->properties[FC2_GAIN].valueA;
+		cam->gain_from = cam->next_frame + cam->settle;
+	}
+	cam->properties[prop->type] = *prop;
+	cam->properties[prop->type].present = TRUE;
+	if (prop->absControl && (prop->type == FC2_SHUTTER || prop->type == FC2_GAIN))
+		cam->properties[prop->type].valueA = mock_raw_value (prop->type, prop->absValue);
+	if (prop->type == FC2_WHITE_BALANCE)
+		cam->registers[0x80C / 4] = (cam->registers[0x80C / 4] & 0xFF000000)
+				| ((prop->valueA & 0xFFF) << 12) | (prop->valueB & 0xFFF);
+
+	// A new shutter or frame rate changes the sensor clock from the next frame
+	if (cam->capturing && (prop->type == FC2_SHUTTER || prop->type == FC2_FRAME_RATE)) {
+		gint64 next_exposure = cam->start_time + cam->next_frame * cam->period_us;
+		mock_update_period (cam);
+		cam->start_time = next_exposure - cam->next_frame * cam->period_us;
+	}
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2ReadRegister (fc2Context context, unsigned int address, unsigned int *pValue)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, FALSE);
+	if (address & 3 || address / 4 >= MOCK_N_REGISTERS)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	g_mutex_lock (&cam->lock);
+	*pValue = cam->registers[address / 4];
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2WriteRegister (fc2Context context, unsigned int address, unsigned int value)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, TRUE);
+	if (address & 3 || address / 4 >= MOCK_N_REGISTERS)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	g_mutex_lock (&cam->lock);
+	// Presence bits are read only
+	cam->registers[address / 4] = (value & 0x7FFFFFFF) | (cam->registers[address / 4] & 0x80000000);
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2ValidateFormat7Settings (fc2Context context, fc2Format7ImageSettings *imageSettings, BOOL *settingsAreValid,
+		fc2Format7PacketInfo *packetInfo)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, FALSE);
+
+	*settingsAreValid = imageSettings->width > 0 && imageSettings->height > 0
+			&& imageSettings->offsetX + imageSettings->width <= cam->sensor_w
+			&& imageSettings->offsetY + imageSettings->height <= cam->sensor_h
+			&& imageSettings->pixelFormat == FC2_PIXEL_FORMAT_RGB8;
+	memset (packetInfo, 0, sizeof (*packetInfo));
+	packetInfo->recommendedBytesPerPacket = 4096;
+	packetInfo->maxBytesPerPacket = 9000;
+	packetInfo->unitBytesPerPacket = 4;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2SetFormat7ConfigurationPacket (fc2Context context, fc2Format7ImageSettings *imageSettings, unsigned int packetSize)
+{
+	MockCamera *cam = context;
+	BOOL ok;
+	fc2Format7PacketInfo packetInfo;
+
+	if (cam->capturing)
+		return FC2_ERROR_INVALID_PARAMETER;    // the camera has to be stopped to change mode
+
+	fc2ValidateFormat7Settings (context, imageSettings, &ok, &packetInfo);
+	if (!ok)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	mock_transaction (cam, TRUE);
+	g_mutex_lock (&cam->lock);
+	cam->format7 = *imageSettings;
+	cam->packet_size = packetSize;
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2GetFormat7Configuration (fc2Context context, fc2Format7ImageSettings *imageSettings, unsigned int *packetSize, float *percentage)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, FALSE);
+
+	g_mutex_lock (&cam->lock);
+	*imageSettings = cam->format7;
+	*packetSize = cam->packet_size;
+	*percentage = 100.0f * cam->packet_size / 9000;
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2EnableLUT (fc2Context context, BOOL on)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, TRUE);
+
+	cam->lut_on = on;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2GetActiveLUTBank (fc2Context context, unsigned int *pActiveBank)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, FALSE);
+
+	*pActiveBank = cam->lut_bank;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2SetActiveLUTBank (fc2Context context, unsigned int activeBank)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, TRUE);
+	if (activeBank > 1)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	cam->lut_bank = activeBank;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2SetLUTChannel (fc2Context context, unsigned int bank, unsigned int channel, unsigned int sizeEntries, unsigned int *pEntries)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, TRUE);
+	if (bank > 1 || channel > 2 || sizeEntries > MOCK_LUT_ENTRIES)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	g_mutex_lock (&cam->lock);
+	memcpy (cam->lut[bank][channel], pEntries, sizeEntries * sizeof (unsigned int));
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2SetStrobe (fc2Context context, fc2StrobeControl *pStrobeControl)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, TRUE);
+	if (pStrobeControl->source > 3)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	cam->strobe = *pStrobeControl;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2GetStrobe (fc2Context context, fc2StrobeControl *pStrobeControl)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, FALSE);
+	if (pStrobeControl->source > 3)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	*pStrobeControl = cam->strobe;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2GetLUTInfo (fc2Context context, fc2LUTData *pData)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, FALSE);
+
+	memset (pData, 0, sizeof (*pData));
+	pData->supported = TRUE;
+	pData->enabled = cam->lut_on;
+	pData->numBanks = 2;
+	pData->numChannels = 3;
+	pData->inputBitDepth = 9;
+	pData->outputBitDepth = 9;
+	pData->numEntries = MOCK_LUT_ENTRIES;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2GetLUTChannel (fc2Context context, unsigned int bank, unsigned int channel, unsigned int sizeEntries, unsigned int *pEntries)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, FALSE);
+	if (bank > 1 || channel > 2 || sizeEntries > MOCK_LUT_ENTRIES)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	g_mutex_lock (&cam->lock);
+	memcpy (pEntries, cam->lut[bank][channel], sizeEntries * sizeof (unsigned int));
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+/* Bus events, one callback of each type is enough for the element */
+fc2Error
+fc2RegisterCallback (fc2Context context, fc2BusEventCallback enumCallback, fc2BusCallbackType callbackType,
+		void *pParameter, fc2CallbackHandle *pCallbackHandle)
+{
+	MockCamera *cam = context;
+
+	switch (callbackType) {
+	case FC2_ARRIVAL:
+		cam->arrival_callback = enumCallback;
+		cam->arrival_data = pParameter;
+		*pCallbackHandle = &cam->arrival_callback;
+		break;
+	case FC2_REMOVAL:
+		cam->removal_callback = enumCallback;
+		cam->removal_data = pParameter;
+		*pCallbackHandle = &cam->removal_callback;
+		break;
+	default:
+		return FC2_ERROR_NOT_IMPLEMENTED;
+	}
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2UnregisterCallback (fc2Context context, fc2CallbackHandle callbackHandle)
+{
+	MockCamera *cam = context;
+
+	if (callbackHandle == (fc2CallbackHandle) &cam->arrival_callback)
+		cam->arrival_callback = NULL;
+	else if (callbackHandle == (fc2CallbackHandle) &cam->removal_callback)
+		cam->removal_callback = NULL;
+	else
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	return FC2_ERROR_OK;
+}
+
+/* Memory channels keep the properties, Format7 and strobe settings, not the LUTs or registers */
+fc2Error
+fc2GetMemoryChannelInfo (fc2Context context, unsigned int *pNumChannels)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, FALSE);
+
+	*pNumChannels = MOCK_N_CHANNELS;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2SaveToMemoryChannel (fc2Context context, unsigned int channel)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, TRUE);
+	if (channel < 1 || channel > MOCK_N_CHANNELS)
+		return FC2_ERROR_INVALID_PARAMETER;
+
+	mock_save_channel (cam, &cam->channels[channel]);
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2RestoreFromMemoryChannel (fc2Context context, unsigned int channel)
+{
+	MockCamera *cam = context;
+	MockChannel *saved;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, TRUE);
+	if (channel > MOCK_N_CHANNELS)
+		return FC2_ERROR_INVALID_PARAMETER;
+	if (cam->capturing)
+		return FC2_ERROR_INVALID_PARAMETER;    // as for a mode change
+
+	// A channel that was never saved holds the defaults
+	saved = cam->channels[channel].saved ? &cam->channels[channel] : &cam->channels[0];
+
+	g_mutex_lock (&cam->lock);
+	memcpy (cam->properties, saved->properties, sizeof (cam->properties));
+	cam->format7 = saved->format7;
+	cam->packet_size = saved->packet_size;
+	cam->strobe = saved->strobe;
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
+
+/* Every field can be embedded, only those that are on take up pixels */
+fc2Error
+fc2GetEmbeddedImageInfo (fc2Context context, fc2EmbeddedImageInfo *pInfo)
+{
+	MockCamera *cam = context;
+	fc2EmbeddedImageInfoProperty *field;
+	guint i;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, FALSE);
+
+	g_mutex_lock (&cam->lock);
+	*pInfo = cam->embedded;
+	g_mutex_unlock (&cam->lock);
+	field = (fc2EmbeddedImageInfoProperty *) pInfo;
+	for (i = 0; i < sizeof (*pInfo) / sizeof (*field); i++)
+		field[i].available = TRUE;
+
+	return FC2_ERROR_OK;
+}
+
+fc2Error
+fc2SetEmbeddedImageInfo (fc2Context context, fc2EmbeddedImageInfo *pInfo)
+{
+	MockCamera *cam = context;
+
+	if (!cam->connected)
+		return FC2_ERROR_NOT_CONNECTED;
+	mock_transaction (cam, TRUE);
+
+	g_mutex_lock (&cam->lock);
+	cam->embedded = *pInfo;
+	g_mutex_unlock (&cam->lock);
+
+	return FC2_ERROR_OK;
+}
@@ -0,0 +1,270 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015-2016 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ *
+ */
+/*
+ * Dark and flat field references for flycapsrc.
+ * References are made from the sums of several camera frames and kept in the form the
+ * correction kernel uses, 8-bit dark levels and fixed point gains, so nothing is converted
+ * per frame. Each is saved in its own file, named for the camera serial number and binning.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h> // for memcpy, memcmp
+
+#include "gstflycapcalib.h"
+
+#define FLYCAP_CALIBRATION_MAGIC    "FLYCAPCL"
+#define FLYCAP_CALIBRATION_VERSION  1
+
+// File header, then width*height*bpp samples, guint8 for a dark and guint16 for a flat, host byte order
+typedef struct
+{
+	gchar magic[8];
+	guint32 version;
+	guint32 type;
+	guint32 width;
+	guint32 height;
+	guint32 bpp;
+	guint32 reserved;
+} FlycapCalibrationHeader;
+
+static gsize
+flycap_calibration_samples (const FlycapCalibration *cal)
+{
+	return (gsize) cal->width * cal->height * cal->bpp;
+}
+
+void
+flycap_calibration_clear (FlycapCalibration *cal)
+{
+	g_free (cal->dark);
+	g_free (cal->gain);
+	g_free (cal->defects);
+	memset (cal, 0, sizeof (*cal));
+}
+
+gboolean
+flycap_calibration_matches (const FlycapCalibration *cal, guint width, guint height, guint bpp)
+{
+	return cal->width == width && cal->height == height && cal->bpp == bpp;
+}
+
+// A reference for another image size is no use with this one
+static void
+flycap_calibration_resize (FlycapCalibration *cal, guint width, guint height, guint bpp)
+{
+	if (flycap_calibration_matches (cal, width, height, bpp))
+		return;
+
+	flycap_calibration_clear (cal);
+	cal->width = width;
+	cal->height = height;
+	cal->bpp = bpp;
+}
+
+void
+flycap_calibration_set_dark (FlycapCalibration *cal, const guint16 *acc, guint n,
+		guint width, guint height, guint bpp)
+{
+	gsize i, size;
+
+	flycap_calibration_resize (cal, width, height, bpp);
+	size = flycap_calibration_samples (cal);
+	if (!cal->dark)
+		cal->dark = g_malloc (size);
+
+	for (i = 0; i < size; i++)
+		cal->dark[i] = (guint8) ((acc[i] + n/2) / n);
+}
+
+/* The gain brings each sample, less its dark level, to the mean of its channel, so the
+ * correction flattens the field without changing the colour balance. Samples with no
+ * signal in the flat are left alone, and gains are limited to what the fixed point holds.
+ */
+void
+flycap_calibration_set_flat (FlycapCalibration *cal, const guint16 *acc, guint n,
+		guint width, guint height, guint bpp)
+{
+	gdouble sum[4] = { 0.0 }, mean[4];
+	gsize i, size;
+	guint c;
+
+	flycap_calibration_resize (cal, width, height, bpp);
+	size = flycap_calibration_samples (cal);
+	if (!cal->gain)
+		cal->gain = g_new (guint16, size);
+
+	for (i = 0; i < size; i++) {
+		gdouble v = (gdouble) acc[i] / n - (cal->dark ? cal->dark[i] : 0);
+		sum[i % bpp] += MAX (v, 0.0);
+	}
+	for (c = 0; c < bpp; c++)
+		mean[c] = sum[c] / (size / bpp);
+
+	for (i = 0; i < size; i++) {
+		gdouble v = (gdouble) acc[i] / n - (cal->dark ? cal->dark[i] : 0);
+		gdouble gain = (v > 0.5) ? mean[i % bpp] / v : 1.0;
+
+		cal->gain[i] = (guint16) CLAMP (gain * FLYCAP_CALIBRATION_GAIN_ONE + 0.5, 0, G_MAXUINT16);
+	}
+}
+
+/* Hot pixels, those with any channel more than threshold above that channel's mean in the dark.
+ * They are found again from the dark whenever it changes, so need no file of their own.
+ * Returns the number found, 0 with no dark or a threshold of 0.
+ */
+guint
+flycap_calibration_find_defects (FlycapCalibration *cal, guint threshold)
+{
+	guint64 sum[4] = { 0 };
+	guint limit[4];
+	gsize i, n_pixels;
+	guint c, n = 0;
+	GArray *defects;
+
+	g_free (cal->defects);
+	cal->defects = NULL;
+	cal->n_defects = 0;
+	if (!cal->dark || threshold == 0)
+		return 0;
+
+	n_pixels = (gsize) cal->width * cal->height;
+	for (i = 0; i < n_pixels * cal->bpp; i++)
+		sum[i % cal->bpp] += cal->dark[i];
+	for (c = 0; c < cal->bpp; c++)
+		limit[c] = sum[c] / n_pixels + threshold;
+
+	defects = g_array_new (FALSE, FALSE, sizeof (guint32));
+	for (i = 0; i < n_pixels; i++) {
+		const guint8 *p = cal->dark + i * cal->bpp;
+
+		for (c = 0; c < cal->bpp; c++) {
+			if (p[c] > limit[c]) {
+				guint32 pixel = (guint32) i;
+				g_array_append_val (defects, pixel);
+				n++;
+				break;
+			}
+		}
+	}
+
+	cal->n_defects = n;
+	cal->defects = (guint32 *) g_array_free (defects, n == 0);
+	return n;
+}
+
+gchar *
+flycap_calibration_filename (const gchar *dir, guint serial, gint binning, FlycapCalibrationType type)
+{
+	gchar *name = g_strdup_printf ("%u-bin%d.%s", serial, binning, type == FLYCAP_CALIBRATION_DARK ? "dark" : "flat");
+	gchar *filename;
+
+	if (dir)
+		filename = g_build_filename (dir, name, NULL);
+	else
+		filename = g_build_filename (g_get_user_data_dir (), "flycap", name, NULL);
+	g_free (name);
+
+	return filename;
+}
+
+gboolean
+flycap_calibration_save (const FlycapCalibration *cal, FlycapCalibrationType type, const gchar *filename, GError **error)
+{
+	FlycapCalibrationHeader header;
+	const guint8 *data = (type == FLYCAP_CALIBRATION_DARK) ? cal->dark : (const guint8 *) cal->gain;
+	gsize data_size = flycap_calibration_samples (cal) * (type == FLYCAP_CALIBRATION_DARK ? 1 : 2);
+	gchar *dir, *contents;
+	gboolean ok;
+
+	if (!data) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "no %s reference to save",
+				type == FLYCAP_CALIBRATION_DARK ? "dark" : "flat");
+		return FALSE;
+	}
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, FLYCAP_CALIBRATION_MAGIC, sizeof (header.magic));
+	header.version = FLYCAP_CALIBRATION_VERSION;
+	header.type = type;
+	header.width = cal->width;
+	header.height = cal->height;
+	header.bpp = cal->bpp;
+
+	contents = g_malloc (sizeof (header) + data_size);
+	memcpy (contents, &header, sizeof (header));
+	memcpy (contents + sizeof (header), data, data_size);
+
+	dir = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dir, 0755);
+	g_free (dir);
+
+	ok = g_file_set_contents (filename, contents, sizeof (header) + data_size, error);
+	g_free (contents);
+
+	return ok;
+}
+
+/* Load one reference. If its image size differs from the references already held, those are
+ * dropped, a dark and flat are only used together if they were made at the same size. */
+gboolean
+flycap_calibration_load (FlycapCalibration *cal, FlycapCalibrationType type, const gchar *filename, GError **error)
+{
+	FlycapCalibrationHeader header;
+	gchar *contents;
+	gsize length, data_size;
+
+	if (!g_file_get_contents (filename, &contents, &length, error))
+		return FALSE;
+
+	if (length < sizeof (header))
+		goto invalid;
+	memcpy (&header, contents, sizeof (header));
+	if (memcmp (header.magic, FLYCAP_CALIBRATION_MAGIC, sizeof (header.magic)) != 0
+			|| header.version != FLYCAP_CALIBRATION_VERSION || header.type != (guint32) type
+			|| header.bpp == 0 || header.bpp > 4)
+		goto invalid;
+	data_size = (gsize) header.width * header.height * header.bpp * (type == FLYCAP_CALIBRATION_DARK ? 1 : 2);
+	if (length != sizeof (header) + data_size)
+		goto invalid;
+
+	flycap_calibration_resize (cal, header.width, header.height, header.bpp);
+	if (type == FLYCAP_CALIBRATION_DARK) {
+		g_free (cal->dark);
+		cal->dark = g_malloc (data_size);
+		memcpy (cal->dark, contents + sizeof (header), data_size);
+	}
+	else {
+		g_free (cal->gain);
+		cal->gain = g_malloc (data_size);
+		memcpy (cal->gain, contents + sizeof (header), data_size);
+	}
+
+	g_free (contents);
+	return TRUE;
+
+	invalid:
+	g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not a flycap %s reference", filename,
+			type == FLYCAP_CALIBRATION_DARK ? "dark" : "flat");
+	g_free (contents);
+	return FALSE;
+}
@@ -0,0 +1,64 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _GST_FLYCAP_CALIB_H_
+#define _GST_FLYCAP_CALIB_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+	FLYCAP_CALIBRATION_DARK,
+	FLYCAP_CALIBRATION_FLAT,
+	FLYCAP_CALIBRATION_N
+} FlycapCalibrationType;
+
+/* Dark and flat references for one camera image size, sample for sample with the camera image.
+ * The correction is out = (in - dark) * gain, with the gain in FLYCAP_CALIBRATION_GAIN_BITS fixed point.
+ */
+#define FLYCAP_CALIBRATION_GAIN_BITS  12
+#define FLYCAP_CALIBRATION_GAIN_ONE   (1 << FLYCAP_CALIBRATION_GAIN_BITS)
+
+typedef struct
+{
+	guint width;       // camera pixels
+	guint height;
+	guint bpp;
+	guint8 *dark;      // NULL if none
+	guint16 *gain;     // flat field gain, NULL if none
+	guint32 *defects;  // pixels, y * width + x, that are hot in the dark, in order
+	guint n_defects;
+} FlycapCalibration;
+
+void flycap_calibration_clear (FlycapCalibration *cal);
+gboolean flycap_calibration_matches (const FlycapCalibration *cal, guint width, guint height, guint bpp);
+void flycap_calibration_set_dark (FlycapCalibration *cal, const guint16 *acc, guint n,
+		guint width, guint height, guint bpp);
+void flycap_calibration_set_flat (FlycapCalibration *cal, const guint16 *acc, guint n,
+		guint width, guint height, guint bpp);
+guint flycap_calibration_find_defects (FlycapCalibration *cal, guint threshold);
+gchar *flycap_calibration_filename (const gchar *dir, guint serial, gint binning, FlycapCalibrationType type);
+gboolean flycap_calibration_save (const FlycapCalibration *cal, FlycapCalibrationType type, const gchar *filename, GError **error);
+gboolean flycap_calibration_load (FlycapCalibration *cal, FlycapCalibrationType type, const gchar *filename, GError **error);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,77 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _GST_FLYCAP_KERNEL_H_
+#define _GST_FLYCAP_KERNEL_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Optional operations done while a frame is copied, these are bits of the ops mask
+typedef enum
+{
+	FLYCAP_KERNEL_OP_STATS = (1 << 0),   // accumulate per channel histograms
+	FLYCAP_KERNEL_OP_HFLIP = (1 << 1),   // mirror left-right
+	FLYCAP_KERNEL_OP_VFLIP = (1 << 2),   // mirror top-bottom
+	FLYCAP_KERNEL_OP_TRANSPOSE = (1 << 3),   // swap rows and columns, flips then apply to the transposed image
+	FLYCAP_KERNEL_OP_ALL   = (1 << 4) - 1
+} FlycapKernelOps;
+
+// One frame to be copied from the (possibly binned) camera image into the output buffer
+typedef struct
+{
+	const guint8 *src;         // camera image
+	guint src_stride;          // bytes
+	guint src_width;           // camera pixels
+	guint src_height;
+	guint8 *dst;               // output image
+	guint dst_stride;          // bytes
+	guint dst_width;           // output pixels, after any transpose
+	guint dst_height;
+	guint bytes_per_pixel;
+	guint32 (*hist)[256];      // FLYCAP_KERNEL_OP_STATS, one table per channel
+} FlycapKernelFrame;
+
+typedef void (*FlycapKernelFunc) (const FlycapKernelFrame *frame);
+
+FlycapKernelFunc flycap_kernel_select (guint binning, guint bytes_per_pixel, guint ops);
+
+guint flycap_kernel_luma_histogram (const guint8 *src, guint src_stride, guint width, guint height,
+		guint bytes_per_pixel, guint subsample, guint32 hist[256]);
+
+#define FLYCAP_KERNEL_MAX_ACCUMULATE 256   // 8-bit samples summed in 16 bits
+
+void flycap_kernel_accumulate (guint16 *acc, const guint8 *src, guint src_stride, guint row_bytes, guint height, gboolean first);
+void flycap_kernel_average (guint8 *dst, guint dst_stride, const guint16 *acc, guint row_bytes, guint height, guint n);
+
+void flycap_kernel_calibrate (guint8 *image, guint stride, guint row_bytes, guint height,
+		const guint8 *dark, const guint16 *gain);
+
+void flycap_kernel_box_downscale (guint8 *dst, guint dst_stride, const guint8 *src, guint src_stride,
+		guint src_width, guint src_height, guint bpp, guint factor, guint16 *row_acc);
+
+void flycap_kernel_patch_defects (guint8 *image, guint stride, guint width, guint height, guint bpp,
+		const guint32 *defects, guint n_defects);
+
+void flycap_kernel_compute_lut (unsigned int lut[512], int a, double b, double c, double d, int e, double f);
+
+G_END_DECLS
+
+#endif
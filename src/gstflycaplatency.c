@@ -0,0 +1,159 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015-2016 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ *
+ */
+/*
+ * Per stage timing histograms for flycapsrc.
+ * Adding a sample is a few integer operations, so it can be done for every frame,
+ * percentiles are only worked out when the histogram is reported.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h> // for memset
+
+#include "gstflycaplatency.h"
+
+static const gchar *stage_names[FLYCAP_STAGE_N] = {
+	"retrieve",
+	"copy",
+	"create",
+	"downstream"
+};
+
+const gchar *
+flycap_latency_stage_name (FlycapLatencyStage stage)
+{
+	g_return_val_if_fail (stage < FLYCAP_STAGE_N, NULL);
+
+	return stage_names[stage];
+}
+
+void
+flycap_latency_histogram_reset (FlycapLatencyHistogram *hist)
+{
+	memset (hist, 0, sizeof (*hist));
+	hist->min = GST_CLOCK_TIME_NONE;
+}
+
+/* Bucket 0 is under 1 us, then FLYCAP_LATENCY_SUB_BUCKETS per power of 2 us */
+static guint
+latency_bucket (GstClockTime t)
+{
+	guint64 us = t / GST_USECOND;
+	guint octave, sub, bucket;
+
+	if (us == 0)
+		return 0;
+
+	octave = g_bit_storage (us) - 1;
+	sub = (guint) ((t * FLYCAP_LATENCY_SUB_BUCKETS / (GST_USECOND << octave)) & (FLYCAP_LATENCY_SUB_BUCKETS - 1));
+	bucket = 1 + octave * FLYCAP_LATENCY_SUB_BUCKETS + sub;
+
+	return MIN (bucket, FLYCAP_LATENCY_BUCKETS - 1);
+}
+
+/* Upper edge of a bucket */
+static GstClockTime
+latency_bucket_limit (guint bucket)
+{
+	guint octave, sub;
+
+	if (bucket == 0)
+		return GST_USECOND;
+
+	octave = (bucket - 1) / FLYCAP_LATENCY_SUB_BUCKETS;
+	sub = (bucket - 1) % FLYCAP_LATENCY_SUB_BUCKETS;
+
+	return ((guint64) (FLYCAP_LATENCY_SUB_BUCKETS + sub + 1) << octave) * GST_USECOND / FLYCAP_LATENCY_SUB_BUCKETS;
+}
+
+void
+flycap_latency_histogram_add (FlycapLatencyHistogram *hist, GstClockTime t)
+{
+	hist->buckets[latency_bucket (t)]++;
+	hist->count++;
+	hist->sum += t;
+	if (t < hist->min)
+		hist->min = t;
+	if (t > hist->max)
+		hist->max = t;
+}
+
+GstClockTime
+flycap_latency_histogram_percentile (const FlycapLatencyHistogram *hist, gdouble percent)
+{
+	guint64 rank, n = 0;
+	guint i;
+
+	if (hist->count == 0)
+		return 0;
+
+	rank = (guint64) (hist->count * percent / 100.0 + 0.5);
+	rank = CLAMP (rank, 1, hist->count);
+
+	for (i = 0; i < FLYCAP_LATENCY_BUCKETS; i++) {
+		n += hist->buckets[i];
+		if (n >= rank)
+			return CLAMP (latency_bucket_limit (i), hist->min, hist->max);
+	}
+
+	return hist->max;
+}
+
+/* Add <stage>-count, -mean, -min, -p50, -p95, -p99 and -max fields, times are in ns */
+void
+flycap_latency_histogram_to_structure (const FlycapLatencyHistogram *hist, GstStructure *s, const gchar *stage)
+{
+	gchar name[64];
+
+#define SET_FIELD(field, val) \
+	g_snprintf (name, sizeof (name), "%s-" field, stage); \
+	gst_structure_set (s, name, G_TYPE_UINT64, (guint64) (val), NULL);
+
+	SET_FIELD ("count", hist->count);
+	SET_FIELD ("mean", hist->count ? hist->sum / hist->count : 0);
+	SET_FIELD ("min", hist->count ? hist->min : 0);
+	SET_FIELD ("p50", flycap_latency_histogram_percentile (hist, 50.0));
+	SET_FIELD ("p95", flycap_latency_histogram_percentile (hist, 95.0));
+	SET_FIELD ("p99", flycap_latency_histogram_percentile (hist, 99.0));
+	SET_FIELD ("max", hist->max);
+
+#undef SET_FIELD
+}
+
+/* Smoothed time between frames. A delta outside half to one and a half times the estimate is a lost
+ * frame or a burst after a stall and is left out, unless FLYCAP_INTERVAL_RESEED come in a row, when
+ * the camera really runs at another rate, e.g. limited by the bus or paced by a trigger, and the
+ * estimate starts again from the last delta. */
+GstClockTime
+flycap_latency_interval_update (GstClockTime interval, GstClockTime delta, guint *outliers)
+{
+	if (delta > interval / 2 && delta < interval * 3 / 2) {
+		*outliers = 0;
+		return interval + ((GstClockTimeDiff) delta - (GstClockTimeDiff) interval) / 16;
+	}
+
+	if (++(*outliers) < FLYCAP_INTERVAL_RESEED)
+		return interval;
+
+	*outliers = 0;
+	return delta;
+}
@@ -0,0 +1,67 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _GST_FLYCAP_LATENCY_H_
+#define _GST_FLYCAP_LATENCY_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Name of the element message and the latency-stats structure
+#define FLYCAP_LATENCY_STRUCTURE_NAME "flycap-latency"
+
+// Log scale buckets, 4 per octave from 1 us, so percentiles are within about 20%
+#define FLYCAP_LATENCY_SUB_BUCKETS 4
+#define FLYCAP_LATENCY_BUCKETS (1 + 32 * FLYCAP_LATENCY_SUB_BUCKETS)
+
+// Where the time goes for each frame, in the order they happen
+typedef enum
+{
+	FLYCAP_STAGE_RETRIEVE,     // waiting in fc2RetrieveBuffer for the SDK to hand over a frame
+	FLYCAP_STAGE_COPY,         // buffer allocation and the copy kernel
+	FLYCAP_STAGE_CREATE,       // the whole of create, retrieve to return
+	FLYCAP_STAGE_DOWNSTREAM,   // from returning a buffer to the next create, the push and any backpressure
+	FLYCAP_STAGE_N
+} FlycapLatencyStage;
+
+typedef struct
+{
+	guint64 count;
+	GstClockTime sum;
+	GstClockTime min;
+	GstClockTime max;
+	guint32 buckets[FLYCAP_LATENCY_BUCKETS];
+} FlycapLatencyHistogram;
+
+const gchar *flycap_latency_stage_name (FlycapLatencyStage stage);
+
+void flycap_latency_histogram_reset (FlycapLatencyHistogram *hist);
+void flycap_latency_histogram_add (FlycapLatencyHistogram *hist, GstClockTime t);
+GstClockTime flycap_latency_histogram_percentile (const FlycapLatencyHistogram *hist, gdouble percent);
+void flycap_latency_histogram_to_structure (const FlycapLatencyHistogram *hist, GstStructure *s, const gchar *stage);
+
+// Frames in a row outside the window before the interval estimate restarts from what is measured
+#define FLYCAP_INTERVAL_RESEED 4
+
+GstClockTime flycap_latency_interval_update (GstClockTime interval, GstClockTime delta, guint *outliers);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,207 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015-2016 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ *
+ */
+/*
+ * Buffer metadata attached by flycapsrc.
+ * The stats meta carries per channel histograms and summary values so that
+ * downstream elements need not make another pass over the frame. The info meta
+ * carries the settings the camera says the frame was exposed with.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h> // for memset, memcpy
+
+#include "gstflycapmeta.h"
+
+GType
+gst_flycap_stats_meta_api_get_type (void)
+{
+  static volatile GType type = 0;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstFlycapStatsMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_flycap_stats_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstFlycapStatsMeta *smeta = (GstFlycapStatsMeta *) meta;
+
+  memset ((guint8 *) smeta + sizeof (GstMeta), 0, sizeof (GstFlycapStatsMeta) - sizeof (GstMeta));
+
+  return TRUE;
+}
+
+static gboolean
+gst_flycap_stats_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstFlycapStatsMeta *smeta = (GstFlycapStatsMeta *) meta;
+  GstFlycapStatsMeta *dmeta;
+
+  // The statistics only describe the whole, unmodified frame
+  if (!GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  dmeta = gst_buffer_add_flycap_stats_meta (dest);
+  if (!dmeta)
+    return FALSE;
+
+  memcpy ((guint8 *) dmeta + sizeof (GstMeta), (guint8 *) smeta + sizeof (GstMeta),
+      sizeof (GstFlycapStatsMeta) - sizeof (GstMeta));
+
+  return TRUE;
+}
+
+const GstMetaInfo *
+gst_flycap_stats_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter (&meta_info)) {
+    const GstMetaInfo *mi = gst_meta_register (GST_FLYCAP_STATS_META_API_TYPE,
+        "GstFlycapStatsMeta",
+        sizeof (GstFlycapStatsMeta),
+        gst_flycap_stats_meta_init,
+        (GstMetaFreeFunction) NULL,
+        gst_flycap_stats_meta_transform);
+    g_once_init_leave (&meta_info, mi);
+  }
+  return meta_info;
+}
+
+GstFlycapStatsMeta *
+gst_buffer_add_flycap_stats_meta (GstBuffer * buffer)
+{
+  return (GstFlycapStatsMeta *) gst_buffer_add_meta (buffer,
+      GST_FLYCAP_STATS_META_INFO, NULL);
+}
+
+/* Derive the summary values from the histograms, called once the histograms are complete.
+ * This is 256 steps per channel, so much cheaper than tracking them per pixel.
+ */
+void
+gst_flycap_stats_meta_finish (GstFlycapStatsMeta * meta)
+{
+  guint c, i;
+
+  for (c = 0; c < GST_FLYCAP_STATS_CHANNELS; c++) {
+    const guint32 *hist = meta->histogram[c];
+    guint64 sum = 0;
+    guint32 n = 0;
+
+    meta->min[c] = 0;
+    meta->max[c] = 0;
+
+    for (i = 0; i < 256; i++) {
+      sum += (guint64) i * hist[i];
+      n += hist[i];
+    }
+
+    for (i = 0; i < 256; i++) {
+      if (hist[i]) {
+        meta->min[c] = i;
+        break;
+      }
+    }
+    for (i = 256; i > 0; i--) {
+      if (hist[i - 1]) {
+        meta->max[c] = i - 1;
+        break;
+      }
+    }
+
+    meta->n_pixels = n;
+    meta->mean[c] = n ? (gdouble) sum / n : 0.0;
+    meta->clipped_low[c] = hist[0];
+    meta->clipped_high[c] = hist[255];
+  }
+}
+
+GType
+gst_flycap_info_meta_api_get_type (void)
+{
+  static volatile GType type = 0;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstFlycapInfoMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_flycap_info_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstFlycapInfoMeta *imeta = (GstFlycapInfoMeta *) meta;
+
+  memset ((guint8 *) imeta + sizeof (GstMeta), 0, sizeof (GstFlycapInfoMeta) - sizeof (GstMeta));
+
+  return TRUE;
+}
+
+static gboolean
+gst_flycap_info_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstFlycapInfoMeta *imeta = (GstFlycapInfoMeta *) meta;
+  GstFlycapInfoMeta *dmeta;
+
+  // How the frame was captured does not change with what is done to it
+  dmeta = gst_buffer_add_flycap_info_meta (dest);
+  if (!dmeta)
+    return FALSE;
+
+  memcpy ((guint8 *) dmeta + sizeof (GstMeta), (guint8 *) imeta + sizeof (GstMeta),
+      sizeof (GstFlycapInfoMeta) - sizeof (GstMeta));
+
+  return TRUE;
+}
+
+const GstMetaInfo *
+gst_flycap_info_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter (&meta_info)) {
+    const GstMetaInfo *mi = gst_meta_register (GST_FLYCAP_INFO_META_API_TYPE,
+        "GstFlycapInfoMeta",
+        sizeof (GstFlycapInfoMeta),
+        gst_flycap_info_meta_init,
+        (GstMetaFreeFunction) NULL,
+        gst_flycap_info_meta_transform);
+    g_once_init_leave (&meta_info, mi);
+  }
+  return meta_info;
+}
+
+GstFlycapInfoMeta *
+gst_buffer_add_flycap_info_meta (GstBuffer * buffer)
+{
+  return (GstFlycapInfoMeta *) gst_buffer_add_meta (buffer,
+      GST_FLYCAP_INFO_META_INFO, NULL);
+}
@@ -0,0 +1,90 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _GST_FLYCAP_META_H_
+#define _GST_FLYCAP_META_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_FLYCAP_STATS_META_API_TYPE (gst_flycap_stats_meta_api_get_type())
+#define GST_FLYCAP_STATS_META_INFO (gst_flycap_stats_meta_get_info())
+
+#define GST_FLYCAP_STATS_CHANNELS 3
+
+typedef struct _GstFlycapStatsMeta GstFlycapStatsMeta;
+
+/* Per frame image statistics, computed by flycapsrc while it copies the frame.
+ * The statistics are of the pixels delivered by the camera, so in binned modes
+ * each value counts once, not once per duplicated output pixel.
+ */
+struct _GstFlycapStatsMeta
+{
+  GstMeta meta;
+
+  guint32 histogram[GST_FLYCAP_STATS_CHANNELS][256];  // channel order R, G, B
+  guint32 n_pixels;                                   // pixels counted per channel
+  gdouble mean[GST_FLYCAP_STATS_CHANNELS];
+  guint8 min[GST_FLYCAP_STATS_CHANNELS];
+  guint8 max[GST_FLYCAP_STATS_CHANNELS];
+  guint32 clipped_low[GST_FLYCAP_STATS_CHANNELS];     // pixels at 0
+  guint32 clipped_high[GST_FLYCAP_STATS_CHANNELS];    // pixels at 255
+};
+
+GType gst_flycap_stats_meta_api_get_type (void);
+const GstMetaInfo *gst_flycap_stats_meta_get_info (void);
+
+#define gst_buffer_get_flycap_stats_meta(b) \
+  ((GstFlycapStatsMeta*)gst_buffer_get_meta((b), GST_FLYCAP_STATS_META_API_TYPE))
+
+GstFlycapStatsMeta *gst_buffer_add_flycap_stats_meta (GstBuffer * buffer);
+void gst_flycap_stats_meta_finish (GstFlycapStatsMeta * meta);
+
+#define GST_FLYCAP_INFO_META_API_TYPE (gst_flycap_info_meta_api_get_type())
+#define GST_FLYCAP_INFO_META_INFO (gst_flycap_info_meta_get_info())
+
+typedef struct _GstFlycapInfoMeta GstFlycapInfoMeta;
+
+/* The settings a frame was exposed with, from the information the camera embeds in
+ * each frame, so a change can be matched to the first frame it reached. Attached by
+ * flycapsrc when its embedded-info property is on.
+ */
+struct _GstFlycapInfoMeta
+{
+  GstMeta meta;
+
+  guint32 frame_counter;  // the camera's, or frames retrieved if it does not embed one
+  gfloat exposure;        // ms
+  gfloat gain;            // linear, as the gain property
+  gint binning;
+  gboolean settling;      // a change has been written that no frame has yet
+};
+
+GType gst_flycap_info_meta_api_get_type (void);
+const GstMetaInfo *gst_flycap_info_meta_get_info (void);
+
+#define gst_buffer_get_flycap_info_meta(b) \
+  ((GstFlycapInfoMeta*)gst_buffer_get_meta((b), GST_FLYCAP_INFO_META_API_TYPE))
+
+GstFlycapInfoMeta *gst_buffer_add_flycap_info_meta (GstBuffer * buffer);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,709 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015-2016 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ *
+ */
+/*
+ * flycaprawsink, records raw frames at the full camera rate.
+ *
+ * Frames are packed into large aligned blocks that are written with O_DIRECT, so there is one
+ * copy per frame and one write per block rather than a write per buffer through the page cache.
+ * Blocks are submitted to io_uring where it is available, or handed to a writer thread, and
+ * render only waits when every block is still in flight. A small index file records where
+ * each frame is, see gstflycaprawsink.h.
+ *
+ *   gst-launch-1.0 flycapsrc ! flycaprawsink location=/data/burst.raw
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     // O_DIRECT
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gst/gst.h>
+
+#include "gstflycaprawsink.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_flycap_raw_sink_debug);
+#define GST_CAT_DEFAULT gst_flycap_raw_sink_debug
+
+#define FLYCAP_RAW_ALIGN   4096   // O_DIRECT needs buffers, lengths and offsets aligned to the device block
+
+enum
+{
+	PROP_0,
+	PROP_LOCATION,
+	PROP_INDEX_LOCATION,
+	PROP_BLOCK_SIZE,
+	PROP_QUEUE_DEPTH,
+	PROP_DIRECT,
+	PROP_FRAMES_WRITTEN,
+	PROP_BYTES_WRITTEN,
+	PROP_STALLS
+};
+
+#define DEFAULT_PROP_BLOCK_SIZE    (8 * 1024 * 1024)
+#define DEFAULT_PROP_QUEUE_DEPTH   4
+#define DEFAULT_PROP_DIRECT        TRUE
+
+static GstStaticPadTemplate gst_flycap_raw_sink_template =
+		GST_STATIC_PAD_TEMPLATE ("sink",
+		GST_PAD_SINK,
+		GST_PAD_ALWAYS,
+		GST_STATIC_CAPS_ANY);
+
+// Tells the writer thread to finish, it is never written
+static FlycapRawBlock quit_block;
+
+G_DEFINE_TYPE (GstFlycapRawSink, gst_flycap_raw_sink, GST_TYPE_BASE_SINK);
+
+static void
+gst_flycap_raw_sink_set_error (GstFlycapRawSink * sink, int error)
+{
+	g_atomic_int_compare_and_exchange (&sink->write_error, 0, error);
+}
+
+/* pwrite the whole block, O_DIRECT writes can come back short */
+static void
+gst_flycap_raw_sink_write_block (GstFlycapRawSink * sink, FlycapRawBlock * block)
+{
+	gsize done = 0;
+	ssize_t n;
+
+	while (done < block->len){
+		n = pwrite(sink->fd, block->data + done, block->len - done, block->offset + done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0){
+			gst_flycap_raw_sink_set_error(sink, n < 0 ? errno : EIO);
+			return;
+		}
+		done += n;
+	}
+}
+
+static gpointer
+gst_flycap_raw_sink_writer (gpointer data)
+{
+	GstFlycapRawSink *sink = GST_FLYCAP_RAW_SINK (data);
+	FlycapRawBlock *block;
+
+	while ((block = g_async_queue_pop(sink->full_queue)) != &quit_block){
+		if (!g_atomic_int_get(&sink->write_error))
+			gst_flycap_raw_sink_write_block(sink, block);
+		g_async_queue_push(sink->free_queue, block);
+	}
+
+	return NULL;
+}
+
+static void
+gst_flycap_raw_sink_submit (GstFlycapRawSink * sink, FlycapRawBlock * block)
+{
+#ifdef HAVE_LIBURING
+	if (sink->use_uring){
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&sink->ring);   // there is an entry for every block
+
+		io_uring_prep_write(sqe, sink->fd, block->data, block->len, block->offset);
+		io_uring_sqe_set_data(sqe, block);
+		io_uring_submit(&sink->ring);
+		return;
+	}
+#endif
+	g_async_queue_push(sink->full_queue, block);
+}
+
+#ifdef HAVE_LIBURING
+/* Wait for a write to complete and return its block, short writes are finished synchronously */
+static FlycapRawBlock *
+gst_flycap_raw_sink_reap (GstFlycapRawSink * sink)
+{
+	struct io_uring_cqe *cqe;
+	FlycapRawBlock *block;
+	int ret, res;
+
+	while ((ret = io_uring_wait_cqe(&sink->ring, &cqe)) == -EINTR)
+		;
+	if (ret < 0){
+		gst_flycap_raw_sink_set_error(sink, -ret);
+		return NULL;
+	}
+
+	block = io_uring_cqe_get_data(cqe);
+	res = cqe->res;
+	io_uring_cqe_seen(&sink->ring, cqe);
+
+	if (res < 0)
+		gst_flycap_raw_sink_set_error(sink, -res);
+	else if ((gsize)res < block->len){
+		FlycapRawBlock rest = { block->data + res, block->len - res, block->offset + res };
+		gst_flycap_raw_sink_write_block(sink, &rest);
+	}
+
+	return block;
+}
+#endif
+
+/* An empty block, waits for a write to finish if they are all in flight */
+static FlycapRawBlock *
+gst_flycap_raw_sink_get_block (GstFlycapRawSink * sink)
+{
+	FlycapRawBlock *block;
+
+#ifdef HAVE_LIBURING
+	if (sink->use_uring){
+		if ((block = g_queue_pop_head(&sink->free_blocks)))
+			return block;
+		sink->stalls++;
+		return gst_flycap_raw_sink_reap(sink);
+	}
+#endif
+	if ((block = g_async_queue_try_pop(sink->free_queue)))
+		return block;
+	sink->stalls++;
+	return g_async_queue_pop(sink->free_queue);
+}
+
+static void
+gst_flycap_raw_sink_put_block (GstFlycapRawSink * sink, FlycapRawBlock * block)
+{
+#ifdef HAVE_LIBURING
+	if (sink->use_uring){
+		g_queue_push_tail(&sink->free_blocks, block);
+		return;
+	}
+#endif
+	g_async_queue_push(sink->free_queue, block);
+}
+
+static gboolean
+gst_flycap_raw_sink_next_block (GstFlycapRawSink * sink)
+{
+	sink->current = gst_flycap_raw_sink_get_block(sink);
+	if (!sink->current)
+		return FALSE;
+	sink->fill = 0;
+	return TRUE;
+}
+
+/* Write out the partly filled block and wait for everything in flight. The last block is padded to
+ * the alignment O_DIRECT needs, then the file is cut back to the frames that were written. */
+static gboolean
+gst_flycap_raw_sink_drain (GstFlycapRawSink * sink)
+{
+	FlycapRawBlock **blocks;
+	guint64 stalls = sink->stalls;   // waiting here is not the disk falling behind
+	guint i;
+	gint error;
+
+	if (sink->fd < 0 || !sink->current)
+		return TRUE;
+
+	if (sink->fill > 0){
+		sink->current->len = GST_ROUND_UP_N(sink->fill, FLYCAP_RAW_ALIGN);
+		memset(sink->current->data + sink->fill, 0, sink->current->len - sink->fill);
+		sink->current->offset = sink->write_offset;
+		gst_flycap_raw_sink_submit(sink, sink->current);
+		sink->write_offset += sink->current->len;
+	}
+	else
+		gst_flycap_raw_sink_put_block(sink, sink->current);
+	sink->current = NULL;
+
+	// Collect every block back, then they are all written
+	blocks = g_new(FlycapRawBlock *, sink->queue_depth);
+	for (i = 0; i < sink->queue_depth; i++)
+		blocks[i] = gst_flycap_raw_sink_get_block(sink);
+	for (i = 0; i < sink->queue_depth; i++)
+		if (blocks[i])
+			gst_flycap_raw_sink_put_block(sink, blocks[i]);
+	g_free(blocks);
+	sink->stalls = stalls;
+
+	if (ftruncate(sink->fd, sink->data_size) < 0)
+		gst_flycap_raw_sink_set_error(sink, errno);
+	fdatasync(sink->fd);
+	if (sink->index)
+		fflush(sink->index);
+
+	// Carry on from the end of the data if more frames come
+	sink->write_offset = GST_ROUND_DOWN_N(sink->data_size, FLYCAP_RAW_ALIGN);
+	if (!gst_flycap_raw_sink_next_block(sink))
+		return FALSE;
+	sink->fill = sink->data_size - sink->write_offset;
+	if (sink->fill > 0 && pread(sink->fd, sink->current->data, FLYCAP_RAW_ALIGN, sink->write_offset) < 0)
+		gst_flycap_raw_sink_set_error(sink, errno);
+
+	error = g_atomic_int_get(&sink->write_error);
+	if (error){
+		GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, ("Could not write to file \"%s\".", sink->location),
+				("%s", g_strerror(error)));
+		return FALSE;
+	}
+
+	GST_DEBUG_OBJECT(sink, "drained, %" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT " bytes, %" G_GUINT64_FORMAT " stalls",
+			sink->frames_written, sink->data_size, sink->stalls);
+	return TRUE;
+}
+
+static int
+gst_flycap_raw_sink_open (GstFlycapRawSink * sink)
+{
+	int flags = O_RDWR | O_CREAT | O_TRUNC;   // read too, the tail block is read back after a drain
+
+#ifdef O_DIRECT
+	if (sink->direct){
+		int fd = open(sink->location, flags | O_DIRECT, 0644);
+		if (fd >= 0 || errno != EINVAL)
+			return fd;
+		// tmpfs and some network file systems refuse it
+		GST_WARNING_OBJECT(sink, "\"%s\" does not support O_DIRECT, writing through the page cache", sink->location);
+	}
+#endif
+
+	return open(sink->location, flags, 0644);
+}
+
+static gboolean
+gst_flycap_raw_sink_start (GstBaseSink * bsink)
+{
+	GstFlycapRawSink *sink = GST_FLYCAP_RAW_SINK (bsink);
+	gchar *index_location;
+	guint i;
+
+	if (!sink->location){
+		GST_ELEMENT_ERROR(sink, RESOURCE, NOT_FOUND, ("No file name specified for writing."), (NULL));
+		return FALSE;
+	}
+
+	sink->fd = gst_flycap_raw_sink_open(sink);
+	if (sink->fd < 0){
+		GST_ELEMENT_ERROR(sink, RESOURCE, OPEN_WRITE, ("Could not open file \"%s\" for writing.", sink->location),
+				GST_ERROR_SYSTEM);
+		return FALSE;
+	}
+
+	index_location = sink->index_location ? g_strdup(sink->index_location) : g_strconcat(sink->location, ".idx", NULL);
+	sink->index = fopen(index_location, "wb");
+	if (!sink->index){
+		GST_ELEMENT_ERROR(sink, RESOURCE, OPEN_WRITE, ("Could not open file \"%s\" for writing.", index_location),
+				GST_ERROR_SYSTEM);
+		g_free(index_location);
+		goto fail;
+	}
+	g_free(index_location);
+	setvbuf(sink->index, NULL, _IOFBF, 256 * sizeof(FlycapRawIndexEntry));
+	sink->index_header_written = FALSE;
+
+	sink->blocks = g_new0(FlycapRawBlock, sink->queue_depth);
+	for (i = 0; i < sink->queue_depth; i++){
+		if (posix_memalign((void **)&sink->blocks[i].data, FLYCAP_RAW_ALIGN, sink->block_size) != 0){
+			GST_ELEMENT_ERROR(sink, RESOURCE, NO_SPACE_LEFT, ("Could not allocate %u byte blocks.", sink->block_size), (NULL));
+			goto fail;
+		}
+	}
+
+	sink->write_error = 0;
+#ifdef HAVE_LIBURING
+	g_queue_init(&sink->free_blocks);
+	sink->use_uring = (io_uring_queue_init(sink->queue_depth, &sink->ring, 0) == 0);
+	if (!sink->use_uring)
+		GST_INFO_OBJECT(sink, "io_uring is not available, writing from a thread");
+#endif
+	sink->free_queue = g_async_queue_new();
+	sink->full_queue = g_async_queue_new();
+#ifdef HAVE_LIBURING
+	if (!sink->use_uring)
+#endif
+		sink->writer = g_thread_new("flycaprawsink", gst_flycap_raw_sink_writer, sink);
+
+	for (i = 0; i < sink->queue_depth; i++)
+		gst_flycap_raw_sink_put_block(sink, &sink->blocks[i]);
+
+	sink->write_offset = 0;
+	sink->data_size = 0;
+	sink->frames_written = 0;
+	sink->bytes_written = 0;
+	sink->stalls = 0;
+	gst_flycap_raw_sink_next_block(sink);
+
+	GST_DEBUG_OBJECT(sink, "recording to %s, %u blocks of %u bytes", sink->location, sink->queue_depth, sink->block_size);
+
+	return TRUE;
+
+	fail:
+	if (sink->index){
+		fclose(sink->index);
+		sink->index = NULL;
+	}
+	if (sink->blocks){
+		for (i = 0; i < sink->queue_depth; i++)
+			free(sink->blocks[i].data);
+		g_free(sink->blocks);
+		sink->blocks = NULL;
+	}
+	close(sink->fd);
+	sink->fd = -1;
+	return FALSE;
+}
+
+static gboolean
+gst_flycap_raw_sink_stop (GstBaseSink * bsink)
+{
+	GstFlycapRawSink *sink = GST_FLYCAP_RAW_SINK (bsink);
+	guint i;
+
+	gst_flycap_raw_sink_drain(sink);
+
+	if (sink->writer){
+		g_async_queue_push(sink->full_queue, &quit_block);
+		g_thread_join(sink->writer);
+		sink->writer = NULL;
+	}
+#ifdef HAVE_LIBURING
+	if (sink->use_uring)
+		io_uring_queue_exit(&sink->ring);
+	g_queue_clear(&sink->free_blocks);
+#endif
+	if (sink->full_queue){
+		g_async_queue_unref(sink->full_queue);
+		g_async_queue_unref(sink->free_queue);
+		sink->full_queue = NULL;
+		sink->free_queue = NULL;
+	}
+
+	if (sink->blocks){
+		for (i = 0; i < sink->queue_depth; i++)
+			free(sink->blocks[i].data);
+		g_free(sink->blocks);
+		sink->blocks = NULL;
+	}
+	sink->current = NULL;
+
+	if (sink->index){
+		fclose(sink->index);
+		sink->index = NULL;
+	}
+	if (sink->fd >= 0){
+		close(sink->fd);
+		sink->fd = -1;
+	}
+	gst_caps_replace(&sink->caps, NULL);
+
+	return TRUE;
+}
+
+// The frame layout, the caps without the frame rate, flycapsrc updates that as the camera's changes
+static gboolean
+gst_flycap_raw_sink_same_layout (GstCaps * a, GstCaps * b)
+{
+	GstCaps *ca = gst_caps_copy(a), *cb = gst_caps_copy(b);
+	gboolean same;
+	guint i;
+
+	for (i = 0; i < gst_caps_get_size(ca); i++)
+		gst_structure_remove_field(gst_caps_get_structure(ca, i), "framerate");
+	for (i = 0; i < gst_caps_get_size(cb); i++)
+		gst_structure_remove_field(gst_caps_get_structure(cb, i), "framerate");
+	same = gst_caps_is_equal(ca, cb);
+	gst_caps_unref(ca);
+	gst_caps_unref(cb);
+
+	return same;
+}
+
+// Frames are only meaningful with the caps in the index, so the layout cannot change once written.
+// Each frame has its own timestamp in the index, so a new frame rate is fine.
+static gboolean
+gst_flycap_raw_sink_set_caps (GstBaseSink * bsink, GstCaps * caps)
+{
+	GstFlycapRawSink *sink = GST_FLYCAP_RAW_SINK (bsink);
+
+	if (sink->index_header_written){
+		if (!gst_flycap_raw_sink_same_layout(caps, sink->caps)){
+			GST_ELEMENT_ERROR(sink, STREAM, FORMAT, ("Caps cannot change during a recording."),
+					("%" GST_PTR_FORMAT " after %" GST_PTR_FORMAT, caps, sink->caps));
+			return FALSE;
+		}
+		GST_DEBUG_OBJECT(sink, "frame rate changed, %" GST_PTR_FORMAT, caps);
+		return TRUE;   // the index keeps the caps it was started with
+	}
+
+	gst_caps_replace(&sink->caps, caps);
+	return TRUE;
+}
+
+static gboolean
+gst_flycap_raw_sink_write_index_header (GstFlycapRawSink * sink)
+{
+	FlycapRawIndexHeader header;
+	gchar *caps = sink->caps ? gst_caps_to_string(sink->caps) : g_strdup("");
+	gsize len = strlen(caps) + 1;
+	gchar pad[8] = { 0 };
+	gboolean ok;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FLYCAP_RAW_INDEX_MAGIC, sizeof(header.magic));
+	header.version = FLYCAP_RAW_INDEX_VERSION;
+	header.caps_size = GST_ROUND_UP_8(len);
+
+	ok = fwrite(&header, sizeof(header), 1, sink->index) == 1
+			&& fwrite(caps, len, 1, sink->index) == 1
+			&& (header.caps_size == len || fwrite(pad, header.caps_size - len, 1, sink->index) == 1);
+	g_free(caps);
+
+	sink->index_header_written = TRUE;
+	return ok;
+}
+
+static GstFlowReturn
+gst_flycap_raw_sink_render (GstBaseSink * bsink, GstBuffer * buf)
+{
+	GstFlycapRawSink *sink = GST_FLYCAP_RAW_SINK (bsink);
+	FlycapRawIndexEntry entry;
+	GstMapInfo map;
+	gsize done = 0, n;
+	gint error;
+
+	if (!sink->index_header_written && !gst_flycap_raw_sink_write_index_header(sink))
+		goto index_error;
+
+	if (!gst_buffer_map(buf, &map, GST_MAP_READ)){
+		GST_ELEMENT_ERROR(sink, RESOURCE, READ, ("Could not map the buffer."), (NULL));
+		return GST_FLOW_ERROR;
+	}
+
+	entry.offset = sink->data_size;
+	entry.pts = GST_BUFFER_PTS(buf);
+	entry.frame = GST_BUFFER_OFFSET(buf);
+	entry.size = map.size;
+	entry.flags = GST_BUFFER_FLAGS(buf);
+
+	// Frames run on across blocks, each full block goes to the disk
+	while (done < map.size){
+		n = MIN(map.size - done, sink->block_size - sink->fill);
+		memcpy(sink->current->data + sink->fill, map.data + done, n);
+		sink->fill += n;
+		done += n;
+
+		if (sink->fill == sink->block_size){
+			sink->current->len = sink->block_size;
+			sink->current->offset = sink->write_offset;
+			gst_flycap_raw_sink_submit(sink, sink->current);
+			sink->write_offset += sink->block_size;
+			if (!gst_flycap_raw_sink_next_block(sink))
+				break;
+		}
+	}
+	gst_buffer_unmap(buf, &map);
+
+	error = g_atomic_int_get(&sink->write_error);
+	if (error){
+		GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, ("Could not write to file \"%s\".", sink->location),
+				("%s", g_strerror(error)));
+		return GST_FLOW_ERROR;
+	}
+
+	sink->data_size += entry.size;
+	sink->bytes_written += entry.size;
+	sink->frames_written++;
+
+	if (fwrite(&entry, sizeof(entry), 1, sink->index) != 1)
+		goto index_error;
+
+	return GST_FLOW_OK;
+
+	index_error:
+	GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, ("Could not write the frame index."), GST_ERROR_SYSTEM);
+	return GST_FLOW_ERROR;
+}
+
+// Everything is on the disk before EOS is posted
+static gboolean
+gst_flycap_raw_sink_event (GstBaseSink * bsink, GstEvent * event)
+{
+	GstFlycapRawSink *sink = GST_FLYCAP_RAW_SINK (bsink);
+
+	if (GST_EVENT_TYPE(event) == GST_EVENT_EOS && !gst_flycap_raw_sink_drain(sink)){
+		gst_event_unref(event);
+		return FALSE;
+	}
+
+	return GST_BASE_SINK_CLASS (gst_flycap_raw_sink_parent_class)->event (bsink, event);
+}
+
+static void
+gst_flycap_raw_sink_set_property (GObject * object, guint property_id,
+		const GValue * value, GParamSpec * pspec)
+{
+	GstFlycapRawSink *sink = GST_FLYCAP_RAW_SINK (object);
+
+	switch (property_id) {
+	case PROP_LOCATION:
+		g_free(sink->location);
+		sink->location = g_value_dup_string (value);
+		break;
+	case PROP_INDEX_LOCATION:
+		g_free(sink->index_location);
+		sink->index_location = g_value_dup_string (value);
+		break;
+	case PROP_BLOCK_SIZE:
+		sink->block_size = GST_ROUND_UP_N(g_value_get_uint (value), FLYCAP_RAW_ALIGN);
+		break;
+	case PROP_QUEUE_DEPTH:
+		sink->queue_depth = g_value_get_uint (value);
+		break;
+	case PROP_DIRECT:
+		sink->direct = g_value_get_boolean (value);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+		break;
+	}
+}
+
+static void
+gst_flycap_raw_sink_get_property (GObject * object, guint property_id,
+		GValue * value, GParamSpec * pspec)
+{
+	GstFlycapRawSink *sink = GST_FLYCAP_RAW_SINK (object);
+
+	switch (property_id) {
+	case PROP_LOCATION:
+		g_value_set_string (value, sink->location);
+		break;
+	case PROP_INDEX_LOCATION:
+		g_value_set_string (value, sink->index_location);
+		break;
+	case PROP_BLOCK_SIZE:
+		g_value_set_uint (value, sink->block_size);
+		break;
+	case PROP_QUEUE_DEPTH:
+		g_value_set_uint (value, sink->queue_depth);
+		break;
+	case PROP_DIRECT:
+		g_value_set_boolean (value, sink->direct);
+		break;
+	case PROP_FRAMES_WRITTEN:
+		g_value_set_uint64 (value, sink->frames_written);
+		break;
+	case PROP_BYTES_WRITTEN:
+		g_value_set_uint64 (value, sink->bytes_written);
+		break;
+	case PROP_STALLS:
+		g_value_set_uint64 (value, sink->stalls);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+		break;
+	}
+}
+
+static void
+gst_flycap_raw_sink_finalize (GObject * object)
+{
+	GstFlycapRawSink *sink = GST_FLYCAP_RAW_SINK (object);
+
+	g_free(sink->location);
+	g_free(sink->index_location);
+
+	G_OBJECT_CLASS (gst_flycap_raw_sink_parent_class)->finalize (object);
+}
+
+static void
+gst_flycap_raw_sink_class_init (GstFlycapRawSinkClass * klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+	GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+	GstBaseSinkClass *gstbasesink_class = GST_BASE_SINK_CLASS (klass);
+
+	GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "flycaprawsink", 0,
+			"FlyCapture raw recording sink");
+
+	gobject_class->set_property = gst_flycap_raw_sink_set_property;
+	gobject_class->get_property = gst_flycap_raw_sink_get_property;
+	gobject_class->finalize = gst_flycap_raw_sink_finalize;
+
+	gst_element_class_add_pad_template (gstelement_class,
+			gst_static_pad_template_get (&gst_flycap_raw_sink_template));
+
+	gst_element_class_set_static_metadata (gstelement_class,
+			"FlyCapture Raw Recording Sink", "Sink/File",
+			"Writes raw frames and a frame index to disk with large aligned direct writes",
+			"Paul R. Barber <paul.barber@oncology.ox.ac.uk>");
+
+	gstbasesink_class->start = GST_DEBUG_FUNCPTR (gst_flycap_raw_sink_start);
+	gstbasesink_class->stop = GST_DEBUG_FUNCPTR (gst_flycap_raw_sink_stop);
+	gstbasesink_class->set_caps = GST_DEBUG_FUNCPTR (gst_flycap_raw_sink_set_caps);
+	gstbasesink_class->render = GST_DEBUG_FUNCPTR (gst_flycap_raw_sink_render);
+	gstbasesink_class->event = GST_DEBUG_FUNCPTR (gst_flycap_raw_sink_event);
+
+	g_object_class_install_property (gobject_class, PROP_LOCATION,
+	  g_param_spec_string("location", "File Location", "File to write the frames to.", NULL,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_INDEX_LOCATION,
+	  g_param_spec_string("index-location", "Index File Location", "File to write the frame index to, NULL for location with .idx appended.", NULL,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_BLOCK_SIZE,
+	  g_param_spec_uint("block-size", "Block Size", "Bytes in each write, rounded up to a multiple of 4096.", FLYCAP_RAW_ALIGN, 256 * 1024 * 1024, DEFAULT_PROP_BLOCK_SIZE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_QUEUE_DEPTH,
+	  g_param_spec_uint("queue-depth", "Queue Depth", "Blocks in memory, one is filled while the others are written.", 2, 256, DEFAULT_PROP_QUEUE_DEPTH,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_DIRECT,
+	  g_param_spec_boolean("direct", "Direct I/O", "Open the file with O_DIRECT to bypass the page cache, if the file system allows it.", DEFAULT_PROP_DIRECT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_FRAMES_WRITTEN,
+	  g_param_spec_uint64("frames-written", "Frames Written", "Frames recorded since the start.", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property (gobject_class, PROP_BYTES_WRITTEN,
+	  g_param_spec_uint64("bytes-written", "Bytes Written", "Bytes of frames recorded since the start.", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property (gobject_class, PROP_STALLS,
+	  g_param_spec_uint64("stalls", "Stalls", "Times a frame waited for a block to be written, more than a few and the disk is not keeping up.", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+}
+
+static void
+gst_flycap_raw_sink_init (GstFlycapRawSink * sink)
+{
+	sink->location = NULL;
+	sink->index_location = NULL;
+	sink->block_size = DEFAULT_PROP_BLOCK_SIZE;
+	sink->queue_depth = DEFAULT_PROP_QUEUE_DEPTH;
+	sink->direct = DEFAULT_PROP_DIRECT;
+	sink->fd = -1;
+	sink->index = NULL;
+	sink->caps = NULL;
+	sink->blocks = NULL;
+	sink->current = NULL;
+	sink->writer = NULL;
+	sink->full_queue = NULL;
+	sink->free_queue = NULL;
+
+	// As filesink, record as fast as frames come rather than to the clock
+	gst_base_sink_set_sync (GST_BASE_SINK (sink), FALSE);
+}
@@ -0,0 +1,121 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _GST_FLYCAP_RAW_SINK_H_
+#define _GST_FLYCAP_RAW_SINK_H_
+
+#include <stdio.h>
+
+#include <gst/base/gstbasesink.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_FLYCAP_RAW_SINK   (gst_flycap_raw_sink_get_type())
+#define GST_FLYCAP_RAW_SINK(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_FLYCAP_RAW_SINK,GstFlycapRawSink))
+#define GST_FLYCAP_RAW_SINK_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_FLYCAP_RAW_SINK,GstFlycapRawSinkClass))
+#define GST_IS_FLYCAP_RAW_SINK(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_FLYCAP_RAW_SINK))
+
+typedef struct _GstFlycapRawSink GstFlycapRawSink;
+typedef struct _GstFlycapRawSinkClass GstFlycapRawSinkClass;
+
+/* The index file is a header, the caps string, then one entry per frame. All values are in
+ * host byte order. Frames are packed back to back in the data file with no padding.
+ */
+#define FLYCAP_RAW_INDEX_MAGIC    "FLYCAPRI"
+#define FLYCAP_RAW_INDEX_VERSION  1
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 caps_size;     // bytes of caps string that follow, NUL terminated and padded to 8
+} FlycapRawIndexHeader;
+
+typedef struct
+{
+  guint64 offset;        // of the frame in the data file
+  guint64 pts;           // GST_CLOCK_TIME_NONE if the buffer had none
+  guint64 frame;         // GST_BUFFER_OFFSET, the flycapsrc frame number
+  guint32 size;
+  guint32 flags;         // GstBufferFlags
+} FlycapRawIndexEntry;
+
+// One aligned block of the data file, filled by render and written asynchronously
+typedef struct
+{
+  guint8 *data;
+  gsize len;
+  guint64 offset;
+} FlycapRawBlock;
+
+struct _GstFlycapRawSink
+{
+  GstBaseSink parent;
+
+  // properties
+  gchar *location;
+  gchar *index_location;     // NULL for location with .idx appended
+  guint block_size;          // bytes, a multiple of FLYCAP_RAW_ALIGN
+  guint queue_depth;         // blocks, one is being filled, the rest can be in flight
+  gboolean direct;           // O_DIRECT, bypass the page cache
+
+  // files
+  int fd;
+  FILE *index;
+  gboolean index_header_written;
+  GstCaps *caps;
+
+  // blocks
+  FlycapRawBlock *blocks;
+  FlycapRawBlock *current;   // being filled
+  gsize fill;                // bytes in current
+  guint64 write_offset;      // file offset of current
+  guint64 data_size;         // bytes of frames, the file is truncated to this at the end
+
+  // submission, io_uring or a writer thread
+#ifdef HAVE_LIBURING
+  gboolean use_uring;
+  struct io_uring ring;
+  GQueue free_blocks;
+#endif
+  GThread *writer;
+  GAsyncQueue *full_queue;   // blocks for the writer thread
+  GAsyncQueue *free_queue;   // blocks it has written
+  gint write_error;          // first errno from a write, atomic
+
+  // statistics
+  guint64 frames_written;
+  guint64 bytes_written;
+  guint64 stalls;            // times render waited for a block, the disk is not keeping up
+};
+
+struct _GstFlycapRawSinkClass
+{
+  GstBaseSinkClass parent_class;
+};
+
+GType gst_flycap_raw_sink_get_type (void);
+
+G_END_DECLS
+
+#endif
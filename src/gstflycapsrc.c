@@ -51,6 +51,10 @@
 #include "FlyCapture2_C.h"
 
 #include "gstflycapsrc.h"
+#include "gstflycapmeta.h"
+#include "gstflycapkernel.h"
+#include "gstflycaplatency.h"
+#include "gstflycapcalib.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_flycap_src_debug);
 #define GST_CAT_DEFAULT gst_flycap_src_debug
@@ -67,6 +71,17 @@ static gboolean gst_flycap_src_start (GstBaseSrc * src);
 static gboolean gst_flycap_src_stop (GstBaseSrc * src);
 static GstCaps *gst_flycap_src_get_caps (GstBaseSrc * src, GstCaps * filter);
 static gboolean gst_flycap_src_set_caps (GstBaseSrc * src, GstCaps * caps);
+static gboolean gst_flycap_src_query (GstBaseSrc * src, GstQuery * query);
+static gboolean gst_flycap_src_unlock (GstBaseSrc * src);
+static gboolean gst_flycap_src_unlock_stop (GstBaseSrc * src);
+static gboolean gst_flycap_src_save_profile (GstFlycapSrc * src, guint channel);
+static gboolean gst_flycap_src_load_profile (GstFlycapSrc * src, guint channel);
+static gboolean gst_flycap_src_trigger (GstFlycapSrc * src);
+static gboolean gst_flycap_src_capture_dark (GstFlycapSrc * src);
+static gboolean gst_flycap_src_capture_flat (GstFlycapSrc * src);
+static GstPad *gst_flycap_src_request_new_pad (GstElement * element, GstPadTemplate * templ,
+		const gchar * name, const GstCaps * caps);
+static void gst_flycap_src_release_pad (GstElement * element, GstPad * pad);
 
 #ifdef OVERRIDE_CREATE
 	static GstFlowReturn gst_flycap_src_create (GstPushSrc * src, GstBuffer ** buf);
@@ -104,9 +119,62 @@ enum
 	PROP_LUT2_OFFSET_B,
 	PROP_LUT2_GAMMA,
 	PROP_LUT2_GAIN,
-	PROP_MAXFRAMERATE
+	PROP_MAXFRAMERATE,
+	PROP_AE_ROI_LEFT,
+	PROP_AE_ROI_TOP,
+	PROP_AE_ROI_WIDTH,
+	PROP_AE_ROI_HEIGHT,
+	PROP_HOST_AE,
+	PROP_HOST_AE_TARGET,
+	PROP_HOST_AE_PERCENTILE,
+	PROP_HOST_AE_MAX_EXPOSURE,
+	PROP_HOST_AE_INTERVAL,
+	PROP_STATS,
+	PROP_HFLIP,
+	PROP_VFLIP,
+	PROP_ROTATION,
+	PROP_LATENCY_TRACING,
+	PROP_LATENCY_INTERVAL,
+	PROP_LATENCY_STATS,
+	PROP_HEALTH_INTERVAL,
+	PROP_HEALTH,
+	PROP_FPS,
+	PROP_FRAMES_RETRIEVED,
+	PROP_FRAMES_DELIVERED,
+	PROP_FRAMES_DROPPED,
+	PROP_FRAMES_CORRUPT,
+	PROP_RETRIEVE_TIMEOUT,
+	PROP_RETRY_LIMIT,
+	PROP_RECONNECT_LIMIT,
+	PROP_STARTUP_STATS,
+	PROP_PROFILE,
+	PROP_PRETRIGGER_SECONDS,
+	PROP_PRETRIGGER_BYTES,
+	PROP_ACCUMULATE,
+	PROP_CALIBRATION,
+	PROP_CALIBRATION_FRAMES,
+	PROP_CALIBRATION_DIR,
+	PROP_DEFECT_THRESHOLD,
+	PROP_PREVIEW_SCALE,
+	PROP_PREVIEW_FRAMERATE,
+	PROP_DECIMATION,
+	PROP_DECIMATION_PHASE,
+	PROP_EMBEDDED_INFO,
+	PROP_SETTLE_FRAMES
 };
 
+enum
+{
+	SIGNAL_SAVE_PROFILE,
+	SIGNAL_LOAD_PROFILE,
+	SIGNAL_TRIGGER,
+	SIGNAL_CAPTURE_DARK,
+	SIGNAL_CAPTURE_FLAT,
+	LAST_SIGNAL
+};
+
+static guint gst_flycap_src_signals[LAST_SIGNAL] = { 0 };
+
 
 #define	FLYCAP_UPDATE_LOCAL  FALSE
 #define	FLYCAP_UPDATE_CAMERA TRUE
@@ -119,8 +187,9 @@ enum
 #define DEFAULT_PROP_BINNING            1
 #define DEFAULT_PROP_SHARPNESS			2    // this is 'normal'
 #define DEFAULT_PROP_SATURATION			25   // this is 100 on the camera scale 0-400
-#define DEFAULT_PROP_HORIZ_FLIP         0
-#define DEFAULT_PROP_VERT_FLIP          0
+#define DEFAULT_PROP_HORIZ_FLIP         FALSE
+#define DEFAULT_PROP_VERT_FLIP          FALSE
+#define DEFAULT_PROP_ROTATION           GST_ROTATION_0
 #define DEFAULT_PROP_WHITEBALANCE       GST_WB_MANUAL
 #define DEFAULT_PROP_LUT		        GST_LUT_1
 #define DEFAULT_PROP_LUT1_OFFSET		0    
@@ -131,6 +200,45 @@ enum
 #define DEFAULT_PROP_LUT2_GAIN		    1.501   
 #define DEFAULT_PROP_MAXFRAMERATE       25
 #define DEFAULT_PROP_GAMMA			    1.5
+#define DEFAULT_PROP_AE_ROI_LEFT        0
+#define DEFAULT_PROP_AE_ROI_TOP         0
+#define DEFAULT_PROP_AE_ROI_WIDTH       0    // 0 = use the central fifth of the frame
+#define DEFAULT_PROP_AE_ROI_HEIGHT      0
+#define DEFAULT_PROP_HOST_AE            FALSE
+#define DEFAULT_PROP_HOST_AE_TARGET     118   // 8-bit level the percentile is driven to
+#define DEFAULT_PROP_HOST_AE_PERCENTILE 50.0
+#define DEFAULT_PROP_HOST_AE_MAX_EXPOSURE 40.0  // ms, gain is used beyond this
+#define DEFAULT_PROP_HOST_AE_INTERVAL   100   // ms between camera writes
+
+#define DEFAULT_PROP_STATS              FALSE
+#define DEFAULT_PROP_LATENCY_TRACING    FALSE
+#define DEFAULT_PROP_LATENCY_INTERVAL   1000  // ms between latency messages
+#define DEFAULT_PROP_HEALTH_INTERVAL    0     // ms between health messages
+#define DEFAULT_PROP_RETRIEVE_TIMEOUT   2000  // ms, -1 waits for ever
+#define DEFAULT_PROP_RETRY_LIMIT        3     // failed retrieves in a row before reconnecting
+#define DEFAULT_PROP_RECONNECT_LIMIT    10    // reconnect attempts before the pipeline gets an error
+#define DEFAULT_PROP_PROFILE            0     // send every setting from the host
+#define DEFAULT_PROP_PRETRIGGER_SECONDS 0.0   // push every frame as it arrives
+#define DEFAULT_PROP_ACCUMULATE         1     // no averaging
+#define DEFAULT_PROP_DECIMATION         1     // every frame
+#define DEFAULT_PROP_DECIMATION_PHASE   0
+#define DEFAULT_PROP_EMBEDDED_INFO      FALSE // the camera writes it over the first pixels
+#define DEFAULT_PROP_CALIBRATION        TRUE  // correct with any references there are
+#define DEFAULT_PROP_CALIBRATION_FRAMES 16
+#define DEFAULT_PROP_DEFECT_THRESHOLD   0     // no defect correction
+#define FLYCAP_CAPS_UPDATE_INTERVAL     GST_SECOND   // between frame rate caps events
+
+#define DEFAULT_PROP_PREVIEW_SCALE      4     // preview is a quarter of the sensor width and height
+#define DEFAULT_PROP_PREVIEW_FRAMERATE  15.0  // fps, 0 for every buffer
+
+#define RETRY_BACKOFF_MIN               (10 * GST_MSECOND)   // first wait after an error, doubles each time
+#define RETRY_BACKOFF_MAX               GST_SECOND           // and between reconnect attempts
+
+#define HOST_AE_SUBSAMPLE               4     // use every 4th pixel of every 4th row
+#define HOST_AE_SETTLE_FRAMES           2     // frames to wait for a new exposure to appear in the image
+#define HOST_AE_DEADBAND                0.05  // relative error that is ignored
+
+#define MIRROR_IMAGE_CTRL               0x1054   // camera register for a left-right mirror
 
 #define DEFAULT_GST_VIDEO_FORMAT GST_VIDEO_FORMAT_RGB
 #define DEFAULT_FLYCAP_VIDEO_FORMAT FC2_PIXEL_FORMAT_RGB8
@@ -145,6 +253,15 @@ static GstStaticPadTemplate gst_flycap_src_template =
 						("{ RGB }"))
 		);
 
+// A smaller copy of the same frames for display, see gst_flycap_preview_push
+static GstStaticPadTemplate gst_flycap_preview_template =
+		GST_STATIC_PAD_TEMPLATE ("preview",
+				GST_PAD_SRC,
+				GST_PAD_REQUEST,
+				GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE
+						("{ RGB }"))
+		);
+
 // error check, use in functions where 'src' is declared and initialised
 #define FLYCAPEXECANDCHECK(function) \
 {\
@@ -198,21 +315,19 @@ lut_get_type (void)
   return lut_type;
 }
 
-static void gst_flycap_Write_ROI_Register(GstFlycapSrc * src)
-{
-	unsigned int pValue, presence, on_off, base, left, top, width, height;
-//	unsigned int left2, top2, width2, height2;
+static gboolean gst_flycap_read_ROI_base(GstFlycapSrc * src)
+{   // The ROI register block does not move, so read its offset and units once per connection and cache them
+	unsigned int pValue, presence, on_off, base;
 
 	if (!src->deviceContext)
-		return;
+		return FALSE;
+
+	if (src->roi_base)
+		return TRUE;
 
 	// Read main flags
 	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext,  0x1A70, &pValue));
 
-	//	presence = (pValue & 0x80000000)>>31;
-//	on_off   = (pValue & 0x02000000)>>25;
-//	GST_DEBUG_OBJECT(src, "gst_flycap_Read_ROI_Register presence %d on_off %d", presence, on_off);
-
 	// Make registers writable and turn on ROI
 	pValue = pValue | 0x02000000;
 	FLYCAPEXECANDCHECK(fc2WriteRegister(src->deviceContext, 0x1A70, pValue));
@@ -221,39 +336,116 @@ static void gst_flycap_Write_ROI_Register(GstFlycapSrc * src)
 	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext,  0x1A70, &pValue));
 	presence = (pValue & 0x80000000)>>31;
 	on_off   = (pValue & 0x02000000)>>25;
-	GST_DEBUG_OBJECT(src, "gst_flycap_Read_ROI_Register presence %d on_off %d", presence, on_off);
+	GST_DEBUG_OBJECT(src, "gst_flycap_read_ROI_base presence %d on_off %d", presence, on_off);
+
+	if (!presence){
+		GST_WARNING_OBJECT(src, "Camera does not support the AE/WB ROI");
+		return FALSE;
+	}
 
 	// Get offset to ROI data
 	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext,  0x1A74, &pValue));
 	base = (pValue*4) - 0xF00000;
-	GST_DEBUG_OBJECT(src, "gst_flycap_Read_ROI_Register BASE 0x%x", base);
+	GST_DEBUG_OBJECT(src, "gst_flycap_read_ROI_base BASE 0x%x", base);
 
-	left = 2*src->nWidth/5;
-	top  = 2*src->nHeight/5;
-	width = src->nWidth/5;
-	height = src->nHeight/5;
+	// Read left and top UNITS
+	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext, base, &pValue));
+	src->roi_left_unit = (pValue & 0xFFFF0000)>>16;   // take MS 16 bits
+	src->roi_top_unit  = (pValue & 0x0000FFFF);       // take LS 16 bits
 
-	GST_DEBUG_OBJECT(src, "gst_flycap_Set_ROI_Register left %d top %d width %d height %d", left, top, width, height);
+	// Read width and height UNITS
+	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext, base + 0x4, &pValue));
+	src->roi_width_unit  = (pValue & 0xFFFF0000)>>16;   // take MS 16 bits
+	src->roi_height_unit = (pValue & 0x0000FFFF);       // take LS 16 bits
 
-	// Set left and top
-	pValue = left*0x10000 + top;
+	GST_DEBUG_OBJECT(src, "gst_flycap_read_ROI_base left_unit %d top_unit %d width_unit %d height_unit %d",
+			src->roi_left_unit, src->roi_top_unit, src->roi_width_unit, src->roi_height_unit);
 
-	// check
-//	left2 = (pValue & 0xFFFF0000)>>16;   // take MS 16 bits
-//	top2  = (pValue & 0x0000FFFF);       // take LS 16 bits
+	src->roi_base = base;
 
-	FLYCAPEXECANDCHECK(fc2WriteRegister(src->deviceContext, base + 0x8, pValue));
+	return TRUE;
 
-	// Set width and height
-	pValue = width*0x10000 + height;
+	fail:   // required for FLYCAPEXECANDCHECK, but do no more than the debug message here.
+	return FALSE;
+}
+
+// Round val down to a multiple of unit, a unit that makes no sense for this dimension is ignored
+static unsigned int roi_round_to_unit(unsigned int val, unsigned int unit, unsigned int dimension)
+{
+	if (unit == 0 || unit > dimension)
+		return val;
+
+	return (val / unit) * unit;
+}
+
+#define TYPE_ROTATION (rotation_get_type ())
+static GType
+rotation_get_type (void)
+{
+  static GType rotation_type = 0;
+
+  if (!rotation_type) {
+    static GEnumValue rotation_types[] = {
+    		  { GST_ROTATION_0, "No rotation.",    "0" },
+    		  { GST_ROTATION_90, "Rotate 90 degrees clockwise.",    "90" },
+    		  { GST_ROTATION_180, "Rotate 180 degrees.",    "180" },
+    		  { GST_ROTATION_270, "Rotate 90 degrees anticlockwise.",    "270" },
+    		  { 0, NULL, NULL },
+    };
+
+    rotation_type =
+	g_enum_register_static ("RotationType", rotation_types);
+  }
+
+  return rotation_type;
+}
+
+static void gst_flycap_Write_ROI_Register(GstFlycapSrc * src)
+{
+	unsigned int pValue, left, top, width, height;
+
+	if (!src->deviceContext)
+		return;
+
+	if (!gst_flycap_read_ROI_base(src))
+		return;
+
+	if (src->ae_roi_width > 0 && src->ae_roi_height > 0){
+		// Requested region, clipped to the sensor
+		left   = MIN((unsigned int)src->ae_roi_left, src->nWidth - 1);
+		top    = MIN((unsigned int)src->ae_roi_top, src->nHeight - 1);
+		width  = MIN((unsigned int)src->ae_roi_width, src->nWidth - left);
+		height = MIN((unsigned int)src->ae_roi_height, src->nHeight - top);
+	}
+	else{
+		// Default to the central fifth of the frame
+		left = 2*src->nWidth/5;
+		top  = 2*src->nHeight/5;
+		width = src->nWidth/5;
+		height = src->nHeight/5;
+	}
 
-	// check
-//	width2  = (pValue & 0xFFFF0000)>>16;   // take MS 16 bits
-//	height2 = (pValue & 0x0000FFFF);       // take LS 16 bits
+	// Validate against the units the camera reported
+	left   = roi_round_to_unit(left,   src->roi_left_unit,   src->nWidth);
+	top    = roi_round_to_unit(top,    src->roi_top_unit,    src->nHeight);
+	width  = roi_round_to_unit(width,  src->roi_width_unit,  src->nWidth);
+	height = roi_round_to_unit(height, src->roi_height_unit, src->nHeight);
+	if (width == 0)
+		width = MAX(src->roi_width_unit, 1);
+	if (height == 0)
+		height = MAX(src->roi_height_unit, 1);
 
-	FLYCAPEXECANDCHECK(fc2WriteRegister(src->deviceContext, base + 0xC, pValue));
+	GST_DEBUG_OBJECT(src, "gst_flycap_Set_ROI_Register left %d top %d width %d height %d", left, top, width, height);
+
+	// Set left and top
+	pValue = left*0x10000 + top;
+	flycap_state_set_register(&src->applied, src->roi_base + 0x8, pValue);
+	FLYCAPEXECANDCHECK(fc2WriteRegister(src->deviceContext, src->roi_base + 0x8, pValue));
 
-//	GST_DEBUG_OBJECT(src, "gst_flycap_Set_ROI_Register left2 %d top2 %d width2 %d height2 %d", left2, top2, width2, height2);
+	// Set width and height
+	pValue = width*0x10000 + height;
+	flycap_state_set_register(&src->applied, src->roi_base + 0xC, pValue);
+	FLYCAPEXECANDCHECK(fc2WriteRegister(src->deviceContext, src->roi_base + 0xC, pValue));
 
 	return;
 
@@ -263,7 +455,7 @@ static void gst_flycap_Write_ROI_Register(GstFlycapSrc * src)
 
 static void gst_flycap_Read_ROI_Register(GstFlycapSrc * src)
 {
-	unsigned int pValue, presence, on_off, base, left, top, width, height, left_unit, top_unit, width_unit, height_unit;
+	unsigned int pValue, presence, on_off, left, top, width, height;
 
 	if (!src->deviceContext)
 		return;
@@ -275,33 +467,24 @@ static void gst_flycap_Read_ROI_Register(GstFlycapSrc * src)
 
 	GST_DEBUG_OBJECT(src, "gst_flycap_Read_ROI_Register presence %d on_off %d", presence, on_off);
 
-	// Get offset to ROI data
-	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext,  0x1A74, &pValue));
-	base = (pValue*4) - 0xF00000;
+	// Get offset to ROI data, and the units
+	if (!gst_flycap_read_ROI_base(src))
+		return;
 
 	// Read left and top
-	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext, base + 0x8, &pValue));
+	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext, src->roi_base + 0x8, &pValue));
 	left = (pValue & 0xFFFF0000)>>16;   // take MS 16 bits
 	top  = (pValue & 0x0000FFFF);       // take LS 16 bits
 
 	// Read width and height
-	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext, base + 0xC, &pValue));
+	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext, src->roi_base + 0xC, &pValue));
 	width  = (pValue & 0xFFFF0000)>>16;   // take MS 16 bits
 	height = (pValue & 0x0000FFFF);       // take LS 16 bits
 
 	GST_DEBUG_OBJECT(src, "gst_flycap_Read_ROI_Register left %d top %d width %d height %d", left, top, width, height);
 
-	// Read left and top UNITS
-	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext, base, &pValue));
-	left_unit = (pValue & 0xFFFF0000)>>16;   // take MS 16 bits
-	top_unit  = (pValue & 0x0000FFFF);       // take LS 16 bits
-
-	// Read width and height UNITS
-	FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext, base + 0x4, &pValue));
-	width_unit  = (pValue & 0xFFFF0000)>>16;   // take MS 16 bits
-	height_unit = (pValue & 0x0000FFFF);       // take LS 16 bits
-
-	GST_DEBUG_OBJECT(src, "gst_flycap_Read_ROI_Register left_unit %d top_unit %d width_unit %d height_unit %d", left_unit, top_unit, width_unit, height_unit);
+	GST_DEBUG_OBJECT(src, "gst_flycap_Read_ROI_Register left_unit %d top_unit %d width_unit %d height_unit %d",
+			src->roi_left_unit, src->roi_top_unit, src->roi_width_unit, src->roi_height_unit);
 
 	return;
 
@@ -334,6 +517,40 @@ static void gst_flycap_Read_WB_Register(GstFlycapSrc * src)
 }
 
 
+/* Every property write goes through here so it is recorded in the applied state for a reconnect.
+ * Only the given fields are changed, the rest are read from the camera first. While starting the
+ * camera's values have already been read, and the write is skipped if the camera has the setting. */
+static gboolean gst_flycap_write_property(GstFlycapSrc * src, const fc2Property * want, guint fields)
+{
+	fc2Property prop;
+	const fc2Property *cached;
+
+	flycap_state_set_property(&src->applied, want, fields);
+
+	if (!src->deviceContext)
+		return FALSE;
+
+	cached = flycap_property_cache_lookup(&src->camera_props, want->type);
+	if (cached){
+		src->startup_checked++;
+		if (flycap_state_property_matches(cached, want, fields))
+			return TRUE;
+		prop = *cached;
+		src->startup_written++;
+	}
+	else{
+		prop.type = want->type;
+		fc2GetProperty(src->deviceContext, &prop);
+	}
+	flycap_property_cache_drop(&src->camera_props, want->type);   // the camera may round what it is sent
+	flycap_state_merge_property(&prop, want, fields);
+	FLYCAPEXECANDCHECK(fc2SetProperty(src->deviceContext, &prop));
+	return TRUE;
+
+	fail:   // required for FLYCAPEXECANDCHECK, but do no more than the debug message here.
+	return FALSE;
+}
+
 static void gst_flycap_set_property_val(GstFlycapSrc * src, fc2PropertyType type, gint val)
 {
 	fc2Property prop;
@@ -342,27 +559,28 @@ static void gst_flycap_set_property_val(GstFlycapSrc * src, fc2PropertyType type
 		return;
 
 	prop.type = type;
-	fc2GetProperty(src->deviceContext, &prop);
-
 	prop.onOff = TRUE;  // turn this property on
 	prop.autoManualMode = FALSE; // Ensure auto-adjust mode is off, not all properties have auto mode
 	prop.absControl = FALSE; // Ensure the property is not set up to use absolute value control.
 	prop.valueA = (unsigned int)val; // Set the absolute value of the property
 	GST_DEBUG_OBJECT(src, "gst_flycap_set_property_val %d %d", type, val);
-	FLYCAPEXECANDCHECK(fc2SetProperty(src->deviceContext, &prop));
-	return;
-
-	fail:   // required for FLYCAPEXECANDCHECK, but do no more than the debug message here.
-	return;
+	gst_flycap_write_property(src, &prop, FLYCAP_FIELD_ON_OFF | FLYCAP_FIELD_AUTO | FLYCAP_FIELD_ABS_CONTROL | FLYCAP_FIELD_VALUE_A);
 }
 
 static void gst_flycap_get_property_val(GstFlycapSrc * src, fc2PropertyType type, gint *val)
 {
 	fc2Property prop;
+	const fc2Property *cached;
 
 	if (!src->deviceContext)
 		return;
 
+	// Still valid if the value was not written
+	if ((cached = flycap_property_cache_lookup(&src->camera_props, type))){
+		*val = (gint)cached->valueA;
+		return;
+	}
+
 	prop.type = type;
 	FLYCAPEXECANDCHECK(fc2GetProperty(src->deviceContext, &prop));
 	*val = (gint)prop.valueA;
@@ -380,27 +598,28 @@ static void gst_flycap_set_property_absVal(GstFlycapSrc * src, fc2PropertyType t
 		return;
 
 	prop.type = type;
-	fc2GetProperty(src->deviceContext, &prop);
-
 	prop.onOff = TRUE;  // turn this property on
 	prop.autoManualMode = FALSE; // Ensure auto-adjust mode is off, not all properties have auto mode
 	prop.absControl = TRUE; // Ensure the property is set up to use absolute value control.
 	prop.absValue = val; // Set the absolute value of the property
 	GST_DEBUG_OBJECT(src, "gst_flycap_set_property_absVal %d %f", type, val);
-	FLYCAPEXECANDCHECK(fc2SetProperty(src->deviceContext, &prop));
-	return;
-
-	fail:   // required for FLYCAPEXECANDCHECK, but do no more than the debug message here.
-	return;
+	gst_flycap_write_property(src, &prop, FLYCAP_FIELD_ON_OFF | FLYCAP_FIELD_AUTO | FLYCAP_FIELD_ABS_CONTROL | FLYCAP_FIELD_ABS_VALUE);
 }
 
 static void gst_flycap_get_property_absVal(GstFlycapSrc * src, fc2PropertyType type, float *val)
 {
 	fc2Property prop;
+	const fc2Property *cached;
 
 	if (!src->deviceContext)
 		return;
 
+	// Still valid if the value was not written
+	if ((cached = flycap_property_cache_lookup(&src->camera_props, type))){
+		*val = cached->absValue;
+		return;
+	}
+
 	prop.type = type;
 	prop.absControl = TRUE;
 	FLYCAPEXECANDCHECK(fc2GetProperty(src->deviceContext, &prop));
@@ -419,16 +638,10 @@ static void gst_flycap_set_property_auto(GstFlycapSrc * src, fc2PropertyType typ
 		return;
 
 	prop.type = type;
-	fc2GetProperty(src->deviceContext, &prop);
-
 	prop.onOff = TRUE;  // turn this property on
 	prop.autoManualMode = TRUE; // Ensure auto-adjust mode is on
 	GST_DEBUG_OBJECT(src, "gst_flycap_set_property_auto %d", type);
-	FLYCAPEXECANDCHECK(fc2SetProperty(src->deviceContext, &prop));
-	return;
-
-	fail:   // required for FLYCAPEXECANDCHECK, but do no more than the debug message here.
-	return;
+	gst_flycap_write_property(src, &prop, FLYCAP_FIELD_ON_OFF | FLYCAP_FIELD_AUTO);
 }
 
 static void gst_flycap_set_property_off(GstFlycapSrc * src, fc2PropertyType type)
@@ -439,16 +652,10 @@ static void gst_flycap_set_property_off(GstFlycapSrc * src, fc2PropertyType type
 		return;
 
 	prop.type = type;
-	fc2GetProperty(src->deviceContext, &prop);
-
 	prop.onOff = FALSE;  // turn this property off
 	prop.autoManualMode = FALSE; // Ensure auto-adjust mode is off
 	GST_DEBUG_OBJECT(src, "gst_flycap_set_property_off %d", type);
-	FLYCAPEXECANDCHECK(fc2SetProperty(src->deviceContext, &prop));
-	return;
-
-	fail:   // required for FLYCAPEXECANDCHECK, but do no more than the debug message here.
-	return;
+	gst_flycap_write_property(src, &prop, FLYCAP_FIELD_ON_OFF | FLYCAP_FIELD_AUTO);
 }
 
 static void gst_flycap_set_property_on(GstFlycapSrc * src, fc2PropertyType type)
@@ -459,16 +666,10 @@ static void gst_flycap_set_property_on(GstFlycapSrc * src, fc2PropertyType type)
 		return;
 
 	prop.type = type;
-	fc2GetProperty(src->deviceContext, &prop);
-
 	prop.onOff = TRUE;  // turn this property on
 	prop.autoManualMode = FALSE; // Ensure auto-adjust mode is off
-	GST_DEBUG_OBJECT(src, "gst_flycap_set_property_off %d", type);
-	FLYCAPEXECANDCHECK(fc2SetProperty(src->deviceContext, &prop));
-	return;
-
-	fail:   // required for FLYCAPEXECANDCHECK, but do no more than the debug message here.
-	return;
+	GST_DEBUG_OBJECT(src, "gst_flycap_set_property_on %d", type);
+	gst_flycap_write_property(src, &prop, FLYCAP_FIELD_ON_OFF | FLYCAP_FIELD_AUTO);
 }
 
 static void setupStrobe(GstFlycapSrc * src)
@@ -480,6 +681,7 @@ static void setupStrobe(GstFlycapSrc * src)
 	mStrobe.delay = 0.0f;   // ms
 	mStrobe.duration = 0;  // 0=exposure time or else specify in ms
 	GST_DEBUG_OBJECT (src, "Setting flash trigger.");
+	flycap_state_set_strobe(&src->applied, &mStrobe);
 	FLYCAPEXECANDCHECK(fc2SetStrobe(src->deviceContext, &mStrobe));
 
 	fail:
@@ -487,6 +689,342 @@ static void setupStrobe(GstFlycapSrc * src)
 	return;
 }
 
+/* Usable bandwidth (bytes/s) of each camera interface, to estimate how long a frame takes to arrive */
+static gdouble
+gst_flycap_interface_bandwidth (fc2InterfaceType type)
+{
+	switch (type){
+	case FC2_INTERFACE_USB_3:
+		return 400e6;
+	case FC2_INTERFACE_GIGE:
+		return 110e6;
+	case FC2_INTERFACE_IEEE1394:
+		return 80e6;
+	case FC2_INTERFACE_USB_2:
+	default:   // assume the slowest rather than under report the latency
+		return 40e6;
+	}
+}
+
+/* A frame is ready once it has been exposed and sent over the bus, that is the minimum latency.
+ * The frames the SDK can hold on to add to the maximum.
+ */
+static void
+gst_flycap_calculate_latency (GstFlycapSrc * src, GstClockTime * min, GstClockTime * max)
+{
+	GstClockTime transfer = 0;
+	guint frames;
+
+	if (src->transfer_rate > 0)
+		transfer = (GstClockTime)((gdouble)src->nRawPitch * src->nRawHeight / src->transfer_rate * GST_SECOND);
+
+	*min = (GstClockTime)(src->exposure * GST_MSECOND) + transfer;
+	*min += (src->accumulate - 1) * src->duration;   // the first frame of an average waits for the rest
+
+	frames = src->sdk_drop_frames ? 1 : MAX(src->sdk_buffers, 1);
+	*max = *min + frames * src->duration;
+}
+
+/* Tell the pipeline when a change of exposure, frame rate or binning changes our latency */
+static void
+gst_flycap_update_latency (GstFlycapSrc * src)
+{
+	GstClockTime min, max;
+
+	if (!src->deviceContext)
+		return;
+
+	gst_flycap_calculate_latency(src, &min, &max);
+	if (min == src->min_latency && max == src->max_latency)
+		return;
+
+	src->min_latency = min;
+	src->max_latency = max;
+	GST_DEBUG_OBJECT(src, "latency min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT, GST_TIME_ARGS(min), GST_TIME_ARGS(max));
+
+	gst_element_post_message(GST_ELEMENT(src), gst_message_new_latency(GST_OBJECT(src)));
+}
+
+/* The SDK grab timeout, long enough for the slowest frame, the exposure of every camera frame
+ * averaged and a frame period, with retrieve-timeout as the margin on top. */
+static gint
+gst_flycap_grab_timeout (GstFlycapSrc * src)
+{
+	if (src->retrieve_timeout < 0)
+		return FC2_TIMEOUT_INFINITE;
+
+	return (gint)ceil(src->exposure * src->accumulate + 1000.0 / src->framerate) + src->retrieve_timeout;
+}
+
+// Follow exposure and frame rate changes, only written to the SDK when the timeout changes
+static void
+gst_flycap_update_grab_timeout (GstFlycapSrc * src)
+{
+	fc2Config config;
+	gint timeout = gst_flycap_grab_timeout(src);
+
+	if (!src->deviceContext || !src->cameraPresent || timeout == src->grab_timeout)
+		return;
+
+	FLYCAPEXECANDCHECK(fc2GetConfiguration(src->deviceContext, &config));
+	config.grabTimeout = timeout;
+	FLYCAPEXECANDCHECK(fc2SetConfiguration(src->deviceContext, &config));
+	src->grab_timeout = timeout;
+	GST_DEBUG_OBJECT (src, "grab timeout %d ms", timeout);
+
+	fail:
+	return;
+}
+
+/* What the camera actually runs at. The shutter, the frame rate feature and the video mode all set
+ * it, so it is read back after each of them rather than worked out from the exposure. Cameras
+ * without the feature keep the estimate.
+ */
+static void
+gst_flycap_read_framerate (GstFlycapSrc * src)
+{
+	float rate = 0.0f;
+
+	if (!src->deviceContext)
+		return;
+
+	flycap_property_cache_drop(&src->camera_props, FC2_FRAME_RATE);   // follows other settings
+	gst_flycap_get_property_absVal(src, FC2_FRAME_RATE, &rate);
+	if (rate > 0.0f)
+		src->framerate = rate;
+	src->duration = 1000000000.0/src->framerate;  // frame duration in ns
+
+	// Most exposure changes, e.g. from host AE or a controller, leave the rate as it was
+	if (src->framerate == src->reported_framerate)
+		return;
+	src->reported_framerate = src->framerate;
+	src->frame_interval = src->duration;          // measure again from here
+	src->interval_outliers = 0;
+	GST_DEBUG_OBJECT(src, "camera frame rate %.3f", src->framerate);
+	gst_flycap_update_grab_timeout(src);
+
+	g_atomic_int_set(&src->framerate_changed, TRUE);
+}
+
+/* Buffers per second, for the caps, rounded so small changes in the camera's value do not
+ * make long fractions */
+static void
+gst_flycap_output_framerate (GstFlycapSrc * src, gint * n, gint * d)
+{
+	gdouble fps = src->framerate / (src->accumulate * src->decimation);
+
+	gst_util_double_to_fraction(floor(fps * 1000.0 + 0.5) / 1000.0, n, d);
+}
+
+/* Called from create, the streaming thread, when the frame rate may have changed. The new rate
+ * goes downstream in a caps event, set_caps sees only the rate differ and leaves the camera running.
+ * At most one caps event in FLYCAP_CAPS_UPDATE_INTERVAL, a ramp sends where it has got to.
+ */
+static void
+gst_flycap_update_caps_framerate (GstFlycapSrc * src)
+{
+	GstClockTime now = gst_util_get_timestamp();
+	GstCaps *caps;
+	gint n, d;
+
+	if (GST_CLOCK_TIME_IS_VALID(src->caps_update_time) && now - src->caps_update_time < FLYCAP_CAPS_UPDATE_INTERVAL)
+		return;   // the flag stays set, tried again on a later frame
+	if (!g_atomic_int_compare_and_exchange(&src->framerate_changed, TRUE, FALSE))
+		return;
+
+	gst_flycap_output_framerate(src, &n, &d);
+	if (n == src->fps_n && d == src->fps_d)
+		return;
+	if (!(caps = gst_pad_get_current_caps(GST_BASE_SRC_PAD(src))))
+		return;
+
+	src->caps_update_time = now;
+	caps = gst_caps_make_writable(caps);
+	gst_caps_set_simple(caps, "framerate", GST_TYPE_FRACTION, n, d, NULL);
+	GST_DEBUG_OBJECT(src, "frame rate now %d/%d", n, d);
+	if (!gst_base_src_set_caps(GST_BASE_SRC(src), caps))
+		GST_WARNING_OBJECT(src, "downstream did not accept frame rate %d/%d", n, d);
+	gst_caps_unref(caps);
+}
+
+/* The time between camera frames as they arrive, for buffer durations and timestamps. Gaps from
+ * lost frames and bursts after a stall are left out, so it tracks the camera's clock, see
+ * flycap_latency_interval_update.
+ */
+static void
+gst_flycap_measure_interval (GstFlycapSrc * src, GstClockTime now)
+{
+	if (GST_CLOCK_TIME_IS_VALID(src->last_retrieved) && src->frame_interval > 0)
+		src->frame_interval = flycap_latency_interval_update(src->frame_interval, now - src->last_retrieved,
+				&src->interval_outliers);
+	src->last_retrieved = now;
+}
+
+/* Embedded image information. The camera writes the settings each frame was exposed with over its
+ * first pixels, one big endian word for each field that is on, in register order. A change is
+ * remembered with its register value when it is written, the first frame that shows that value is
+ * the first exposed with it, which the overlay_param_changed boxes, drawn when the change is
+ * requested, cannot tell.
+ */
+// After a write, what frames will show once it takes effect
+static void
+gst_flycap_embedded_info_expect (GstFlycapSrc * src, FlycapEmbeddedSetting * setting, fc2PropertyType type, gfloat value)
+{
+	fc2Property prop;
+
+	if (!src->deviceContext || (setting == &src->info_shutter ? src->info_shutter_word : src->info_gain_word) < 0)
+		return;
+
+	prop.type = type;
+	FLYCAPEXECANDCHECK(fc2GetProperty(src->deviceContext, &prop));
+
+	GST_OBJECT_LOCK(src);
+	if (src->starting || (prop.valueA & 0xFFF) == setting->raw){
+		// Not capturing yet, or too small a change for the camera to see, frames have it from now
+		setting->raw = prop.valueA & 0xFFF;
+		setting->value = value;
+		setting->pending = FALSE;
+	}
+	else {
+		setting->pending = TRUE;
+		setting->pending_raw = prop.valueA & 0xFFF;
+		setting->pending_value = value;
+		setting->written_at = src->info_frame;
+	}
+	GST_OBJECT_UNLOCK(src);
+
+	fail:
+	return;
+}
+
+static void
+gst_flycap_embedded_info_enable (GstFlycapSrc * src)
+{
+	fc2EmbeddedImageInfo info;
+	gint word = 0;
+
+	src->info_shutter_word = src->info_gain_word = src->info_counter_word = -1;
+
+	FLYCAPEXECANDCHECK(fc2GetEmbeddedImageInfo(src->deviceContext, &info));
+
+	// The camera keeps these over a restart, switch off ours so the first pixels are image again
+	if (!src->embedded_info){
+		if (info.gain.onOff || info.shutter.onOff || info.frameCounter.onOff){
+			info.gain.onOff = FALSE;
+			info.shutter.onOff = FALSE;
+			info.frameCounter.onOff = FALSE;
+			FLYCAPEXECANDCHECK(fc2SetEmbeddedImageInfo(src->deviceContext, &info));
+		}
+		return;
+	}
+
+	info.gain.onOff = info.gain.available;
+	info.shutter.onOff = info.shutter.available;
+	info.frameCounter.onOff = info.frameCounter.available;
+	FLYCAPEXECANDCHECK(fc2SetEmbeddedImageInfo(src->deviceContext, &info));
+	FLYCAPEXECANDCHECK(fc2GetEmbeddedImageInfo(src->deviceContext, &info));
+
+	// Fields come in this order, each there only if on, ours or left on by something else
+	if (info.timestamp.onOff)
+		word++;
+	if (info.gain.onOff)
+		src->info_gain_word = word++;
+	if (info.shutter.onOff)
+		src->info_shutter_word = word++;
+	if (info.brightness.onOff)
+		word++;
+	if (info.exposure.onOff)
+		word++;
+	if (info.whiteBalance.onOff)
+		word++;
+	if (info.frameCounter.onOff)
+		src->info_counter_word = word++;
+
+	GST_DEBUG_OBJECT(src, "embedded info words: gain %d, shutter %d, frame counter %d",
+			src->info_gain_word, src->info_shutter_word, src->info_counter_word);
+
+	// What the first frames will show, called while starting so nothing is pending
+	gst_flycap_embedded_info_expect(src, &src->info_shutter, FC2_SHUTTER, src->exposure);
+	gst_flycap_embedded_info_expect(src, &src->info_gain, FC2_GAIN, src->gain);
+	return;
+
+	fail:
+	if (src->embedded_info)   // not worth a warning for a camera that never embeds anything
+		GST_WARNING_OBJECT(src, "The camera cannot embed image information");
+}
+
+// Returns the frames a pending change took, once this frame shows it, otherwise -1
+static gint
+gst_flycap_embedded_setting_check (FlycapEmbeddedSetting * setting, guint32 word, guint32 frame)
+{
+	if (!setting->pending || (word & 0xFFF) != setting->pending_raw)
+		return -1;
+
+	setting->raw = setting->pending_raw;
+	setting->value = setting->pending_value;
+	setting->pending = FALSE;
+	return (gint)(frame - setting->written_at);
+}
+
+static void
+gst_flycap_embedded_info_settled (GstFlycapSrc * src, const gchar * setting, gfloat value, gint frames)
+{
+	src->settle_frames = frames;
+	GST_DEBUG_OBJECT(src, "%s %.3f reached frame %u, %d frames after it was written", setting, value, src->info_frame, frames);
+
+	gst_element_post_message(GST_ELEMENT(src), gst_message_new_element(GST_OBJECT(src),
+			gst_structure_new("flycap-settled",
+					"setting", G_TYPE_STRING, setting,
+					"value", G_TYPE_DOUBLE, (gdouble)value,
+					"frames", G_TYPE_UINT, (guint)frames,
+					"frame", G_TYPE_UINT, src->info_frame,
+					NULL)));
+}
+
+// Called for every camera frame as it is retrieved, before anything is done to its pixels
+static void
+gst_flycap_embedded_info_decode (GstFlycapSrc * src)
+{
+	const guint8 *words = src->convertedImage.pData;
+	gint shutter_frames = -1, gain_frames = -1;
+
+	if (src->info_counter_word >= 0)
+		src->info_frame = GST_READ_UINT32_BE(words + 4 * src->info_counter_word);
+	else
+		src->info_frame = (guint32)src->frames_retrieved;
+
+	GST_OBJECT_LOCK(src);
+	if (src->info_shutter_word >= 0)
+		shutter_frames = gst_flycap_embedded_setting_check(&src->info_shutter, GST_READ_UINT32_BE(words + 4 * src->info_shutter_word), src->info_frame);
+	if (src->info_gain_word >= 0)
+		gain_frames = gst_flycap_embedded_setting_check(&src->info_gain, GST_READ_UINT32_BE(words + 4 * src->info_gain_word), src->info_frame);
+	GST_OBJECT_UNLOCK(src);
+
+	// Posting takes the object lock
+	if (G_UNLIKELY(shutter_frames >= 0))
+		gst_flycap_embedded_info_settled(src, "exposure", src->info_shutter.value, shutter_frames);
+	if (G_UNLIKELY(gain_frames >= 0))
+		gst_flycap_embedded_info_settled(src, "gain", src->info_gain.value, gain_frames);
+}
+
+static void
+gst_flycap_embedded_info_attach (GstFlycapSrc * src, GstBuffer * buf)
+{
+	GstFlycapInfoMeta *meta;
+
+	// Pre-trigger ring buffers are reused, so they already have one
+	if (!(meta = gst_buffer_get_flycap_info_meta(buf)))
+		meta = gst_buffer_add_flycap_info_meta(buf);
+
+	meta->frame_counter = src->info_frame;
+	meta->binning = src->convertedImage.cols ? MAX(src->nWidth / src->convertedImage.cols, 1) : src->binning;
+	GST_OBJECT_LOCK(src);
+	meta->exposure = src->info_shutter_word >= 0 ? src->info_shutter.value : src->exposure;
+	meta->gain = src->info_gain_word >= 0 ? src->info_gain.value : src->gain;
+	meta->settling = src->info_shutter.pending || src->info_gain.pending;
+	GST_OBJECT_UNLOCK(src);
+}
+
 static void
 gst_flycap_set_camera_exposure (GstFlycapSrc * src, gboolean send)
 {  // How should the pipeline be told/respond to a change in frame rate - seems to be ok with a push source
@@ -500,8 +1038,8 @@ gst_flycap_set_camera_exposure (GstFlycapSrc * src, gboolean send)
 			gst_flycap_set_property_absVal(src, FC2_SHUTTER, src->exposure);
 			// Get the exposure value actually set back from the camera
 			gst_flycap_get_property_absVal(src, FC2_SHUTTER, &src->exposure);
-			// Update the duration to the actual value
-			src->duration = 1000000000.0/src->framerate;  // frame duration in ns
+			// Update the duration to the actual value, the camera may not go as fast as the exposure allows
+			gst_flycap_read_framerate(src);
 			GST_DEBUG_OBJECT(src, "Set duration %d us, and exposure to %.1f ms", (int)GST_TIME_AS_USECONDS(src->duration), src->exposure);
 		}
 	}
@@ -513,17 +1051,26 @@ gst_flycap_set_camera_exposure (GstFlycapSrc * src, gboolean send)
 			gst_flycap_set_property_absVal(src, FC2_FRAME_RATE, src->framerate);
 			gst_flycap_set_property_absVal(src, FC2_SHUTTER, src->exposure);
 			// Get the exposure value actually set back from the camera
-			gst_flycap_get_property_absVal(src, FC2_FRAME_RATE, &src->framerate);
 			gst_flycap_get_property_absVal(src, FC2_SHUTTER, &src->exposure);
 			// Update the duration to the actual value
-			src->duration = 1000000000.0/src->framerate;  // frame duration in ns
+			gst_flycap_read_framerate(src);
 			GST_DEBUG_OBJECT(src, "Set frame rate to %.1f, duration %d us, and exposure to %.1f ms", src->framerate, (int)GST_TIME_AS_USECONDS(src->duration), src->exposure);
 		}
 	}
 
+	if (send)
+		gst_flycap_embedded_info_expect(src, &src->info_shutter, FC2_SHUTTER, src->exposure);
+	else
+		src->frame_interval = src->duration;   // until the camera is asked
+
 	// adjust and turn on the output strobe 'flash' sync pulse direct from the camera
 //	setupStrobe(src);
 
+	if (send){
+		gst_flycap_update_grab_timeout(src);
+		gst_flycap_update_latency(src);
+	}
+
 	src->exposure_just_changed = TRUE;
 }
 
@@ -537,6 +1084,7 @@ gst_flycap_set_camera_gain (GstFlycapSrc * src)
 	val = (float)(20.0*log10(src->gain));
 	gst_flycap_set_property_absVal(src, FC2_GAIN, val);   // gain comes as linear factor
 //	GST_DEBUG_OBJECT (src, "gst_flycap_set_camera_gain src->gain: %d val: %f db", src->gain, val);
+	gst_flycap_embedded_info_expect(src, &src->info_gain, FC2_GAIN, src->gain);
 
 	src->gain_just_changed = TRUE;
 }
@@ -605,18 +1153,15 @@ get_image_size_for_camera_and_mode(GstFlycapSrc * src, fc2Mode mode, int *sensor
 static int
 gst_flycap_set_video_mode (GstFlycapSrc * src, fc2Mode mode)
 {
-    fc2Format7ImageSettings imageSettings;
+    fc2Format7ImageSettings imageSettings, requested;
 	fc2Format7PacketInfo packetInfo;
 	gboolean ok;
-	unsigned int packetSize;
-	float packetSizeAsPercentage;
+	unsigned int packetSize = 0;
+	float packetSizeAsPercentage = 0;
 	int sensor_w, sensor_h, w, h;
 
     // We will use camera binning mode but interpolate up to full sensor resolution so image size does not change for the rest of the pipeline.
 
-    if(src->acq_started == TRUE)
-		FLYCAPEXECANDCHECK(fc2StopCapture(src->deviceContext));
-
     get_image_size_for_camera_and_mode(src, mode, &sensor_w, &sensor_h, &w, &h);
 
     // Use the correct image size etc to set the mode of the camera
@@ -635,13 +1180,36 @@ gst_flycap_set_video_mode (GstFlycapSrc * src, fc2Mode mode)
 	fc2ValidateFormat7Settings(src->deviceContext, &imageSettings, &ok, &packetInfo);
 	GST_DEBUG_OBJECT (src, "fc2ValidateFormat7Settings for mode: %d - %s", imageSettings.mode, (ok?"OK":"BAD SETTINGS!"));
 
-	FLYCAPEXECANDCHECK(fc2SetFormat7ConfigurationPacket(src->deviceContext, &imageSettings, packetInfo.recommendedBytesPerPacket));
+	flycap_state_set_format7(&src->applied, &imageSettings, packetInfo.recommendedBytesPerPacket);
 
-	fc2GetFormat7Configuration(src->deviceContext, &imageSettings, &packetSize, &packetSizeAsPercentage);
-	GST_DEBUG_OBJECT (src, "2 fc2GetFormat7Configuration: mode %d offset %d %d size %d %d format %x packet size %d %f",
-			imageSettings.mode, imageSettings.offsetX, imageSettings.offsetY, imageSettings.width, imageSettings.height,
-			imageSettings.pixelFormat, packetSize, packetSizeAsPercentage);
+	// The camera is often still in this mode from the last run, leave it alone and skip the capture restart
+	requested = imageSettings;
+	if (fc2GetFormat7Configuration(src->deviceContext, &imageSettings, &packetSize, &packetSizeAsPercentage) != FC2_ERROR_OK
+			|| !flycap_state_format7_matches(&imageSettings, packetSize, &requested, packetInfo.recommendedBytesPerPacket)){
+		if(src->acq_started == TRUE)
+			FLYCAPEXECANDCHECK(fc2StopCapture(src->deviceContext));
 
+		imageSettings = requested;
+		FLYCAPEXECANDCHECK(fc2SetFormat7ConfigurationPacket(src->deviceContext, &imageSettings, packetInfo.recommendedBytesPerPacket));
+
+		fc2GetFormat7Configuration(src->deviceContext, &imageSettings, &packetSize, &packetSizeAsPercentage);
+
+		if(src->acq_started == TRUE)
+			FLYCAPEXECANDCHECK(fc2StartCapture(src->deviceContext));
+
+		if (src->starting)
+			src->startup_written++;
+	}
+	if (src->starting)
+		src->startup_checked++;
+	GST_DEBUG_OBJECT (src, "2 fc2GetFormat7Configuration: mode %d offset %d %d size %d %d format %x packet size %d %f",
+			imageSettings.mode, imageSettings.offsetX, imageSettings.offsetY, imageSettings.width, imageSettings.height,
+			imageSettings.pixelFormat, packetSize, packetSizeAsPercentage);
+
+	// Bandwidth we get at this packet size, for the latency
+	src->transfer_rate = gst_flycap_interface_bandwidth(src->camInfo.interfaceType);
+	if (packetSizeAsPercentage > 0)
+		src->transfer_rate *= packetSizeAsPercentage / 100.0;
 
 	// Record width and height etc. of the full sensor, and the image we expect from the camera
 	src->nWidth = sensor_w;
@@ -659,15 +1227,94 @@ gst_flycap_set_video_mode (GstFlycapSrc * src, fc2Mode mode)
 	src->nRawPitch = src->nRawWidth * src->nBytesPerPixel;
 	GST_DEBUG_OBJECT (src, "Image is %d x %d, pitch %d, bpp %d, Bpp %d", src->nWidth, src->nHeight, src->nPitch, src->nBitsPerPixel, src->nBytesPerPixel);
 
-	if(src->acq_started == TRUE)
-		FLYCAPEXECANDCHECK(fc2StartCapture(src->deviceContext));
-
 	return 0;
 
 	fail:
 		return -1;
 }
 
+#define SWAP_BOOLEANS(a, b) { gboolean tmp = (a); (a) = (b); (b) = tmp; }
+
+/* Choose the copy kernel specialisation for the current binning, pixel size and options */
+static void
+gst_flycap_select_kernel (GstFlycapSrc * src)
+{
+	FlycapKernelFunc kernel, preview;
+	guint ops = 0;
+	gboolean hflip = src->hflip && !src->hflip_in_camera;
+	gboolean vflip = src->vflip;
+
+	if (src->stats)
+		ops |= FLYCAP_KERNEL_OP_STATS;
+
+	// Flips are applied to the camera image, then it is rotated.
+	// The kernel flips after a transpose, so a 90 degree rotation is a transpose and a left-right flip.
+	switch (src->rotation){
+	case GST_ROTATION_90:
+		ops |= FLYCAP_KERNEL_OP_TRANSPOSE;
+		SWAP_BOOLEANS(hflip, vflip);
+		hflip = !hflip;
+		break;
+	case GST_ROTATION_180:
+		hflip = !hflip;
+		vflip = !vflip;
+		break;
+	case GST_ROTATION_270:
+		ops |= FLYCAP_KERNEL_OP_TRANSPOSE;
+		SWAP_BOOLEANS(hflip, vflip);
+		vflip = !vflip;
+		break;
+	case GST_ROTATION_0:
+	default:
+		break;
+	}
+
+	if (hflip)
+		ops |= FLYCAP_KERNEL_OP_HFLIP;
+	if (vflip)
+		ops |= FLYCAP_KERNEL_OP_VFLIP;
+
+	kernel = flycap_kernel_select(src->binning, src->nBytesPerPixel, ops);
+	// The preview is oriented the same, without statistics, see gst_flycap_preview_configure
+	preview = src->preview_kernel_binning ? flycap_kernel_select(src->preview_kernel_binning, src->nBytesPerPixel,
+			ops & ~FLYCAP_KERNEL_OP_STATS) : NULL;
+
+	// The stream thread may be copying a frame, it takes the kernel and its ops together
+	GST_OBJECT_LOCK(src);
+	src->copy_kernel = kernel;
+	src->kernel_ops = ops;
+	src->preview_kernel = preview;
+	GST_OBJECT_UNLOCK(src);
+}
+
+/* Use the camera mirror for hflip if it has one, anything else is done in the copy kernel */
+static void
+gst_flycap_set_camera_flip (GstFlycapSrc * src)
+{
+	unsigned int pValue, current;
+
+	src->hflip_in_camera = FALSE;
+
+	if (src->deviceContext){
+		FLYCAPEXECANDCHECK(fc2ReadRegister(src->deviceContext, MIRROR_IMAGE_CTRL, &pValue));
+		if (pValue & 0x80000000){   // presence
+			current = pValue;
+			if (src->hflip)
+				pValue |= 0x1;
+			else
+				pValue &= ~0x1;
+			flycap_state_set_register(&src->applied, MIRROR_IMAGE_CTRL, pValue);
+			if (pValue != current)
+				FLYCAPEXECANDCHECK(fc2WriteRegister(src->deviceContext, MIRROR_IMAGE_CTRL, pValue));
+			src->hflip_in_camera = src->hflip;
+		}
+		GST_DEBUG_OBJECT(src, "hflip %d in camera %d, vflip %d", src->hflip, src->hflip_in_camera, src->vflip);
+	}
+
+	fail:   // fall back to flipping in the copy
+	gst_flycap_select_kernel(src);
+}
+
 static void
 gst_flycap_set_camera_binning (GstFlycapSrc * src)
 {
@@ -685,6 +1332,9 @@ gst_flycap_set_camera_binning (GstFlycapSrc * src)
 		gst_flycap_set_video_mode (src, FC2_MODE_0);
 	}
 
+	gst_flycap_select_kernel(src);
+	gst_flycap_read_framerate(src);   // binned modes read out faster
+	gst_flycap_update_latency(src);
 	src->binning_just_changed = TRUE;
 }
 
@@ -729,43 +1379,25 @@ gst_flycap_get_camera_sharpness (GstFlycapSrc * src)
 static void gst_flycap_set_property_WB_manual(GstFlycapSrc * src)
 {
 	fc2Property prop;
-	prop.type = FC2_WHITE_BALANCE;
-
-	FLYCAPEXECANDCHECK(fc2GetProperty(src->deviceContext, &prop));
-
-	GST_DEBUG ("fc2GetProperty p %d op %d oo %d am %d", prop.present, prop.onePush, prop.onOff, prop.autoManualMode);
 
+	prop.type = FC2_WHITE_BALANCE;
 	prop.onOff = TRUE;
 	prop.autoManualMode = FALSE;
-	prop.onePush = FALSE;
 	prop.valueA = src->rgain; // Set the white balance red channel
 	prop.valueB = src->bgain; // Set the white balance blue channel
 	GST_DEBUG ("Using gst_flycap_set_property_WB_manual.");
-	FLYCAPEXECANDCHECK(fc2SetProperty(src->deviceContext, &prop));
-	return;
-
-	fail:
-	return;
+	gst_flycap_write_property(src, &prop, FLYCAP_FIELD_ON_OFF | FLYCAP_FIELD_AUTO | FLYCAP_FIELD_VALUE_A | FLYCAP_FIELD_VALUE_B);
 }
 
 static void gst_flycap_set_property_WB_auto(GstFlycapSrc * src)
 {
 	fc2Property prop;
-	prop.type = FC2_WHITE_BALANCE;
-
-	FLYCAPEXECANDCHECK(fc2GetProperty(src->deviceContext, &prop));
-
-	GST_DEBUG ("fc2GetProperty p %d op %d oo %d am %d", prop.present, prop.onePush, prop.onOff, prop.autoManualMode);
 
+	prop.type = FC2_WHITE_BALANCE;
 	prop.onOff = TRUE;
 	prop.autoManualMode = TRUE;
-	prop.onePush = FALSE;
 	GST_DEBUG ("Using gst_flycap_set_property_WB_auto.");
-	FLYCAPEXECANDCHECK(fc2SetProperty(src->deviceContext, &prop));
-	return;
-
-	fail:
-	return;
+	gst_flycap_write_property(src, &prop, FLYCAP_FIELD_ON_OFF | FLYCAP_FIELD_AUTO);
 }
 
 static void gst_flycap_set_property_WB_onepush(GstFlycapSrc * src)
@@ -777,6 +1409,7 @@ static void gst_flycap_set_property_WB_onepush(GstFlycapSrc * src)
 	GST_DEBUG ("Using gst_flycap_set_property_WB_oneshot.");
 
 	// Read to populate prop, and check current vales
+	flycap_property_cache_drop(&src->camera_props, FC2_WHITE_BALANCE);
 	FLYCAPEXECANDCHECK(fc2GetProperty(src->deviceContext, &prop));
 
 	GST_DEBUG ("fc2GetProperty p %d op %d oo %d am %d", prop.present, prop.onePush, prop.onOff, prop.autoManualMode);
@@ -787,6 +1420,7 @@ static void gst_flycap_set_property_WB_onepush(GstFlycapSrc * src)
 	prop.autoManualMode = FALSE;
 	prop.onePush = FALSE;
 	FLYCAPEXECANDCHECK(fc2SetProperty(src->deviceContext, &prop));
+	flycap_state_set_property(&src->applied, &prop, FLYCAP_FIELD_ON_OFF | FLYCAP_FIELD_AUTO | FLYCAP_FIELD_VALUE_A | FLYCAP_FIELD_VALUE_B);
 
 	// write to turn on one push
 	prop.type = FC2_WHITE_BALANCE;
@@ -813,8 +1447,10 @@ static gboolean gst_flycap_check_WB_onepush(GstFlycapSrc * src, unsigned int *rg
 
 	FLYCAPEXECANDCHECK(fc2GetProperty(src->deviceContext, &prop));
 
-	if (prop.onePush==FALSE)  // onepush has ended
+	if (prop.onePush==FALSE){  // onepush has ended, a reconnect should restore the balance it found
 		GST_DEBUG ("gst_flycap_check_WB_oneshot ended %d %d %d", prop.onePush, prop.valueA, prop.valueB);
+		flycap_state_set_property(&src->applied, &prop, FLYCAP_FIELD_ON_OFF | FLYCAP_FIELD_AUTO | FLYCAP_FIELD_VALUE_A | FLYCAP_FIELD_VALUE_B);
+	}
 
 	// If required return the final r and b gain values
 	if (rgain)
@@ -856,7 +1492,7 @@ gst_flycap_calculate_luts (GstFlycapSrc * src, gint lut_bank, gint channel)
 	// Setup an the luts, should be 9-bit input and output
 	// channel 0=red, 1=green, 2=blue
 
-	unsigned int i, lut[512];
+	unsigned int lut[512], current[512];
 	int    a, e;
 	double b, c, d, f;
 
@@ -874,20 +1510,21 @@ gst_flycap_calculate_luts (GstFlycapSrc * src, gint lut_bank, gint channel)
 
 	GST_DEBUG_OBJECT (src, "LUT bank %d gamma a=%d b=%f c=%f d=%f e=%d", lut_bank, a, b, c, d, e);
 
-	for (i=0;i<512;i++){
+	flycap_kernel_compute_lut(lut, a, b, c, d, e, f);
 
-		double x = (double)(i-a) / 511.0      ;  // value along 0-1 input axis
+	// Set bank's RGB channels
+	flycap_state_set_lut(&src->applied, lut_bank, channel, lut);
+	if (!src->deviceContext)
+		return;
 
-		if (i<a)
-			lut[i]=0;
-		else if ((i-a) <= e)   // e linear section according to Rec. 709 standard
-			lut[i] = (unsigned int)MIN(d*(i-a), 511);
-		else
-			lut[i] = (unsigned int)MIN((c*(pow(x, b))-f)*511, 511);
-//		GST_DEBUG_OBJECT (src, "bank %d %d %d", lut_bank, i, lut[i]);
+	// A camera that has not been power cycled still has the table from the last run
+	if (src->starting){
+		src->startup_checked++;
+		if (fc2GetLUTChannel(src->deviceContext, lut_bank, channel, 512, current) == FC2_ERROR_OK
+				&& memcmp(current, lut, sizeof(lut)) == 0)
+			return;
+		src->startup_written++;
 	}
-
-	// Set bank's RGB channels
 	FLYCAPEXECANDCHECK(fc2SetLUTChannel(src->deviceContext, lut_bank, channel, 512, lut));
 
 	fail:
@@ -895,6 +1532,17 @@ gst_flycap_calculate_luts (GstFlycapSrc * src, gint lut_bank, gint channel)
 
 }
 
+/* A bank's tables are only sent once the bank is used, or when its settings change */
+static void
+gst_flycap_send_lut_bank (GstFlycapSrc * src, gint lut_bank)
+{
+	gint channel;
+
+	for (channel = 0; channel < 3; channel++)
+		if (!(src->applied.lut_set & (1 << (lut_bank * 3 + channel))))
+			gst_flycap_calculate_luts(src, lut_bank, channel);
+}
+
 static void
 gst_flycap_set_camera_lut (GstFlycapSrc * src)
 {
@@ -904,49 +1552,1149 @@ gst_flycap_set_camera_lut (GstFlycapSrc * src)
 	switch (src->lut){
 	case GST_LUT_OFF:
 		GST_DEBUG_OBJECT (src, "GST_LUT_OFF");
+		flycap_state_set_lut_bank(&src->applied, FALSE, 0);
 		FLYCAPEXECANDCHECK(fc2EnableLUT(src->deviceContext, FALSE));
-		gst_flycap_set_property_off(src->deviceContext, FC2_GAMMA);
+		gst_flycap_set_property_off(src, FC2_GAMMA);
 		break;
 	case GST_LUT_1:
 		GST_DEBUG_OBJECT (src, "GST_LUT_1");
+		gst_flycap_send_lut_bank(src, 0);
+		flycap_state_set_lut_bank(&src->applied, TRUE, 0);
 		FLYCAPEXECANDCHECK(fc2EnableLUT(src->deviceContext, TRUE));
 		FLYCAPEXECANDCHECK(fc2SetActiveLUTBank(src->deviceContext, 0));  // use lut bank 0
 	break;
 	case GST_LUT_2:
 		GST_DEBUG_OBJECT (src, "GST_LUT_2");
+		gst_flycap_send_lut_bank(src, 1);
+		flycap_state_set_lut_bank(&src->applied, TRUE, 1);
 		FLYCAPEXECANDCHECK(fc2EnableLUT(src->deviceContext, TRUE));
 		FLYCAPEXECANDCHECK(fc2SetActiveLUTBank(src->deviceContext, 1));  // use lut bank 1
 		break;
 	case GST_LUT_GAMMA:
 		GST_DEBUG_OBJECT (src, "GST_LUT_GAMMA %f", src->gamma);
 //		FLYCAPEXECANDCHECK(fc2EnableLUT(src->deviceContext, FALSE));
-		gst_flycap_set_property_absVal(src->deviceContext, FC2_GAMMA, src->gamma);
+		gst_flycap_set_property_absVal(src, FC2_GAMMA, src->gamma);
 		GST_DEBUG_OBJECT (src, "GST_LUT_GAMMA ok");
 		break;
 	default:
 		GST_DEBUG_OBJECT (src, "GST_LUT_???");
+		flycap_state_set_lut_bank(&src->applied, FALSE, 0);
 		FLYCAPEXECANDCHECK(fc2EnableLUT(src->deviceContext, FALSE));
-		gst_flycap_set_property_off(src->deviceContext, FC2_GAMMA);
+		gst_flycap_set_property_off(src, FC2_GAMMA);
 		break;
 	}
 
 	fail:
-	return;
+	return;
+}
+
+static void
+gst_flycap_get_camera_lut (GstFlycapSrc * src)
+{
+	unsigned int val;
+	fc2GetActiveLUTBank(src->deviceContext, &val);
+
+	// Decode the value, really not sure how we can determine if LUT is off or in gamma mode.
+	if (val==0)
+		src->lut = GST_LUT_1;
+	else if (val==1)
+		src->lut = GST_LUT_2;
+	else
+		src->lut = GST_LUT_OFF;
+}
+
+/* Host side auto exposure, drive the chosen percentile of the luminance histogram
+ * towards the target level using the shutter first and then the gain.
+ */
+static void
+gst_flycap_host_ae_update (GstFlycapSrc * src)
+{
+	guint32 hist[256];
+	guint n, count, threshold, level;
+	gint64 now;
+	gdouble ratio, desired, exposure;
+	gint gain;
+
+	// Give the last change time to appear in the image, and do not chatter on the bus
+	if (src->host_ae_settle > 0){
+		src->host_ae_settle--;
+		return;
+	}
+	now = g_get_monotonic_time();
+	if (now - src->host_ae_last_write < (gint64)src->host_ae_interval * 1000)
+		return;
+
+	n = flycap_kernel_luma_histogram(src->convertedImage.pData, src->nRawPitch, src->nRawWidth, src->nRawHeight,
+			src->nBytesPerPixel, HOST_AE_SUBSAMPLE, hist);
+	if (n == 0)
+		return;
+
+	// Nearest rank, the first level with that many samples at or below it, 100 is the brightest sample
+	threshold = CLAMP((guint)ceil(n * src->host_ae_percentile / 100.0), 1, n);
+	for (level = 0, count = 0; level < 255; level++) {
+		count += hist[level];
+		if (count >= threshold)
+			break;
+	}
+
+	if (level >= 254)   // clipped, we do not know how bright it really is, so step down hard
+		ratio = 0.5;
+	else
+		ratio = (gdouble)src->host_ae_target / MAX(level, 1);
+	ratio = CLAMP(ratio, 0.25, 4.0);
+
+	if (fabs(ratio - 1.0) < HOST_AE_DEADBAND)
+		return;
+
+	// Total 'exposure' we want, use shutter up to the limit, then integer gain
+	desired = src->exposure * src->gain * ratio;
+	gain = 1;
+	if (desired > src->host_ae_max_exposure)
+		gain = (gint)ceil(desired / src->host_ae_max_exposure);
+	gain = CLAMP(gain, 1, 16);
+	exposure = CLAMP(desired / gain, 0.01, src->host_ae_max_exposure);
+
+	GST_LOG_OBJECT(src, "host AE: level %d target %d ratio %.2f -> exposure %.2f ms gain %d",
+			level, src->host_ae_target, ratio, exposure, gain);
+
+	if (fabs(exposure - src->exposure) > HOST_AE_DEADBAND * src->exposure){
+		src->exposure = exposure;
+		gst_flycap_set_camera_exposure(src, FLYCAP_UPDATE_CAMERA);
+	}
+	if (gain != src->gain){
+		src->gain = gain;
+		gst_flycap_set_camera_gain(src);
+	}
+
+	src->host_ae_last_write = now;
+	src->host_ae_settle = HOST_AE_SETTLE_FRAMES;
+}
+
+/* Per stage timing. The histograms are filled in the streaming thread and read from
+ * get_property, so they are protected by the object lock.
+ */
+static void
+gst_flycap_latency_reset (GstFlycapSrc * src)
+{
+	guint i;
+
+	GST_OBJECT_LOCK(src);
+	for (i = 0; i < FLYCAP_STAGE_N; i++)
+		if (i != FLYCAP_STAGE_RETRIEVE && i != FLYCAP_STAGE_COPY)   // also the health counters', see gst_flycap_health_reset
+			flycap_latency_histogram_reset(&src->latency_hist[i]);
+	src->latency_window_start = GST_CLOCK_TIME_NONE;
+	src->last_create_exit = GST_CLOCK_TIME_NONE;
+	GST_OBJECT_UNLOCK(src);
+}
+
+// Call with the object lock held
+static GstStructure *
+gst_flycap_latency_to_structure (GstFlycapSrc * src, GstClockTime now)
+{
+	GstStructure *s;
+	guint i;
+
+	s = gst_structure_new(FLYCAP_LATENCY_STRUCTURE_NAME,
+			"interval", G_TYPE_UINT64, GST_CLOCK_TIME_IS_VALID(src->latency_window_start) ? now - src->latency_window_start : G_GUINT64_CONSTANT(0),
+			NULL);
+	for (i = 0; i < FLYCAP_STAGE_N; i++)
+		flycap_latency_histogram_to_structure(&src->latency_hist[i], s, flycap_latency_stage_name(i));
+
+	return s;
+}
+
+static GstStructure *
+gst_flycap_latency_get_stats (GstFlycapSrc * src)
+{
+	GstStructure *s;
+
+	GST_OBJECT_LOCK(src);
+	if (src->latency_interval > 0 && src->latency_last)
+		s = gst_structure_copy(src->latency_last);
+	else
+		s = gst_flycap_latency_to_structure(src, gst_util_get_timestamp());
+	GST_OBJECT_UNLOCK(src);
+
+	return s;
+}
+
+/* Add the timings of one frame, taken in create, and post the histograms every latency-interval */
+static void
+gst_flycap_latency_update (GstFlycapSrc * src, GstClockTime t_enter, GstClockTime t_retrieved, GstClockTime t_copied)
+{
+	GstClockTime now = gst_util_get_timestamp();
+	GstStructure *s = NULL;
+	guint i;
+
+	GST_OBJECT_LOCK(src);
+
+	// retrieve and copy are added by gst_flycap_health_update
+	flycap_latency_histogram_add(&src->latency_hist[FLYCAP_STAGE_CREATE], now - t_enter);
+	if (GST_CLOCK_TIME_IS_VALID(src->last_create_exit))
+		flycap_latency_histogram_add(&src->latency_hist[FLYCAP_STAGE_DOWNSTREAM], t_enter - src->last_create_exit);
+	src->last_create_exit = now;
+
+	if (!GST_CLOCK_TIME_IS_VALID(src->latency_window_start))
+		src->latency_window_start = t_enter;
+
+	if (src->latency_interval > 0 && now - src->latency_window_start >= (GstClockTime)src->latency_interval * GST_MSECOND){
+		s = gst_flycap_latency_to_structure(src, now);
+		if (src->latency_last)
+			gst_structure_free(src->latency_last);
+		src->latency_last = gst_structure_copy(s);
+
+		// With a health-interval, retrieve and copy go by the health window
+		for (i = 0; i < FLYCAP_STAGE_N; i++)
+			if (src->health_interval <= 0 || (i != FLYCAP_STAGE_RETRIEVE && i != FLYCAP_STAGE_COPY))
+				flycap_latency_histogram_reset(&src->latency_hist[i]);
+		src->latency_window_start = now;
+	}
+
+	GST_OBJECT_UNLOCK(src);
+
+	if (s)
+		gst_element_post_message(GST_ELEMENT(src), gst_message_new_element(GST_OBJECT(src), s));
+}
+
+/* Throughput and health. Counters run from the start, the fps and the copy and retrieve
+ * percentiles are over a window of health-interval ms, or from the start if that is 0.
+ */
+static void
+gst_flycap_health_reset (GstFlycapSrc * src)
+{
+	GST_OBJECT_LOCK(src);
+	src->frames_retrieved = 0;
+	src->frames_delivered = 0;
+	src->retrieve_errors = 0;
+	src->consistency_errors = 0;
+	src->total_timeouts = 0;
+	src->reconnects = 0;
+	src->reconnect_time = 0;
+	src->reconnect_writes = 0;
+	memset(&src->camera_stats, 0, sizeof(src->camera_stats));
+	flycap_latency_histogram_reset(&src->latency_hist[FLYCAP_STAGE_RETRIEVE]);
+	flycap_latency_histogram_reset(&src->latency_hist[FLYCAP_STAGE_COPY]);
+	src->health_window_start = GST_CLOCK_TIME_NONE;
+	src->health_window_frames = 0;
+	src->fps = 0.0;
+	GST_OBJECT_UNLOCK(src);
+}
+
+// fc2GetStats reads camera registers, so it is done once per window and never under the object lock
+static void
+gst_flycap_health_read_camera_stats (GstFlycapSrc * src)
+{
+	fc2CameraStats stats;
+
+	if (!src->deviceContext)
+		return;
+
+	FLYCAPEXECANDCHECK(fc2GetStats(src->deviceContext, &stats));
+
+	GST_OBJECT_LOCK(src);
+	src->camera_stats = stats;
+	GST_OBJECT_UNLOCK(src);
+
+	fail:
+	return;
+}
+
+// Call with the object lock held
+static void
+gst_flycap_health_update_fps (GstFlycapSrc * src, GstClockTime now)
+{
+	if (GST_CLOCK_TIME_IS_VALID(src->health_window_start) && now > src->health_window_start)
+		src->fps = (gdouble)src->health_window_frames * GST_SECOND / (now - src->health_window_start);
+}
+
+// Call with the object lock held
+static GstStructure *
+gst_flycap_health_to_structure (GstFlycapSrc * src, GstClockTime now)
+{
+	GstStructure *s;
+
+	gst_flycap_health_update_fps(src, now);
+
+	s = gst_structure_new("flycap-health",
+			"fps", G_TYPE_DOUBLE, src->fps,
+			"frames-retrieved", G_TYPE_UINT64, src->frames_retrieved,
+			"frames-delivered", G_TYPE_UINT64, src->frames_delivered,
+			"retrieve-errors", G_TYPE_UINT64, src->retrieve_errors,
+			"consistency-errors", G_TYPE_UINT64, src->consistency_errors,
+			"timeouts", G_TYPE_UINT64, src->total_timeouts,
+			"reconnects", G_TYPE_UINT64, src->reconnects,
+			"reconnect-time", G_TYPE_UINT64, src->reconnect_time,
+			"reconnect-writes", G_TYPE_UINT, src->reconnect_writes,
+			"sdk-dropped", G_TYPE_UINT64, (guint64)src->camera_stats.imageDropped,
+			"sdk-driver-dropped", G_TYPE_UINT64, (guint64)src->camera_stats.imageDriverDropped,
+			"sdk-corrupt", G_TYPE_UINT64, (guint64)src->camera_stats.imageCorrupt,
+			"sdk-xmit-failed", G_TYPE_UINT64, (guint64)src->camera_stats.imageXmitFailed,
+			"sdk-port-errors", G_TYPE_UINT64, (guint64)src->camera_stats.portErrors,
+			"sdk-resends-requested", G_TYPE_UINT64, (guint64)src->camera_stats.numResendPacketsRequested,
+			NULL);
+	flycap_latency_histogram_to_structure(&src->latency_hist[FLYCAP_STAGE_RETRIEVE], s, flycap_latency_stage_name(FLYCAP_STAGE_RETRIEVE));
+	flycap_latency_histogram_to_structure(&src->latency_hist[FLYCAP_STAGE_COPY], s, flycap_latency_stage_name(FLYCAP_STAGE_COPY));
+
+	return s;
+}
+
+// Without a health-interval nothing is updated in the background, so read the camera now
+static void
+gst_flycap_health_refresh (GstFlycapSrc * src)
+{
+	if (src->health_interval > 0)
+		return;
+
+	gst_flycap_health_read_camera_stats(src);
+	GST_OBJECT_LOCK(src);
+	gst_flycap_health_update_fps(src, gst_util_get_timestamp());
+	GST_OBJECT_UNLOCK(src);
+}
+
+static GstStructure *
+gst_flycap_health_get (GstFlycapSrc * src)
+{
+	GstStructure *s;
+
+	if (src->health_interval <= 0)
+		gst_flycap_health_read_camera_stats(src);
+
+	GST_OBJECT_LOCK(src);
+	if (src->health_interval > 0 && src->health_last)
+		s = gst_structure_copy(src->health_last);
+	else
+		s = gst_flycap_health_to_structure(src, gst_util_get_timestamp());
+	GST_OBJECT_UNLOCK(src);
+
+	return s;
+}
+
+/* Count a delivered frame, and post the flycap-health message every health-interval */
+static void
+gst_flycap_health_update (GstFlycapSrc * src, GstClockTime t_enter, GstClockTime t_retrieved, GstClockTime t_copied)
+{
+	GstStructure *s = NULL;
+	gboolean due;
+
+	GST_OBJECT_LOCK(src);
+	src->frames_delivered++;
+	src->health_window_frames++;
+	flycap_latency_histogram_add(&src->latency_hist[FLYCAP_STAGE_RETRIEVE], t_retrieved - t_enter);
+	flycap_latency_histogram_add(&src->latency_hist[FLYCAP_STAGE_COPY], t_copied - t_retrieved);
+	if (!GST_CLOCK_TIME_IS_VALID(src->health_window_start))
+		src->health_window_start = t_enter;
+	due = src->health_interval > 0 && t_copied - src->health_window_start >= (GstClockTime)src->health_interval * GST_MSECOND;
+	GST_OBJECT_UNLOCK(src);
+
+	if (!due)
+		return;
+
+	gst_flycap_health_read_camera_stats(src);
+
+	GST_OBJECT_LOCK(src);
+	s = gst_flycap_health_to_structure(src, t_copied);
+	if (src->health_last)
+		gst_structure_free(src->health_last);
+	src->health_last = gst_structure_copy(s);
+
+	flycap_latency_histogram_reset(&src->latency_hist[FLYCAP_STAGE_RETRIEVE]);
+	flycap_latency_histogram_reset(&src->latency_hist[FLYCAP_STAGE_COPY]);
+	src->health_window_start = t_copied;
+	src->health_window_frames = 0;
+	GST_OBJECT_UNLOCK(src);
+
+	gst_element_post_message(GST_ELEMENT(src), gst_message_new_element(GST_OBJECT(src), s));
+}
+
+// create loops over several camera frames when holding or averaging, it must still stop for unlock
+static gboolean
+gst_flycap_is_flushing (GstFlycapSrc * src)
+{
+	gboolean flushing;
+
+	GST_OBJECT_LOCK(src);
+	flushing = src->flushing;
+	GST_OBJECT_UNLOCK(src);
+
+	return flushing;
+}
+
+/* Frame averaging. Camera images are summed, then every accumulate frames the average goes on
+ * to the copy kernel in place of the camera image, so binning, flips, rotation and statistics
+ * apply as usual and downstream gets one buffer per average. Returns TRUE when one is ready.
+ */
+static gboolean
+gst_flycap_accumulate (GstFlycapSrc * src)
+{
+	guint row_bytes = src->nRawWidth * src->nBytesPerPixel;
+	gsize size = (gsize)row_bytes * src->nRawHeight;
+
+	// The camera image changes size with the binning, start again
+	if (size != src->acc_size){
+		g_free(src->acc);
+		g_free(src->acc_image);
+		src->acc = g_new(guint16, size);
+		src->acc_image = g_malloc(size);
+		src->acc_size = size;
+		src->acc_count = 0;
+	}
+
+	flycap_kernel_accumulate(src->acc, src->convertedImage.pData, src->nRawPitch, row_bytes, src->nRawHeight, src->acc_count == 0);
+	if (++src->acc_count < src->accumulate)
+		return FALSE;
+
+	flycap_kernel_average(src->acc_image, row_bytes, src->acc, row_bytes, src->nRawHeight, src->acc_count);
+	src->acc_count = 0;
+	return TRUE;
+}
+
+/* Preview pad. A request pad with the same frames at preview-scale of the sensor size, made from the
+ * camera image after averaging and correction. When the scale is larger than the binning the camera
+ * image is box filtered down first, otherwise the copy kernel expands it as it does for the main
+ * buffer, so with equal scale and binning the camera image is copied as it is. Flips and rotation
+ * are done by the copy kernel, as for the main buffer.
+ */
+static void
+gst_flycap_preview_configure (GstFlycapSrc * src)
+{
+	GstVideoInfo info;
+	GstCaps *caps;
+	guint scale = src->preview_scale;
+
+	if (scale >= (guint)src->binning){
+		src->preview_factor = scale / src->binning;
+		src->preview_kernel_binning = 1;
+	}
+	else {
+		src->preview_factor = 1;
+		src->preview_kernel_binning = src->binning / scale;
+	}
+	gst_flycap_select_kernel(src);   // the preview kernel goes with the main one
+
+	// Made again at the new size when a preview is pushed
+	g_free(src->preview_image);
+	g_free(src->preview_row);
+	src->preview_image = NULL;
+	src->preview_row = NULL;
+
+	gst_video_info_init(&info);
+	gst_video_info_set_format(&info, DEFAULT_GST_VIDEO_FORMAT, MAX(src->out_width / scale, 1), MAX(src->out_height / scale, 1));
+	src->preview_width = GST_VIDEO_INFO_WIDTH(&info);
+	src->preview_height = GST_VIDEO_INFO_HEIGHT(&info);
+	src->preview_stride = GST_VIDEO_INFO_COMP_STRIDE(&info, 0);
+	caps = gst_video_info_to_caps(&info);
+
+	GST_OBJECT_LOCK(src);
+	if (src->preview_caps)
+		gst_caps_unref(src->preview_caps);
+	src->preview_caps = caps;
+	src->preview_caps_sent = FALSE;
+	GST_OBJECT_UNLOCK(src);
+
+	GST_DEBUG_OBJECT(src, "preview %ux%u, box filter %u, kernel binning %u", src->preview_width, src->preview_height,
+			src->preview_factor, src->preview_kernel_binning);
+}
+
+// Stream start, caps and segment, before the first preview and again after a flush
+static void
+gst_flycap_preview_send_events (GstFlycapSrc * src, GstPad * pad)
+{
+	GstSegment segment;
+	GstCaps *caps;
+	gchar *stream_id;
+
+	if (!src->preview_started){
+		stream_id = gst_pad_create_stream_id(pad, GST_ELEMENT(src), "preview");
+		gst_pad_push_event(pad, gst_event_new_stream_start(stream_id));
+		g_free(stream_id);
+		src->preview_started = TRUE;
+	}
+
+	GST_OBJECT_LOCK(src);
+	caps = gst_caps_ref(src->preview_caps);
+	src->preview_caps_sent = TRUE;
+	GST_OBJECT_UNLOCK(src);
+	gst_pad_push_event(pad, gst_event_new_caps(caps));
+	gst_caps_unref(caps);
+
+	// Live, so buffers are in running time as on the main pad
+	gst_segment_init(&segment, GST_FORMAT_TIME);
+	gst_pad_push_event(pad, gst_event_new_segment(&segment));
+}
+
+static void
+gst_flycap_preview_push (GstFlycapSrc * src, const guint8 * image, guint image_stride, GstBuffer * main_buf)
+{
+	FlycapKernelFrame frame;
+	FlycapKernelFunc kernel;
+	GstMapInfo minfo;
+	GstBuffer *buf;
+	GstClock *clock;
+	GstClockTime now;
+	GstBuffer *old;
+	GstPad *pad = NULL;
+	guint bpp = src->nBytesPerPixel;
+
+	GST_OBJECT_LOCK(src);
+	if (src->preview_pad && src->preview_caps)
+		pad = gst_object_ref(src->preview_pad);
+	GST_OBJECT_UNLOCK(src);
+	if (!pad)
+		return;
+	if (!gst_pad_is_linked(pad))
+		goto done;
+
+	now = gst_util_get_timestamp();
+	if (src->preview_framerate > 0.0 && GST_CLOCK_TIME_IS_VALID(src->preview_last)
+			&& now - src->preview_last < (GstClockTime)(GST_SECOND / src->preview_framerate))
+		goto done;
+	src->preview_last = now;
+
+	frame.src = image;
+	frame.src_stride = image_stride;
+	frame.src_width = src->nRawWidth;
+	frame.src_height = src->nRawHeight;
+	if (src->preview_factor > 1){
+		frame.src_width /= src->preview_factor;
+		frame.src_height /= src->preview_factor;
+		frame.src_stride = frame.src_width * bpp;
+		if (!src->preview_image){
+			src->preview_image = g_malloc((gsize)frame.src_stride * frame.src_height);
+			src->preview_row = g_new(guint16, src->nRawWidth * bpp);
+		}
+		flycap_kernel_box_downscale(src->preview_image, frame.src_stride, image, image_stride,
+				src->nRawWidth, src->nRawHeight, bpp, src->preview_factor, src->preview_row);
+		frame.src = src->preview_image;
+	}
+
+	buf = gst_buffer_new_and_alloc(src->preview_stride * src->preview_height);
+	gst_buffer_map(buf, &minfo, GST_MAP_WRITE);
+	frame.dst = minfo.data;
+	frame.dst_stride = src->preview_stride;
+	frame.dst_width = src->preview_width;
+	frame.dst_height = src->preview_height;
+	frame.bytes_per_pixel = bpp;
+	frame.hist = NULL;
+	GST_OBJECT_LOCK(src);
+	kernel = src->preview_kernel;
+	GST_OBJECT_UNLOCK(src);
+	kernel(&frame);
+	gst_buffer_unmap(buf, &minfo);
+
+	// The main buffer's times, basesrc has not stamped it yet if it is doing the timestamps
+	GST_BUFFER_PTS(buf) = GST_BUFFER_PTS(main_buf);
+	if (!GST_BUFFER_PTS_IS_VALID(buf) && (clock = gst_element_get_clock(GST_ELEMENT(src)))){
+		GST_BUFFER_PTS(buf) = gst_clock_get_time(clock) - gst_element_get_base_time(GST_ELEMENT(src));
+		gst_object_unref(clock);
+	}
+	GST_BUFFER_DTS(buf) = GST_BUFFER_PTS(buf);
+	GST_BUFFER_OFFSET(buf) = GST_BUFFER_OFFSET(main_buf);
+
+	// The preview task pushes it, one not yet pushed is dropped for the newer one
+	GST_OBJECT_LOCK(src);
+	old = src->preview_pending;
+	src->preview_pending = buf;
+	g_cond_broadcast(&src->preview_cond);
+	GST_OBJECT_UNLOCK(src);
+	if (old){
+		GST_LOG_OBJECT(src, "preview branch busy, dropped a preview");
+		gst_buffer_unref(old);
+	}
+
+	done:
+	gst_object_unref(pad);
+}
+
+/* The preview pad's own task, so a slow, clock synced or blocked preview branch never holds up
+ * the main stream. It waits for the buffer create leaves, with the pad's stream lock held, so
+ * flushes pause it first.
+ */
+static void
+gst_flycap_preview_loop (GstPad * pad)
+{
+	GstFlycapSrc *src = GST_FLYCAP_SRC (GST_PAD_PARENT(pad));
+	GstBuffer *buf;
+	GstFlowReturn ret;
+
+	GST_OBJECT_LOCK(src);
+	while (!src->preview_pending && !src->preview_eos && !src->preview_flushing)
+		g_cond_wait(&src->preview_cond, GST_OBJECT_GET_LOCK(src));
+	// Paused under the lock, so a flush stop that restarts the task cannot come in between
+	if (src->preview_flushing){
+		gst_pad_pause_task(pad);
+		GST_OBJECT_UNLOCK(src);
+		return;
+	}
+	buf = src->preview_pending;
+	src->preview_pending = NULL;
+	GST_OBJECT_UNLOCK(src);
+
+	if (!buf){
+		gst_pad_push_event(pad, gst_event_new_eos());
+		GST_OBJECT_LOCK(src);
+		if (src->preview_eos)
+			gst_pad_pause_task(pad);
+		GST_OBJECT_UNLOCK(src);
+		return;
+	}
+
+	if (!src->preview_caps_sent)
+		gst_flycap_preview_send_events(src, pad);
+
+	ret = gst_pad_push(pad, buf);
+	if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED && ret != GST_FLOW_FLUSHING)
+		GST_WARNING_OBJECT(src, "preview push returned %s", gst_flow_get_name(ret));
+}
+
+static gboolean
+gst_flycap_preview_activate_mode (GstPad * pad, GstObject * parent, GstPadMode mode, gboolean active)
+{
+	GstFlycapSrc *src = GST_FLYCAP_SRC (parent);
+
+	if (mode != GST_PAD_MODE_PUSH)
+		return FALSE;
+
+	GST_OBJECT_LOCK(src);
+	src->preview_flushing = !active;
+	src->preview_eos = FALSE;
+	src->preview_started = FALSE;   // deactivating drops the sticky events
+	src->preview_caps_sent = FALSE;
+	gst_buffer_replace(&src->preview_pending, NULL);
+	g_cond_broadcast(&src->preview_cond);
+	GST_OBJECT_UNLOCK(src);
+
+	if (active)
+		return gst_pad_start_task(pad, (GstTaskFunction) gst_flycap_preview_loop, pad, NULL);
+
+	return gst_pad_stop_task(pad);
+}
+
+// basesrc only knows its own pad, pass EOS and flushes on to the preview
+static GstPadProbeReturn
+gst_flycap_preview_forward_event (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+	GstFlycapSrc *src = GST_FLYCAP_SRC (user_data);
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+	GstPad *preview = NULL;
+
+	switch (GST_EVENT_TYPE(event)){
+	case GST_EVENT_EOS:
+		// After any preview still waiting, the task has the pad's stream lock
+		GST_OBJECT_LOCK(src);
+		src->preview_eos = TRUE;
+		g_cond_broadcast(&src->preview_cond);
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case GST_EVENT_FLUSH_START:
+		GST_OBJECT_LOCK(src);
+		if (src->preview_pad)
+			preview = gst_object_ref(src->preview_pad);
+		src->preview_flushing = TRUE;
+		gst_buffer_replace(&src->preview_pending, NULL);
+		g_cond_broadcast(&src->preview_cond);
+		GST_OBJECT_UNLOCK(src);
+		if (preview){
+			gst_pad_push_event(preview, gst_event_ref(event));   // unblocks a push in progress
+			gst_object_unref(preview);
+		}
+		break;
+	case GST_EVENT_FLUSH_STOP:
+		GST_OBJECT_LOCK(src);
+		if (src->preview_pad)
+			preview = gst_object_ref(src->preview_pad);
+		src->preview_caps_sent = FALSE;   // the segment goes with a flush
+		src->preview_flushing = FALSE;
+		src->preview_eos = FALSE;
+		GST_OBJECT_UNLOCK(src);
+		if (preview){
+			gst_pad_push_event(preview, gst_event_ref(event));   // once the task has paused
+			if (gst_pad_is_active(preview))
+				gst_pad_start_task(preview, (GstTaskFunction) gst_flycap_preview_loop, preview, NULL);
+			gst_object_unref(preview);
+		}
+		break;
+	default:
+		break;
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+gst_flycap_preview_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+	GstFlycapSrc *src = GST_FLYCAP_SRC (parent);
+	GstCaps *caps, *filter, *result;
+
+	switch (GST_QUERY_TYPE(query)){
+	case GST_QUERY_CAPS:
+		GST_OBJECT_LOCK(src);
+		caps = src->preview_caps ? gst_caps_ref(src->preview_caps) : gst_pad_get_pad_template_caps(pad);
+		GST_OBJECT_UNLOCK(src);
+		gst_query_parse_caps(query, &filter);
+		if (filter){
+			result = gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+			gst_caps_unref(caps);
+			caps = result;
+		}
+		gst_query_set_caps_result(query, caps);
+		gst_caps_unref(caps);
+		return TRUE;
+	case GST_QUERY_LATENCY:
+		gst_query_set_latency(query, TRUE, GST_CLOCK_TIME_IS_VALID(src->min_latency) ? src->min_latency : 0, src->max_latency);
+		return TRUE;
+	default:
+		return gst_pad_query_default(pad, parent, query);
+	}
+}
+
+static GstPad *
+gst_flycap_src_request_new_pad (GstElement * element, GstPadTemplate * templ,
+		const gchar * name, const GstCaps * caps)
+{
+	GstFlycapSrc *src = GST_FLYCAP_SRC (element);
+	GstPad *pad;
+
+	GST_OBJECT_LOCK(src);
+	pad = src->preview_pad;
+	GST_OBJECT_UNLOCK(src);
+	if (pad){
+		GST_WARNING_OBJECT(src, "there is already a preview pad");
+		return NULL;
+	}
+
+	pad = gst_pad_new_from_template(templ, "preview");
+	gst_pad_set_query_function(pad, GST_DEBUG_FUNCPTR (gst_flycap_preview_query));
+	gst_pad_set_activatemode_function(pad, GST_DEBUG_FUNCPTR (gst_flycap_preview_activate_mode));
+	gst_pad_use_fixed_caps(pad);
+
+	GST_OBJECT_LOCK(src);
+	src->preview_pad = pad;
+	src->preview_started = FALSE;
+	src->preview_caps_sent = FALSE;
+	src->preview_last = GST_CLOCK_TIME_NONE;
+	GST_OBJECT_UNLOCK(src);
+
+	src->preview_probe = gst_pad_add_probe(GST_BASE_SRC_PAD(src), GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+			gst_flycap_preview_forward_event, src, NULL);
+	// Activated once it has its parent, the task needs the element
+	gst_element_add_pad(element, pad);
+	if (GST_STATE(element) > GST_STATE_READY)
+		gst_pad_set_active(pad, TRUE);
+
+	return pad;
+}
+
+static void
+gst_flycap_src_release_pad (GstElement * element, GstPad * pad)
+{
+	GstFlycapSrc *src = GST_FLYCAP_SRC (element);
+
+	GST_OBJECT_LOCK(src);
+	if (pad != src->preview_pad){
+		GST_OBJECT_UNLOCK(src);
+		return;
+	}
+	src->preview_pad = NULL;
+	GST_OBJECT_UNLOCK(src);
+
+	gst_pad_remove_probe(GST_BASE_SRC_PAD(src), src->preview_probe);
+	src->preview_probe = 0;
+	gst_pad_set_active(pad, FALSE);
+	gst_element_remove_pad(element, pad);
+}
+
+/* Dark and flat field correction. The capture signals average the next calibration-frames camera
+ * images into a reference, which is saved for the camera's serial number and binning and loaded
+ * again when the caps are set. References are applied in place to the camera image, or to the
+ * average, just before the copy, so every copy kernel works on the corrected image. Hot pixels
+ * found in the dark are then replaced by their neighbours.
+ */
+static const gchar *calibration_type_names[FLYCAP_CALIBRATION_N] = { "dark", "flat" };
+
+static void
+gst_flycap_calibration_load (GstFlycapSrc * src)
+{
+	FlycapCalibrationType type;
+	GError *err = NULL;
+	gchar *filename;
+
+	flycap_calibration_clear(&src->calib);
+
+	for (type = 0; type < FLYCAP_CALIBRATION_N; type++){
+		filename = flycap_calibration_filename(src->calibration_dir, src->camInfo.serialNumber, src->binning, type);
+		if (flycap_calibration_load(&src->calib, type, filename, &err))
+			GST_INFO_OBJECT(src, "loaded %s reference %s", calibration_type_names[type], filename);
+		else if (g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			GST_DEBUG_OBJECT(src, "no %s reference %s", calibration_type_names[type], filename);
+		else
+			GST_WARNING_OBJECT(src, "could not load the %s reference: %s", calibration_type_names[type], err->message);
+		g_clear_error(&err);
+		g_free(filename);
+	}
+
+	if (flycap_calibration_find_defects(&src->calib, src->defect_threshold) > 0)
+		GST_INFO_OBJECT(src, "%u hot pixels in the dark reference", src->calib.n_defects);
+}
+
+static void
+gst_flycap_calibration_capture (GstFlycapSrc * src)
+{
+	FlycapCalibrationType type = g_atomic_int_get(&src->calib_capture);
+	guint row_bytes = src->nRawWidth * src->nBytesPerPixel;
+	gsize size = (gsize)row_bytes * src->nRawHeight;
+	GError *err = NULL;
+	gchar *filename;
+
+	// The camera image changes size with the binning, start again
+	if (size != src->calib_acc_size){
+		g_free(src->calib_acc);
+		src->calib_acc = g_new(guint16, size);
+		src->calib_acc_size = size;
+		src->calib_count = 0;
+	}
+
+	flycap_kernel_accumulate(src->calib_acc, src->convertedImage.pData, src->nRawPitch, row_bytes, src->nRawHeight, src->calib_count == 0);
+	if (++src->calib_count < src->calibration_frames)
+		return;
+
+	if (type == FLYCAP_CALIBRATION_DARK){
+		flycap_calibration_set_dark(&src->calib, src->calib_acc, src->calib_count, src->nRawWidth, src->nRawHeight, src->nBytesPerPixel);
+		flycap_calibration_find_defects(&src->calib, src->defect_threshold);
+	}
+	else
+		flycap_calibration_set_flat(&src->calib, src->calib_acc, src->calib_count, src->nRawWidth, src->nRawHeight, src->nBytesPerPixel);
+
+	g_free(src->calib_acc);
+	src->calib_acc = NULL;
+	src->calib_acc_size = 0;
+	src->calib_count = 0;
+	g_atomic_int_set(&src->calib_capture, -1);
+
+	filename = flycap_calibration_filename(src->calibration_dir, src->camInfo.serialNumber, src->binning, type);
+	if (flycap_calibration_save(&src->calib, type, filename, &err))
+		GST_INFO_OBJECT(src, "saved %s reference %s", calibration_type_names[type], filename);
+	else {
+		GST_ELEMENT_WARNING(src, RESOURCE, WRITE, ("Could not save the %s reference.", calibration_type_names[type]),
+				("%s", err->message));
+		g_clear_error(&err);
+	}
+
+	gst_element_post_message(GST_ELEMENT(src), gst_message_new_element(GST_OBJECT(src),
+			gst_structure_new("flycap-calibration",
+					"type", G_TYPE_STRING, calibration_type_names[type],
+					"frames", G_TYPE_INT, src->calibration_frames,
+					"location", G_TYPE_STRING, filename,
+					"defects", G_TYPE_UINT, src->calib.n_defects,
+					NULL)));
+	g_free(filename);
+}
+
+static gboolean
+gst_flycap_src_capture_reference (GstFlycapSrc * src, FlycapCalibrationType type)
+{
+	if (!src->acq_started){
+		GST_WARNING_OBJECT(src, "capture-%s needs frames, start the pipeline first", calibration_type_names[type]);
+		return FALSE;
+	}
+	if (!g_atomic_int_compare_and_exchange(&src->calib_capture, -1, type)){
+		GST_WARNING_OBJECT(src, "capture-%s ignored, a reference is already being captured", calibration_type_names[type]);
+		return FALSE;
+	}
+
+	GST_INFO_OBJECT(src, "capturing a %s reference from %d frames", calibration_type_names[type], src->calibration_frames);
+	return TRUE;
+}
+
+static gboolean
+gst_flycap_src_capture_dark (GstFlycapSrc * src)
+{
+	return gst_flycap_src_capture_reference(src, FLYCAP_CALIBRATION_DARK);
+}
+
+static gboolean
+gst_flycap_src_capture_flat (GstFlycapSrc * src)
+{
+	return gst_flycap_src_capture_reference(src, FLYCAP_CALIBRATION_FLAT);
+}
+
+/* Pre-trigger ring. While armed every frame is copied into the next of a fixed set of buffers,
+ * allocated when the caps are set, overwriting the oldest, and nothing is pushed. The trigger
+ * signal sends the held frames, oldest first with the times they were captured, then the
+ * source is live. The ring is armed again on the next start.
+ */
+static void
+gst_flycap_pretrigger_free (GstFlycapSrc * src)
+{
+	guint i;
+
+	if (src->pretrigger_ring){
+		for (i = 0; i < src->pretrigger_slots; i++)
+			if (src->pretrigger_ring[i])
+				gst_buffer_unref(src->pretrigger_ring[i]);
+		g_free(src->pretrigger_ring);
+		src->pretrigger_ring = NULL;
+	}
+	src->pretrigger_slots = 0;
+	src->pretrigger_next = 0;
+	src->pretrigger_held = 0;
+	src->pretrigger_bytes = 0;
+	src->pretrigger_armed = FALSE;
+}
+
+static gboolean
+gst_flycap_pretrigger_alloc (GstFlycapSrc * src)
+{
+	gsize frame_size = src->out_height * src->gst_stride;
+	GstStructure *s;
+	gboolean triggered;
+	guint i;
+
+	gst_flycap_pretrigger_free(src);
+	GST_OBJECT_LOCK(src);
+	triggered = src->triggered;   // renegotiating after the trigger, stay live
+	GST_OBJECT_UNLOCK(src);
+	if (src->pretrigger_seconds <= 0.0 || triggered)
+		return TRUE;
+
+	// Enough buffers for the time at the fastest rate allowed, slower rates hold more time
+	src->pretrigger_slots = MAX((guint)ceil(src->pretrigger_seconds * src->maxframerate / (src->accumulate * src->decimation)), 1);
+	src->pretrigger_ring = g_new0(GstBuffer *, src->pretrigger_slots);
+	for (i = 0; i < src->pretrigger_slots; i++){
+		src->pretrigger_ring[i] = gst_buffer_new_and_alloc(frame_size);
+		if (!src->pretrigger_ring[i]){
+			GST_ELEMENT_ERROR(src, RESOURCE, NO_SPACE_LEFT, ("Not enough memory for %.1f s of pre-trigger frames.", src->pretrigger_seconds),
+					("%u frames of %" G_GSIZE_FORMAT " bytes", src->pretrigger_slots, frame_size));
+			gst_flycap_pretrigger_free(src);
+			return FALSE;
+		}
+		if (src->kernel_ops & FLYCAP_KERNEL_OP_STATS)
+			gst_buffer_add_flycap_stats_meta(src->pretrigger_ring[i]);
+	}
+	src->pretrigger_bytes = (guint64)src->pretrigger_slots * frame_size;
+	src->pretrigger_armed = TRUE;
+
+	GST_INFO_OBJECT(src, "pre-trigger ring of %u frames, %" G_GUINT64_FORMAT " bytes", src->pretrigger_slots, src->pretrigger_bytes);
+	s = gst_structure_new("flycap-pretrigger",
+			"seconds", G_TYPE_DOUBLE, src->pretrigger_seconds,
+			"frames", G_TYPE_UINT, src->pretrigger_slots,
+			"frame-size", G_TYPE_UINT64, (guint64)frame_size,
+			"bytes", G_TYPE_UINT64, src->pretrigger_bytes,
+			NULL);
+	gst_element_post_message(GST_ELEMENT(src), gst_message_new_element(GST_OBJECT(src), s));
+
+	return TRUE;
+}
+
+// The ring buffer for the next frame, the oldest once the ring is full
+static GstBuffer *
+gst_flycap_pretrigger_slot (GstFlycapSrc * src)
+{
+	GstBuffer *buf = src->pretrigger_ring[src->pretrigger_next];
+
+	src->pretrigger_next = (src->pretrigger_next + 1) % src->pretrigger_slots;
+	if (src->pretrigger_held < src->pretrigger_slots)
+		src->pretrigger_held++;
+
+	return buf;
+}
+
+// The oldest held frame, the ring gives it up to be pushed
+static GstBuffer *
+gst_flycap_pretrigger_pop (GstFlycapSrc * src)
+{
+	guint slot = (src->pretrigger_next + src->pretrigger_slots - src->pretrigger_held) % src->pretrigger_slots;
+	GstBuffer *buf = src->pretrigger_ring[slot];
+
+	src->pretrigger_ring[slot] = NULL;
+	src->pretrigger_held--;
+
+	return buf;
+}
+
+// After each held frame, stop holding if triggered
+static GstFlowReturn
+gst_flycap_pretrigger_check (GstFlycapSrc * src)
+{
+	gboolean triggered;
+
+	if (gst_flycap_is_flushing(src))
+		return GST_FLOW_FLUSHING;
+
+	GST_OBJECT_LOCK(src);
+	triggered = src->triggered;
+	GST_OBJECT_UNLOCK(src);
+
+	if (triggered){
+		src->pretrigger_armed = FALSE;
+		GST_INFO_OBJECT(src, "triggered, sending %u held frames", src->pretrigger_held);
+		gst_element_post_message(GST_ELEMENT(src), gst_message_new_element(GST_OBJECT(src),
+				gst_structure_new("flycap-trigger", "frames", G_TYPE_UINT, src->pretrigger_held, NULL)));
+	}
+
+	return GST_FLOW_OK;
+}
+
+static gboolean
+gst_flycap_src_trigger (GstFlycapSrc * src)
+{
+	gboolean armed;
+
+	GST_OBJECT_LOCK(src);
+	armed = src->pretrigger_seconds > 0.0 && !src->triggered;
+	src->triggered = TRUE;
+	GST_OBJECT_UNLOCK(src);
+
+	if (!armed)
+		GST_WARNING_OBJECT(src, "trigger ignored, set pretrigger-seconds to hold frames until the trigger");
+
+	return armed;
+}
+
+/* Profiles are the camera's memory channels, which keep its properties, video mode and strobe.
+ * Channel 0 holds the factory defaults and cannot be saved to. */
+static gboolean
+gst_flycap_check_memory_channel (GstFlycapSrc * src, guint channel, gboolean save)
+{
+	unsigned int numChannels = 0;
+
+	FLYCAPEXECANDCHECK(fc2GetMemoryChannelInfo(src->deviceContext, &numChannels));
+	if (channel > numChannels || (save && channel == 0)){
+		GST_WARNING_OBJECT(src, "Memory channel %u cannot be used, the camera has %u", channel, numChannels);
+		return FALSE;
+	}
+	return TRUE;
+
+	fail:
+	return FALSE;
+}
+
+/* After a profile is restored the camera holds the settings, bring the element's copies up to date */
+static void
+gst_flycap_read_camera_settings (GstFlycapSrc * src)
+{
+	fc2Property prop;
+	const fc2Property *cached;
+
+	gst_flycap_get_property_absVal(src, FC2_SHUTTER, &src->exposure);
+	gst_flycap_set_camera_exposure(src, FLYCAP_UPDATE_LOCAL);
+	gst_flycap_read_framerate(src);
+	gst_flycap_get_camera_gain(src);
+	gst_flycap_get_property_val(src, FC2_BRIGHTNESS, &src->blacklevel);
+	gst_flycap_get_camera_saturation(src);
+	gst_flycap_get_camera_sharpness(src);
+
+	if ((cached = flycap_property_cache_lookup(&src->camera_props, FC2_WHITE_BALANCE)))
+		prop = *cached;
+	else{
+		prop.type = FC2_WHITE_BALANCE;
+		FLYCAPEXECANDCHECK(fc2GetProperty(src->deviceContext, &prop));
+	}
+	src->whitebalance = prop.autoManualMode ? GST_WB_AUTO : GST_WB_MANUAL;
+	src->rgain = prop.valueA;
+	src->bgain = prop.valueB;
+
+	fail:
+	gst_flycap_update_latency(src);
+	GST_DEBUG_OBJECT(src, "from the camera: exposure %.1f ms, gain %d, blacklevel %d, white balance %d %d %d",
+			src->exposure, src->gain, src->blacklevel, src->whitebalance, src->rgain, src->bgain);
+}
+
+static gboolean
+gst_flycap_src_save_profile (GstFlycapSrc * src, guint channel)
+{
+	if (!src->deviceContext){
+		GST_WARNING_OBJECT(src, "save-profile needs the camera, start the element first");
+		return FALSE;
+	}
+	if (!gst_flycap_check_memory_channel(src, channel, TRUE))
+		return FALSE;
+
+	GST_INFO_OBJECT(src, "saving the camera settings to memory channel %u", channel);
+	FLYCAPEXECANDCHECK(fc2SaveToMemoryChannel(src->deviceContext, channel));
+	return TRUE;
+
+	fail:
+	return FALSE;
 }
 
-static void
-gst_flycap_get_camera_lut (GstFlycapSrc * src)
+/* The element keeps its own video mode and LUT, a channel saved from another element or
+ * another binning must not change the image size that was negotiated */
+static gboolean
+gst_flycap_src_load_profile (GstFlycapSrc * src, guint channel)
 {
-	unsigned int val;
-	fc2GetActiveLUTBank(src->deviceContext, &val);
+	gboolean restart = src->acq_started;
+	fc2Error error;
 
-	// Decode the value, really not sure how we can determine if LUT is off or in gamma mode.
-	if (val==0)
-		src->lut = GST_LUT_1;
-	else if (val==1)
-		src->lut = GST_LUT_2;
+	if (!src->deviceContext){
+		GST_WARNING_OBJECT(src, "load-profile needs the camera, use the profile property to load one on start");
+		return FALSE;
+	}
+	if (!gst_flycap_check_memory_channel(src, channel, FALSE))
+		return FALSE;
+
+	// The channel can change the video mode, which the camera only allows when stopped
+	if (restart){
+		FLYCAPEXECANDCHECK(fc2StopCapture(src->deviceContext));
+		src->acq_started = FALSE;
+	}
+
+	GST_INFO_OBJECT(src, "restoring the camera settings from memory channel %u", channel);
+	error = fc2RestoreFromMemoryChannel(src->deviceContext, channel);
+	if (error == FC2_ERROR_OK){
+		flycap_state_set_profile(&src->applied, channel);
+		gst_flycap_read_camera_settings(src);
+	}
 	else
-		src->lut = GST_LUT_OFF;
+		GST_WARNING_OBJECT(src, "fc2RestoreFromMemoryChannel(%u) failed: %s", channel, fc2ErrorToDescription(error));
+
+	gst_flycap_set_camera_binning(src);
+	gst_flycap_set_camera_lut(src);
+
+	if (restart){
+		FLYCAPEXECANDCHECK(fc2StartCapture(src->deviceContext));
+		src->acq_started = TRUE;
+	}
+
+	return error == FC2_ERROR_OK;
+
+	fail:
+	return FALSE;
+}
+
+/* Startup timing, reported by the startup-stats property and a flycap-startup element message */
+static const gchar *startup_phase_names[FLYCAP_STARTUP_N] = {
+	"connect", "configure", "profile", "read", "mode", "controls", "luts"
+};
+
+// Add the time since *since to a startup phase, and move *since on to now
+static void
+gst_flycap_startup_phase_end (GstFlycapSrc * src, FlycapStartupPhase phase, GstClockTime * since)
+{
+	GstClockTime now = gst_util_get_timestamp();
+
+	src->startup_time[phase] += now - *since;
+	*since = now;
+}
+
+static GstStructure *
+gst_flycap_startup_to_structure (GstFlycapSrc * src)
+{
+	GstStructure *s;
+	GstClockTime total = 0;
+	guint phase;
+
+	s = gst_structure_new("flycap-startup",
+			"checked", G_TYPE_UINT, src->startup_checked,
+			"written", G_TYPE_UINT, src->startup_written,
+			NULL);
+	for (phase = 0; phase < FLYCAP_STARTUP_N; phase++){
+		gst_structure_set(s, startup_phase_names[phase], G_TYPE_UINT64, src->startup_time[phase], NULL);
+		total += src->startup_time[phase];
+	}
+	gst_structure_set(s, "total", G_TYPE_UINT64, total, NULL);
+
+	return s;
 }
 
 /* class initialisation */
@@ -971,6 +2719,11 @@ gst_flycap_src_class_init (GstFlycapSrcClass * klass)
 
 	gst_element_class_add_pad_template (gstelement_class,
 			gst_static_pad_template_get (&gst_flycap_src_template));
+	gst_element_class_add_pad_template (gstelement_class,
+			gst_static_pad_template_get (&gst_flycap_preview_template));
+
+	gstelement_class->request_new_pad = GST_DEBUG_FUNCPTR (gst_flycap_src_request_new_pad);
+	gstelement_class->release_pad = GST_DEBUG_FUNCPTR (gst_flycap_src_release_pad);
 
 	gst_element_class_set_static_metadata (gstelement_class,
 			"FlyCapture Video Source", "Source/Video",
@@ -980,6 +2733,9 @@ gst_flycap_src_class_init (GstFlycapSrcClass * klass)
 	gstbasesrc_class->stop = GST_DEBUG_FUNCPTR (gst_flycap_src_stop);
 	gstbasesrc_class->get_caps = GST_DEBUG_FUNCPTR (gst_flycap_src_get_caps);
 	gstbasesrc_class->set_caps = GST_DEBUG_FUNCPTR (gst_flycap_src_set_caps);
+	gstbasesrc_class->query = GST_DEBUG_FUNCPTR (gst_flycap_src_query);
+	gstbasesrc_class->unlock = GST_DEBUG_FUNCPTR (gst_flycap_src_unlock);
+	gstbasesrc_class->unlock_stop = GST_DEBUG_FUNCPTR (gst_flycap_src_unlock_stop);
 
 #ifdef OVERRIDE_CREATE
 	gstpushsrc_class->create = GST_DEBUG_FUNCPTR (gst_flycap_src_create);
@@ -990,6 +2746,37 @@ gst_flycap_src_class_init (GstFlycapSrcClass * klass)
 	GST_DEBUG ("Using gst_flycap_src_fill.");
 #endif
 
+	klass->save_profile = GST_DEBUG_FUNCPTR (gst_flycap_src_save_profile);
+	klass->load_profile = GST_DEBUG_FUNCPTR (gst_flycap_src_load_profile);
+	klass->trigger = GST_DEBUG_FUNCPTR (gst_flycap_src_trigger);
+	klass->capture_dark = GST_DEBUG_FUNCPTR (gst_flycap_src_capture_dark);
+	klass->capture_flat = GST_DEBUG_FUNCPTR (gst_flycap_src_capture_flat);
+
+	// Action signals, save the camera settings to a memory channel or restore them from one, e.g.
+	//   g_signal_emit_by_name (flycapsrc, "save-profile", 1, &ok);
+	gst_flycap_src_signals[SIGNAL_SAVE_PROFILE] =
+			g_signal_new ("save-profile", G_TYPE_FROM_CLASS (klass), (GSignalFlags) (G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+					G_STRUCT_OFFSET (GstFlycapSrcClass, save_profile), NULL, NULL, g_cclosure_marshal_generic,
+					G_TYPE_BOOLEAN, 1, G_TYPE_UINT);
+	gst_flycap_src_signals[SIGNAL_LOAD_PROFILE] =
+			g_signal_new ("load-profile", G_TYPE_FROM_CLASS (klass), (GSignalFlags) (G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+					G_STRUCT_OFFSET (GstFlycapSrcClass, load_profile), NULL, NULL, g_cclosure_marshal_generic,
+					G_TYPE_BOOLEAN, 1, G_TYPE_UINT);
+	// With pretrigger-seconds set, send the held frames and go live
+	gst_flycap_src_signals[SIGNAL_TRIGGER] =
+			g_signal_new ("trigger", G_TYPE_FROM_CLASS (klass), (GSignalFlags) (G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+					G_STRUCT_OFFSET (GstFlycapSrcClass, trigger), NULL, NULL, g_cclosure_marshal_generic,
+					G_TYPE_BOOLEAN, 0);
+	// Average the next calibration-frames camera frames into a dark or flat reference and save it
+	gst_flycap_src_signals[SIGNAL_CAPTURE_DARK] =
+			g_signal_new ("capture-dark", G_TYPE_FROM_CLASS (klass), (GSignalFlags) (G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+					G_STRUCT_OFFSET (GstFlycapSrcClass, capture_dark), NULL, NULL, g_cclosure_marshal_generic,
+					G_TYPE_BOOLEAN, 0);
+	gst_flycap_src_signals[SIGNAL_CAPTURE_FLAT] =
+			g_signal_new ("capture-flat", G_TYPE_FROM_CLASS (klass), (GSignalFlags) (G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+					G_STRUCT_OFFSET (GstFlycapSrcClass, capture_flat), NULL, NULL, g_cclosure_marshal_generic,
+					G_TYPE_BOOLEAN, 0);
+
 	// Install GObject properties
 	// Camera Present property
 	g_object_class_install_property (gobject_class, PROP_CAMERAPRESENT,
@@ -998,15 +2785,15 @@ gst_flycap_src_class_init (GstFlycapSrcClass * klass)
 	// Exposure property
 	g_object_class_install_property (gobject_class, PROP_EXPOSURE,
 	  g_param_spec_float("exposure", "Exposure", "Camera sensor exposure time (ms).", 0.01, 31900, DEFAULT_PROP_EXPOSURE,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	// Gain property
 	g_object_class_install_property (gobject_class, PROP_GAIN,
 			  g_param_spec_int("gain", "Gain", "Camera sensor master gain (linear factor).", 1, 16, DEFAULT_PROP_GAIN,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	// Black Level property
 	g_object_class_install_property (gobject_class, PROP_BLACKLEVEL,
 		g_param_spec_int("blacklevel", "Black Level", "Camera sensor black level offset.", 0, 31, DEFAULT_PROP_BLACKLEVEL,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	// R gain property
 	g_object_class_install_property (gobject_class, PROP_RGAIN,
 		g_param_spec_int("rgain", "Red Gain", "Camera sensor red channel gain.", 0, 1023, DEFAULT_PROP_RGAIN,
@@ -1038,46 +2825,178 @@ gst_flycap_src_class_init (GstFlycapSrcClass * klass)
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
 	g_object_class_install_property (gobject_class, PROP_LUT1_OFFSET_R,
 	  g_param_spec_int("lut1offsetred", "LUT1 Red Offset", "Intensity look up table 1 offset value for the Red channel.", 0, 511, DEFAULT_PROP_LUT1_OFFSET,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	g_object_class_install_property (gobject_class, PROP_LUT1_OFFSET_G,
 	  g_param_spec_int("lut1offsetgreen", "LUT1 Green Offset", "Intensity look up table 1 offset value for the Green channel.", 0, 511, DEFAULT_PROP_LUT1_OFFSET,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	g_object_class_install_property (gobject_class, PROP_LUT1_OFFSET_B,
 	  g_param_spec_int("lut1offsetblue", "LUT1 Blue Offset", "Intensity look up table 1 offset value for the Blue channel.", 0, 511, DEFAULT_PROP_LUT1_OFFSET,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	g_object_class_install_property (gobject_class, PROP_LUT1_GAMMA,
 	  g_param_spec_double("lut1gamma", "LUT1 Gamma", "Intensity look up table 1 gamma value.", 0.0, 4.0, DEFAULT_PROP_LUT1_GAMMA,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	g_object_class_install_property (gobject_class, PROP_LUT1_GAIN,
 	  g_param_spec_double("lut1gain", "LUT1 Gain", "Intensity look up table 1 gain value.", 0.0, 1000.0, DEFAULT_PROP_LUT1_GAIN,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	g_object_class_install_property (gobject_class, PROP_LUT2_OFFSET_R,
 	  g_param_spec_int("lut2offsetred", "LUT2 Red Offset", "Intensity look up table 2 offset value for the Red channel.", 0, 511, DEFAULT_PROP_LUT2_OFFSET,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	g_object_class_install_property (gobject_class, PROP_LUT2_OFFSET_G,
 	  g_param_spec_int("lut2offsetgreen", "LUT2 Green Offset", "Intensity look up table 2 offset value for the Green channel.", 0, 511, DEFAULT_PROP_LUT2_OFFSET,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	g_object_class_install_property (gobject_class, PROP_LUT2_OFFSET_B,
 	  g_param_spec_int("lut2offsetblue", "LUT2 Blue Offset", "Intensity look up table 2 offset value for the Blue channel.", 0, 511, DEFAULT_PROP_LUT2_OFFSET,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	g_object_class_install_property (gobject_class, PROP_LUT2_GAMMA,
 	  g_param_spec_double("lut2gamma", "LUT2 Gamma", "Intensity look up table 2 gamma value.", 0.0, 4.0, DEFAULT_PROP_LUT2_GAMMA,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	g_object_class_install_property (gobject_class, PROP_LUT2_GAIN,
 	  g_param_spec_double("lut2gain", "LUT2 Gain", "Intensity look up table 2 gain value.", 0.0, 1000.0, DEFAULT_PROP_LUT2_GAIN,
-          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING | GST_PARAM_CONTROLLABLE)));
 	g_object_class_install_property (gobject_class, PROP_SATURATION,
 	  g_param_spec_int("saturation", "Saturation", "Camera colour saturation.", 0, 100, DEFAULT_PROP_SATURATION,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
 	g_object_class_install_property (gobject_class, PROP_SHARPNESS,
 	  g_param_spec_int("sharpness", "Sharpness/Detail", "Camera sharpness/detail setting. Value <2 will blur.", 0, 10, DEFAULT_PROP_SHARPNESS,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	// Auto exposure and white balance ROI properties
+	g_object_class_install_property (gobject_class, PROP_AE_ROI_LEFT,
+	  g_param_spec_int("ae-roi-left", "AE ROI Left", "Left edge of the auto exposure/white balance region (sensor pixels).", 0, 65535, DEFAULT_PROP_AE_ROI_LEFT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_AE_ROI_TOP,
+	  g_param_spec_int("ae-roi-top", "AE ROI Top", "Top edge of the auto exposure/white balance region (sensor pixels).", 0, 65535, DEFAULT_PROP_AE_ROI_TOP,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_AE_ROI_WIDTH,
+	  g_param_spec_int("ae-roi-width", "AE ROI Width", "Width of the auto exposure/white balance region (sensor pixels). 0 uses the central fifth of the frame.", 0, 65535, DEFAULT_PROP_AE_ROI_WIDTH,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_AE_ROI_HEIGHT,
+	  g_param_spec_int("ae-roi-height", "AE ROI Height", "Height of the auto exposure/white balance region (sensor pixels). 0 uses the central fifth of the frame.", 0, 65535, DEFAULT_PROP_AE_ROI_HEIGHT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	// Host side auto exposure properties
+	g_object_class_install_property (gobject_class, PROP_HOST_AE,
+	  g_param_spec_boolean("host-ae", "Host Auto Exposure", "Control exposure and gain from the host using a histogram of each frame.", DEFAULT_PROP_HOST_AE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_HOST_AE_TARGET,
+	  g_param_spec_int("host-ae-target", "Host AE Target", "Level (0-255) that host auto exposure drives the chosen percentile to.", 1, 254, DEFAULT_PROP_HOST_AE_TARGET,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_HOST_AE_PERCENTILE,
+	  g_param_spec_double("host-ae-percentile", "Host AE Percentile", "Percentile of the luminance histogram used by host auto exposure.", 0.0, 100.0, DEFAULT_PROP_HOST_AE_PERCENTILE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_HOST_AE_MAX_EXPOSURE,
+	  g_param_spec_float("host-ae-max-exposure", "Host AE Maximum Exposure", "Longest exposure (ms) host auto exposure will use before adding gain.", 0.01, 31900, DEFAULT_PROP_HOST_AE_MAX_EXPOSURE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_HOST_AE_INTERVAL,
+	  g_param_spec_int("host-ae-interval", "Host AE Interval", "Minimum time (ms) between host auto exposure writes to the camera.", 0, 10000, DEFAULT_PROP_HOST_AE_INTERVAL,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	// Flip properties
+	g_object_class_install_property (gobject_class, PROP_HFLIP,
+	  g_param_spec_boolean("hflip", "Horizontal Flip", "Mirror the image left-right, using the camera if it can.", DEFAULT_PROP_HORIZ_FLIP,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_VFLIP,
+	  g_param_spec_boolean("vflip", "Vertical Flip", "Mirror the image top-bottom.", DEFAULT_PROP_VERT_FLIP,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_ROTATION,
+	  g_param_spec_enum("rotation", "Rotation", "Rotate the image, after any flips. 90 and 270 swap the width and height.", TYPE_ROTATION, DEFAULT_PROP_ROTATION,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	// Image statistics property
+	g_object_class_install_property (gobject_class, PROP_STATS,
+	  g_param_spec_boolean("stats", "Image Statistics", "Compute per channel histograms, mean, min/max and clipped pixel counts while copying each frame and attach them as GstFlycapStatsMeta.", DEFAULT_PROP_STATS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	// Latency tracing properties
+	g_object_class_install_property (gobject_class, PROP_LATENCY_TRACING,
+	  g_param_spec_boolean("latency-tracing", "Latency Tracing", "Time the retrieve, copy, create and downstream stages of each frame into histograms.", DEFAULT_PROP_LATENCY_TRACING,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_LATENCY_INTERVAL,
+	  g_param_spec_int("latency-interval", "Latency Interval", "Time (ms) between flycap-latency element messages while latency-tracing is on, 0 for no messages.", 0, 3600000, DEFAULT_PROP_LATENCY_INTERVAL,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_LATENCY_STATS,
+	  g_param_spec_boxed("latency-stats", "Latency Statistics", "Count, mean, min, p50, p95, p99 and max (ns) of each stage over the last latency-interval, or since the start if latency-interval is 0.", GST_TYPE_STRUCTURE,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+	// Throughput and health properties
+	g_object_class_install_property (gobject_class, PROP_HEALTH_INTERVAL,
+	  g_param_spec_int("health-interval", "Health Interval", "Time (ms) between flycap-health messages with throughput, error and SDK counters, 0 for no messages.", 0, 3600000, DEFAULT_PROP_HEALTH_INTERVAL,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_HEALTH,
+	  g_param_spec_boxed("health", "Health", "The flycap-health structure for the last health-interval, or since the start if health-interval is 0.", GST_TYPE_STRUCTURE,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property (gobject_class, PROP_FPS,
+	  g_param_spec_double("fps", "Measured Frame Rate", "Frames per second delivered over the last health-interval, or since the start if health-interval is 0.", 0.0, G_MAXDOUBLE, 0.0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property (gobject_class, PROP_FRAMES_RETRIEVED,
+	  g_param_spec_uint64("frames-retrieved", "Frames Retrieved", "Images returned by the SDK since the start.", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property (gobject_class, PROP_FRAMES_DELIVERED,
+	  g_param_spec_uint64("frames-delivered", "Frames Delivered", "Buffers pushed since the start.", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property (gobject_class, PROP_FRAMES_DROPPED,
+	  g_param_spec_uint64("frames-dropped", "Frames Dropped", "Images dropped by the SDK and driver, from fc2GetStats.", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property (gobject_class, PROP_FRAMES_CORRUPT,
+	  g_param_spec_uint64("frames-corrupt", "Frames Corrupt", "Image consistency errors from fc2RetrieveBuffer plus corrupt images from fc2GetStats.", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+	// Recovery properties
+	g_object_class_install_property (gobject_class, PROP_RETRIEVE_TIMEOUT,
+	  g_param_spec_int("retrieve-timeout", "Retrieve Timeout", "Time (ms) to wait for an image, on top of the exposure and frame period, before skipping it and trying again, -1 to wait for ever.", -1, 3600000, DEFAULT_PROP_RETRIEVE_TIMEOUT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_RETRY_LIMIT,
+	  g_param_spec_int("retry-limit", "Retry Limit", "Failed retrieves in a row before the camera is reconnected.", 0, 1000, DEFAULT_PROP_RETRY_LIMIT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_RECONNECT_LIMIT,
+	  g_param_spec_int("reconnect-limit", "Reconnect Limit", "Attempts to reconnect the camera before stopping with an error, 0 to stop as soon as retry-limit is reached.", 0, 1000, DEFAULT_PROP_RECONNECT_LIMIT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_PROFILE,
+	  g_param_spec_int("profile", "Profile", "Camera memory channel to restore on start, only LUT tables, the video mode and registers are then sent from the host. 0 to send every setting.", 0, 15, DEFAULT_PROP_PROFILE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_PRETRIGGER_SECONDS,
+	  g_param_spec_double("pretrigger-seconds", "Pre-trigger Seconds", "Hold this many seconds of frames in memory, pushing nothing, until the trigger signal sends them and the source goes live. 0 to push every frame.", 0.0, 3600.0, DEFAULT_PROP_PRETRIGGER_SECONDS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_PRETRIGGER_BYTES,
+	  g_param_spec_uint64("pretrigger-bytes", "Pre-trigger Bytes", "Memory held for pre-trigger frames, set once the caps are negotiated.", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property (gobject_class, PROP_ACCUMULATE,
+	  g_param_spec_int("accumulate", "Accumulate", "Camera frames averaged into each buffer, for low light. Buffers come at the frame rate divided by this. 1 for no averaging.", 1, FLYCAP_KERNEL_MAX_ACCUMULATE, DEFAULT_PROP_ACCUMULATE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_DECIMATION,
+	  g_param_spec_int("decimation", "Decimation", "Only one camera frame in this many is used, the camera keeps its frame rate and exposure. 1 for every frame.", 1, 1000, DEFAULT_PROP_DECIMATION,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_DECIMATION_PHASE,
+	  g_param_spec_int("decimation-phase", "Decimation Phase", "Which camera frame of each decimation frames is used, counting from 0 at the start of streaming.", 0, 999, DEFAULT_PROP_DECIMATION_PHASE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_EMBEDDED_INFO,
+	  g_param_spec_boolean("embedded-info", "Embedded Info", "Have the camera embed the shutter, gain and frame counter in the first pixels of each frame, attach them to buffers as GstFlycapInfoMeta and report when changes take effect.", DEFAULT_PROP_EMBEDDED_INFO,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_SETTLE_FRAMES,
+	  g_param_spec_uint("settle-frames", "Settle Frames", "Camera frames between the last exposure or gain change being written and the first frame exposed with it, with embedded-info.", 0, G_MAXUINT, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property (gobject_class, PROP_CALIBRATION,
+	  g_param_spec_boolean("calibration", "Calibration", "Subtract the dark reference and divide by the flat reference, where there are references for the camera and binning.", DEFAULT_PROP_CALIBRATION,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_CALIBRATION_FRAMES,
+	  g_param_spec_int("calibration-frames", "Calibration Frames", "Camera frames averaged into a reference by the capture-dark and capture-flat signals.", 1, FLYCAP_KERNEL_MAX_ACCUMULATE, DEFAULT_PROP_CALIBRATION_FRAMES,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_CALIBRATION_DIR,
+	  g_param_spec_string("calibration-dir", "Calibration Directory", "Directory the references are saved to and loaded from, one file per camera serial number, binning and type. NULL for flycap in the user data directory.", NULL,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_DEFECT_THRESHOLD,
+	  g_param_spec_uint("defect-threshold", "Defect Threshold", "Pixels this far above their channel's mean in the dark reference are hot, and are replaced by their neighbours in every frame. 0 for no defect correction.", 0, 255, DEFAULT_PROP_DEFECT_THRESHOLD,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_PREVIEW_SCALE,
+	  g_param_spec_int("preview-scale", "Preview Scale", "The preview pad's frames are the sensor size divided by this, rounded down to a power of two.", 1, 16, DEFAULT_PROP_PREVIEW_SCALE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+	g_object_class_install_property (gobject_class, PROP_PREVIEW_FRAMERATE,
+	  g_param_spec_double("preview-framerate", "Preview Frame Rate", "Maximum frame rate on the preview pad (fps), 0 for every buffer.", 0.0, 1000.0, DEFAULT_PROP_PREVIEW_FRAMERATE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING)));
+	g_object_class_install_property (gobject_class, PROP_STARTUP_STATS,
+	  g_param_spec_boxed("startup-stats", "Startup Statistics", "The flycap-startup structure from the last start, time (ns) spent in each phase and the settings checked and written.", GST_TYPE_STRUCTURE,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
 }
 
 static void
 init_properties(GstFlycapSrc * src)
 {
 	src->exposure = DEFAULT_PROP_EXPOSURE;
+	src->exposure_requested = -1.0f;   // nothing requested yet
+	src->syncing_thread = NULL;
 	gst_flycap_set_camera_exposure(src, FLYCAP_UPDATE_LOCAL);
 	src->gain = DEFAULT_PROP_GAIN;
 	src->blacklevel = DEFAULT_PROP_BLACKLEVEL;
@@ -1088,10 +3007,39 @@ init_properties(GstFlycapSrc * src)
 	src->sharpness = DEFAULT_PROP_SHARPNESS;
 	src->vflip = DEFAULT_PROP_VERT_FLIP;
 	src->hflip = DEFAULT_PROP_HORIZ_FLIP;
+	src->rotation = DEFAULT_PROP_ROTATION;
 	src->whitebalance = DEFAULT_PROP_WHITEBALANCE;
 	src->maxframerate = DEFAULT_PROP_MAXFRAMERATE;
 	src->lut = DEFAULT_PROP_LUT;
 	src->gamma = DEFAULT_PROP_GAMMA;
+	src->ae_roi_left = DEFAULT_PROP_AE_ROI_LEFT;
+	src->ae_roi_top = DEFAULT_PROP_AE_ROI_TOP;
+	src->ae_roi_width = DEFAULT_PROP_AE_ROI_WIDTH;
+	src->ae_roi_height = DEFAULT_PROP_AE_ROI_HEIGHT;
+	src->host_ae = DEFAULT_PROP_HOST_AE;
+	src->host_ae_target = DEFAULT_PROP_HOST_AE_TARGET;
+	src->host_ae_percentile = DEFAULT_PROP_HOST_AE_PERCENTILE;
+	src->host_ae_max_exposure = DEFAULT_PROP_HOST_AE_MAX_EXPOSURE;
+	src->host_ae_interval = DEFAULT_PROP_HOST_AE_INTERVAL;
+	src->stats = DEFAULT_PROP_STATS;
+	src->latency_tracing = DEFAULT_PROP_LATENCY_TRACING;
+	src->latency_interval = DEFAULT_PROP_LATENCY_INTERVAL;
+	src->health_interval = DEFAULT_PROP_HEALTH_INTERVAL;
+	src->retrieve_timeout = DEFAULT_PROP_RETRIEVE_TIMEOUT;
+	src->retry_limit = DEFAULT_PROP_RETRY_LIMIT;
+	src->reconnect_limit = DEFAULT_PROP_RECONNECT_LIMIT;
+	src->profile = DEFAULT_PROP_PROFILE;
+	src->pretrigger_seconds = DEFAULT_PROP_PRETRIGGER_SECONDS;
+	src->accumulate = DEFAULT_PROP_ACCUMULATE;
+	src->decimation = DEFAULT_PROP_DECIMATION;
+	src->decimation_phase = DEFAULT_PROP_DECIMATION_PHASE;
+	src->embedded_info = DEFAULT_PROP_EMBEDDED_INFO;
+	src->calibration = DEFAULT_PROP_CALIBRATION;
+	src->calibration_frames = DEFAULT_PROP_CALIBRATION_FRAMES;
+	src->calibration_dir = NULL;
+	src->defect_threshold = DEFAULT_PROP_DEFECT_THRESHOLD;
+	src->preview_scale = DEFAULT_PROP_PREVIEW_SCALE;
+	src->preview_framerate = DEFAULT_PROP_PREVIEW_FRAMERATE;
 
 	// Settings for lut bank 0 from lut1 settings
 	src->lut_offset[0][0] = DEFAULT_PROP_LUT1_OFFSET;
@@ -1130,6 +3078,11 @@ gst_flycap_src_init (GstFlycapSrc * src)
 	gst_base_src_set_format (GST_BASE_SRC (src), GST_FORMAT_TIME);
 
 	init_properties(src);
+	gst_flycap_select_kernel(src);
+
+	g_cond_init (&src->retry_cond);
+	g_cond_init (&src->preview_cond);
+	src->flushing = FALSE;
 
 	gst_flycap_src_reset (src);
 }
@@ -1139,9 +3092,93 @@ gst_flycap_src_reset (GstFlycapSrc * src)
 {
 	src->deviceContext = NULL;
 	src->cameraPresent = FALSE;
+	src->grab_timeout = 0;
 	src->n_frames = 0;
-	src->total_timeouts = 0;
 	src->last_frame_time = 0;
+	src->roi_base = 0;   // ROI registers must be located again on the next connection
+	src->hflip_in_camera = FALSE;
+	src->host_ae_last_write = 0;
+	src->host_ae_settle = 0;
+	src->min_latency = GST_CLOCK_TIME_NONE;   // so the first calculation is posted
+	src->arrival_callback = NULL;
+	src->removal_callback = NULL;
+	src->camera_removed = FALSE;
+	src->camera_arrived = FALSE;
+	flycap_state_reset(&src->applied);
+	flycap_property_cache_reset(&src->camera_props);
+	src->starting = FALSE;
+	gst_flycap_pretrigger_free(src);
+	src->triggered = FALSE;
+	g_free(src->acc);
+	g_free(src->acc_image);
+	src->acc = NULL;
+	src->acc_image = NULL;
+	src->acc_size = 0;
+	src->acc_count = 0;
+	src->decimation_count = 0;
+	src->last_retrieved = GST_CLOCK_TIME_NONE;
+	src->interval_outliers = 0;
+	src->caps_update_time = GST_CLOCK_TIME_NONE;
+	src->reported_framerate = 0.0f;
+	src->fps_n = 0;
+	src->fps_d = 1;
+	src->info_shutter_word = src->info_gain_word = src->info_counter_word = -1;
+	src->info_frame = 0;
+	memset(&src->info_shutter, 0, sizeof(src->info_shutter));
+	memset(&src->info_gain, 0, sizeof(src->info_gain));
+	flycap_calibration_clear(&src->calib);
+	g_free(src->calib_acc);
+	src->calib_acc = NULL;
+	src->calib_acc_size = 0;
+	src->calib_count = 0;
+	src->calib_capture = -1;
+	g_free(src->preview_image);
+	g_free(src->preview_row);
+	src->preview_image = NULL;
+	src->preview_row = NULL;
+	src->max_latency = GST_CLOCK_TIME_NONE;
+	gst_flycap_latency_reset(src);
+	gst_flycap_health_reset(src);
+}
+
+/* The controller sets controlled properties again for every frame, so a value the element already
+ * has is not sent to the camera again. An application setting the same value still has it written.
+ * Exposure is compared with what was last asked for, as long as nothing else, e.g. host auto
+ * exposure, has changed it since, the camera rounds what it is sent.
+ */
+static gboolean
+gst_flycap_src_unchanged (GstFlycapSrc * src, guint property_id, const GValue * value)
+{
+	switch (property_id) {
+	case PROP_EXPOSURE:
+		return g_value_get_float (value) == src->exposure_requested && src->exposure == src->exposure_written;
+	case PROP_GAIN:
+		return g_value_get_int (value) == src->gain;
+	case PROP_BLACKLEVEL:
+		return g_value_get_int (value) == src->blacklevel;
+	case PROP_LUT1_OFFSET_R:
+		return g_value_get_int (value) == src->lut_offset[0][0];
+	case PROP_LUT1_OFFSET_G:
+		return g_value_get_int (value) == src->lut_offset[0][1];
+	case PROP_LUT1_OFFSET_B:
+		return g_value_get_int (value) == src->lut_offset[0][2];
+	case PROP_LUT1_GAMMA:
+		return g_value_get_double (value) == src->lut_gamma[0];
+	case PROP_LUT1_GAIN:
+		return g_value_get_double (value) == src->lut_gain[0];
+	case PROP_LUT2_OFFSET_R:
+		return g_value_get_int (value) == src->lut_offset[1][0];
+	case PROP_LUT2_OFFSET_G:
+		return g_value_get_int (value) == src->lut_offset[1][1];
+	case PROP_LUT2_OFFSET_B:
+		return g_value_get_int (value) == src->lut_offset[1][2];
+	case PROP_LUT2_GAMMA:
+		return g_value_get_double (value) == src->lut_gamma[1];
+	case PROP_LUT2_GAIN:
+		return g_value_get_double (value) == src->lut_gain[1];
+	default:
+		return FALSE;
+	}
 }
 
 void
@@ -1152,11 +3189,18 @@ gst_flycap_src_set_property (GObject * object, guint property_id,
 
 	src = GST_FLYCAP_SRC (object);
 
+	// Only the controller's own calls, an application thread may set a property while it syncs
+	if (g_atomic_pointer_get(&src->syncing_thread) == (gpointer)g_thread_self()
+			&& gst_flycap_src_unchanged(src, property_id, value))
+		return;
+
 	switch (property_id) {
 	case PROP_EXPOSURE:
 		src->exposure = g_value_get_float(value);
 		GST_DEBUG_OBJECT (src, "set exposure %f", src->exposure);
+		src->exposure_requested = src->exposure;
 		gst_flycap_set_camera_exposure(src, FLYCAP_UPDATE_CAMERA);
+		src->exposure_written = src->exposure;
 		break;
 	case PROP_GAIN:
 		src->gain = g_value_get_int (value);
@@ -1249,6 +3293,116 @@ gst_flycap_src_set_property (GObject * object, guint property_id,
 	case PROP_MAXFRAMERATE:
 		src->maxframerate = g_value_get_float(value);
 		break;
+	case PROP_AE_ROI_LEFT:
+		src->ae_roi_left = g_value_get_int (value);
+		gst_flycap_Write_ROI_Register(src);
+		break;
+	case PROP_AE_ROI_TOP:
+		src->ae_roi_top = g_value_get_int (value);
+		gst_flycap_Write_ROI_Register(src);
+		break;
+	case PROP_AE_ROI_WIDTH:
+		src->ae_roi_width = g_value_get_int (value);
+		gst_flycap_Write_ROI_Register(src);
+		break;
+	case PROP_AE_ROI_HEIGHT:
+		src->ae_roi_height = g_value_get_int (value);
+		gst_flycap_Write_ROI_Register(src);
+		break;
+	case PROP_HOST_AE:
+		src->host_ae = g_value_get_boolean (value);
+		src->host_ae_settle = 0;
+		break;
+	case PROP_HOST_AE_TARGET:
+		src->host_ae_target = g_value_get_int (value);
+		break;
+	case PROP_HOST_AE_PERCENTILE:
+		src->host_ae_percentile = g_value_get_double (value);
+		break;
+	case PROP_HOST_AE_MAX_EXPOSURE:
+		src->host_ae_max_exposure = g_value_get_float (value);
+		break;
+	case PROP_HOST_AE_INTERVAL:
+		src->host_ae_interval = g_value_get_int (value);
+		break;
+	case PROP_STATS:
+		src->stats = g_value_get_boolean (value);
+		gst_flycap_select_kernel(src);
+		break;
+	case PROP_HFLIP:
+		src->hflip = g_value_get_boolean (value);
+		gst_flycap_set_camera_flip(src);
+		break;
+	case PROP_VFLIP:
+		src->vflip = g_value_get_boolean (value);
+		gst_flycap_set_camera_flip(src);
+		break;
+	case PROP_ROTATION:
+		// The output size and caps follow the rotation, so it can only change before negotiation
+		if (GST_STATE(src) > GST_STATE_READY){
+			GST_WARNING_OBJECT(src, "rotation can only be changed in the READY state, ignored");
+			break;
+		}
+		src->rotation = g_value_get_enum (value);
+		gst_flycap_select_kernel(src);
+		break;
+	case PROP_LATENCY_TRACING:
+		src->latency_tracing = g_value_get_boolean (value);
+		gst_flycap_latency_reset(src);
+		break;
+	case PROP_LATENCY_INTERVAL:
+		src->latency_interval = g_value_get_int (value);
+		break;
+	case PROP_HEALTH_INTERVAL:
+		src->health_interval = g_value_get_int (value);
+		break;
+	case PROP_RETRIEVE_TIMEOUT:
+		src->retrieve_timeout = g_value_get_int (value);
+		break;
+	case PROP_RETRY_LIMIT:
+		src->retry_limit = g_value_get_int (value);
+		break;
+	case PROP_RECONNECT_LIMIT:
+		src->reconnect_limit = g_value_get_int (value);
+		break;
+	case PROP_PROFILE:
+		src->profile = g_value_get_int (value);
+		break;
+	case PROP_PRETRIGGER_SECONDS:
+		src->pretrigger_seconds = g_value_get_double (value);
+		break;
+	case PROP_ACCUMULATE:
+		src->accumulate = g_value_get_int (value);
+		break;
+	case PROP_DECIMATION:
+		src->decimation = g_value_get_int (value);
+		g_atomic_int_set(&src->framerate_changed, TRUE);
+		break;
+	case PROP_DECIMATION_PHASE:
+		src->decimation_phase = g_value_get_int (value);
+		break;
+	case PROP_EMBEDDED_INFO:
+		src->embedded_info = g_value_get_boolean (value);
+		break;
+	case PROP_CALIBRATION:
+		src->calibration = g_value_get_boolean (value);
+		break;
+	case PROP_CALIBRATION_FRAMES:
+		src->calibration_frames = g_value_get_int (value);
+		break;
+	case PROP_CALIBRATION_DIR:
+		g_free(src->calibration_dir);
+		src->calibration_dir = g_value_dup_string (value);
+		break;
+	case PROP_DEFECT_THRESHOLD:
+		src->defect_threshold = g_value_get_uint (value);
+		break;
+	case PROP_PREVIEW_SCALE:
+		src->preview_scale = 1 << (g_bit_storage (g_value_get_int (value)) - 1);
+		break;
+	case PROP_PREVIEW_FRAMERATE:
+		src->preview_framerate = g_value_get_double (value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
 		break;
@@ -1348,39 +3502,482 @@ gst_flycap_src_get_property (GObject * object, guint property_id,
 	case PROP_MAXFRAMERATE:
 		g_value_set_float (value, src->maxframerate);
 		break;
+	case PROP_AE_ROI_LEFT:
+		g_value_set_int (value, src->ae_roi_left);
+		break;
+	case PROP_AE_ROI_TOP:
+		g_value_set_int (value, src->ae_roi_top);
+		break;
+	case PROP_AE_ROI_WIDTH:
+		g_value_set_int (value, src->ae_roi_width);
+		break;
+	case PROP_AE_ROI_HEIGHT:
+		g_value_set_int (value, src->ae_roi_height);
+		break;
+	case PROP_HOST_AE:
+		g_value_set_boolean (value, src->host_ae);
+		break;
+	case PROP_HOST_AE_TARGET:
+		g_value_set_int (value, src->host_ae_target);
+		break;
+	case PROP_HOST_AE_PERCENTILE:
+		g_value_set_double (value, src->host_ae_percentile);
+		break;
+	case PROP_HOST_AE_MAX_EXPOSURE:
+		g_value_set_float (value, src->host_ae_max_exposure);
+		break;
+	case PROP_HOST_AE_INTERVAL:
+		g_value_set_int (value, src->host_ae_interval);
+		break;
+	case PROP_STATS:
+		g_value_set_boolean (value, src->stats);
+		break;
+	case PROP_HFLIP:
+		g_value_set_boolean (value, src->hflip);
+		break;
+	case PROP_VFLIP:
+		g_value_set_boolean (value, src->vflip);
+		break;
+	case PROP_ROTATION:
+		g_value_set_enum (value, src->rotation);
+		break;
+	case PROP_LATENCY_TRACING:
+		g_value_set_boolean (value, src->latency_tracing);
+		break;
+	case PROP_LATENCY_INTERVAL:
+		g_value_set_int (value, src->latency_interval);
+		break;
+	case PROP_LATENCY_STATS:
+		g_value_take_boxed (value, gst_flycap_latency_get_stats(src));
+		break;
+	case PROP_HEALTH_INTERVAL:
+		g_value_set_int (value, src->health_interval);
+		break;
+	case PROP_HEALTH:
+		g_value_take_boxed (value, gst_flycap_health_get(src));
+		break;
+	case PROP_FPS:
+		gst_flycap_health_refresh(src);
+		g_value_set_double (value, src->fps);
+		break;
+	case PROP_FRAMES_RETRIEVED:
+		g_value_set_uint64 (value, src->frames_retrieved);
+		break;
+	case PROP_FRAMES_DELIVERED:
+		g_value_set_uint64 (value, src->frames_delivered);
+		break;
+	case PROP_FRAMES_DROPPED:
+		gst_flycap_health_refresh(src);
+		g_value_set_uint64 (value, (guint64)src->camera_stats.imageDropped + src->camera_stats.imageDriverDropped);
+		break;
+	case PROP_FRAMES_CORRUPT:
+		gst_flycap_health_refresh(src);
+		g_value_set_uint64 (value, src->consistency_errors + src->camera_stats.imageCorrupt);
+		break;
+	case PROP_RETRIEVE_TIMEOUT:
+		g_value_set_int (value, src->retrieve_timeout);
+		break;
+	case PROP_RETRY_LIMIT:
+		g_value_set_int (value, src->retry_limit);
+		break;
+	case PROP_RECONNECT_LIMIT:
+		g_value_set_int (value, src->reconnect_limit);
+		break;
+	case PROP_STARTUP_STATS:
+		g_value_take_boxed (value, gst_flycap_startup_to_structure(src));
+		break;
+	case PROP_PROFILE:
+		g_value_set_int (value, src->profile);
+		break;
+	case PROP_PRETRIGGER_SECONDS:
+		g_value_set_double (value, src->pretrigger_seconds);
+		break;
+	case PROP_PRETRIGGER_BYTES:
+		g_value_set_uint64 (value, src->pretrigger_bytes);
+		break;
+	case PROP_ACCUMULATE:
+		g_value_set_int (value, src->accumulate);
+		break;
+	case PROP_DECIMATION:
+		g_value_set_int (value, src->decimation);
+		break;
+	case PROP_DECIMATION_PHASE:
+		g_value_set_int (value, src->decimation_phase);
+		break;
+	case PROP_EMBEDDED_INFO:
+		g_value_set_boolean (value, src->embedded_info);
+		break;
+	case PROP_SETTLE_FRAMES:
+		g_value_set_uint (value, src->settle_frames);
+		break;
+	case PROP_CALIBRATION:
+		g_value_set_boolean (value, src->calibration);
+		break;
+	case PROP_CALIBRATION_FRAMES:
+		g_value_set_int (value, src->calibration_frames);
+		break;
+	case PROP_CALIBRATION_DIR:
+		g_value_set_string (value, src->calibration_dir);
+		break;
+	case PROP_DEFECT_THRESHOLD:
+		g_value_set_uint (value, src->defect_threshold);
+		break;
+	case PROP_PREVIEW_SCALE:
+		g_value_set_int (value, src->preview_scale);
+		break;
+	case PROP_PREVIEW_FRAMERATE:
+		g_value_set_double (value, src->preview_framerate);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
 		break;
 	}
 }
 
-void
-gst_flycap_src_dispose (GObject * object)
+void
+gst_flycap_src_dispose (GObject * object)
+{
+	GstFlycapSrc *src;
+
+	g_return_if_fail (GST_IS_FLYCAP_SRC (object));
+	src = GST_FLYCAP_SRC (object);
+
+	GST_DEBUG_OBJECT (src, "dispose");
+
+	// clean up as possible.  may be called multiple times
+
+	G_OBJECT_CLASS (gst_flycap_src_parent_class)->dispose (object);
+}
+
+void
+gst_flycap_src_finalize (GObject * object)
+{
+	GstFlycapSrc *src;
+
+	g_return_if_fail (GST_IS_FLYCAP_SRC (object));
+	src = GST_FLYCAP_SRC (object);
+
+	GST_DEBUG_OBJECT (src, "finalize");
+
+	/* clean up object here */
+	if (src->latency_last)
+		gst_structure_free (src->latency_last);
+	if (src->health_last)
+		gst_structure_free (src->health_last);
+	g_cond_clear (&src->retry_cond);
+	g_cond_clear (&src->preview_cond);
+	g_free (src->calibration_dir);
+	if (src->preview_caps)
+		gst_caps_unref (src->preview_caps);
+
+	G_OBJECT_CLASS (gst_flycap_src_parent_class)->finalize (object);
+}
+
+/* SDK buffering sets the maximum latency, the grab timeout lets create recover from a lost image.
+ * The timeout follows the exposure from here on, see gst_flycap_update_grab_timeout. */
+static gboolean
+gst_flycap_apply_sdk_config (GstFlycapSrc * src)
+{
+	fc2Config config;
+
+	FLYCAPEXECANDCHECK(fc2GetConfiguration(src->deviceContext, &config));
+	config.grabTimeout = gst_flycap_grab_timeout(src);
+	FLYCAPEXECANDCHECK(fc2SetConfiguration(src->deviceContext, &config));
+	src->grab_timeout = config.grabTimeout;
+
+	src->sdk_buffers = config.numBuffers;
+	src->sdk_drop_frames = (config.grabMode == FC2_DROP_FRAMES);
+	GST_DEBUG_OBJECT (src, "fc2SetConfiguration: %d buffers, %s, timeout %d ms", config.numBuffers,
+			src->sdk_drop_frames ? "drop frames" : "buffer frames", config.grabTimeout);
+
+	return TRUE;
+
+	fail:
+	return FALSE;
+}
+
+/* Send all the settings we hold to the camera on start.
+ * The camera usually still has most of them from the last run, so its property values are read
+ * in one pass first and only the settings it does not have are written. With a profile the
+ * camera properties come from its memory channel instead, and are read back into the element. */
+static void
+gst_flycap_apply_camera_settings (GstFlycapSrc * src, GstClockTime * since)
+{
+	fc2PropertyType types[8];
+	guint n_types = 0;
+	gboolean from_profile = FALSE;
+	fc2Error error;
+
+	flycap_state_reset(&src->applied);
+	src->starting = TRUE;
+
+	if (src->profile > 0 && gst_flycap_check_memory_channel(src, src->profile, FALSE)){
+		src->startup_checked++;
+		src->startup_written++;
+		error = fc2RestoreFromMemoryChannel(src->deviceContext, src->profile);
+		if (error == FC2_ERROR_OK){
+			flycap_state_set_profile(&src->applied, src->profile);
+			from_profile = TRUE;
+		}
+		else
+			GST_WARNING_OBJECT(src, "fc2RestoreFromMemoryChannel(%d) failed, sending the settings instead: %s",
+					src->profile, fc2ErrorToDescription(error));
+		gst_flycap_startup_phase_end(src, FLYCAP_STARTUP_PROFILE, since);
+	}
+
+	// Every property the settings below write
+	types[n_types++] = FC2_FRAME_RATE;
+	types[n_types++] = FC2_SHUTTER;
+	types[n_types++] = FC2_GAIN;
+	types[n_types++] = FC2_BRIGHTNESS;
+	types[n_types++] = FC2_SATURATION;
+	types[n_types++] = FC2_SHARPNESS;
+	if (src->whitebalance != GST_WB_ONEPUSH || from_profile)
+		types[n_types++] = FC2_WHITE_BALANCE;
+	if (src->lut == GST_LUT_OFF || src->lut == GST_LUT_GAMMA)
+		types[n_types++] = FC2_GAMMA;
+	flycap_property_cache_read(&src->camera_props, src->deviceContext, types, n_types);
+	gst_flycap_startup_phase_end(src, FLYCAP_STARTUP_READ, since);
+
+	// Set binning first which determines the video mode and image size etc.
+	gst_flycap_set_camera_binning(src);
+	gst_flycap_startup_phase_end(src, FLYCAP_STARTUP_MODE, since);
+
+//	GST_DEBUG_OBJECT (src, "gain %d, min %f, max %f", src->gain, src->cam_min_gain, src->cam_max_gain);
+	GST_DEBUG_OBJECT (src, "gain %d", src->gain);
+	GST_DEBUG_OBJECT (src, "exposure %f", src->exposure);
+	if (from_profile)
+		gst_flycap_read_camera_settings(src);
+	else{
+		gst_flycap_set_camera_exposure(src, FLYCAP_UPDATE_CAMERA);
+		gst_flycap_set_camera_gain(src);
+		GST_DEBUG_OBJECT (src, "set blacklevel %d", src->blacklevel);
+		gst_flycap_set_property_val(src, FC2_BRIGHTNESS, src->blacklevel);
+		//gst_flycap_set_camera_whitebalance(src);  // moved to later as got property not present error here
+
+		gst_flycap_set_camera_saturation(src);
+	}
+
+	gst_flycap_set_camera_flip(src);
+
+	if (!from_profile)
+		setupStrobe(src);
+	gst_flycap_startup_phase_end(src, FLYCAP_STARTUP_CONTROLS, since);
+
+	// Set default lut or gamma, this sends the tables of the bank it uses
+    gst_flycap_set_camera_lut(src);
+	gst_flycap_startup_phase_end(src, FLYCAP_STARTUP_LUTS, since);
+
+	if (!from_profile){
+		// Set sharpness (think this has to come after setting LUT), this also turns it on
+		gst_flycap_set_camera_sharpness(src);
+
+		// Set default white balance
+		gst_flycap_set_camera_whitebalance(src);
+	}
+
+	// For debugging read these registers
+//	gst_flycap_Read_WB_Register(src);
+//	gst_flycap_Read_ROI_Register(src);
+
+	// Change the AE and WB ROI
+	gst_flycap_Write_ROI_Register(src);
+//	gst_flycap_Read_ROI_Register(src); // for debug only
+
+	gst_flycap_embedded_info_enable(src);
+
+	// From here on property changes go straight to the camera
+	flycap_property_cache_reset(&src->camera_props);
+	src->starting = FALSE;
+	gst_flycap_startup_phase_end(src, FLYCAP_STARTUP_CONTROLS, since);
+}
+
+/* FlyCapture bus events arrive on an SDK thread, note them for create and wake any wait to retry */
+static void
+gst_flycap_bus_arrival (void *pParameter, unsigned int serialNumber)
 {
-	GstFlycapSrc *src;
+	GstFlycapSrc *src = GST_FLYCAP_SRC (pParameter);
 
-	g_return_if_fail (GST_IS_FLYCAP_SRC (object));
-	src = GST_FLYCAP_SRC (object);
+	if (serialNumber != src->camInfo.serialNumber)
+		return;
 
-	GST_DEBUG_OBJECT (src, "dispose");
+	GST_INFO_OBJECT(src, "camera %u arrived", serialNumber);
+	GST_OBJECT_LOCK(src);
+	src->camera_arrived = TRUE;
+	g_cond_broadcast(&src->retry_cond);
+	GST_OBJECT_UNLOCK(src);
+}
 
-	// clean up as possible.  may be called multiple times
+static void
+gst_flycap_bus_removal (void *pParameter, unsigned int serialNumber)
+{
+	GstFlycapSrc *src = GST_FLYCAP_SRC (pParameter);
 
-	G_OBJECT_CLASS (gst_flycap_src_parent_class)->dispose (object);
+	if (serialNumber != src->camInfo.serialNumber)
+		return;
+
+	GST_INFO_OBJECT(src, "camera %u removed", serialNumber);
+	GST_OBJECT_LOCK(src);
+	src->camera_removed = TRUE;
+	src->camera_arrived = FALSE;
+	g_cond_broadcast(&src->retry_cond);
+	GST_OBJECT_UNLOCK(src);
 }
 
-void
-gst_flycap_src_finalize (GObject * object)
+/* The callbacks belong to the context, so they last through a reconnect */
+static void
+gst_flycap_register_bus_callbacks (GstFlycapSrc * src)
 {
-	GstFlycapSrc *src;
+	FLYCAPEXECANDCHECK(fc2RegisterCallback(src->deviceContext, gst_flycap_bus_arrival, FC2_ARRIVAL, src, &src->arrival_callback));
+	FLYCAPEXECANDCHECK(fc2RegisterCallback(src->deviceContext, gst_flycap_bus_removal, FC2_REMOVAL, src, &src->removal_callback));
+	return;
 
-	g_return_if_fail (GST_IS_FLYCAP_SRC (object));
-	src = GST_FLYCAP_SRC (object);
+	fail:   // without them a lost camera is found by retrying
+	return;
+}
 
-	GST_DEBUG_OBJECT (src, "finalize");
+static void
+gst_flycap_unregister_bus_callbacks (GstFlycapSrc * src)
+{
+	if (src->arrival_callback)
+		fc2UnregisterCallback(src->deviceContext, src->arrival_callback);
+	if (src->removal_callback)
+		fc2UnregisterCallback(src->deviceContext, src->removal_callback);
+	src->arrival_callback = NULL;
+	src->removal_callback = NULL;
+}
 
-	/* clean up object here */
-	G_OBJECT_CLASS (gst_flycap_src_parent_class)->finalize (object);
+/* Drop the connection and find the same camera again by serial number, it may have re-enumerated.
+ * Then compare the camera with the applied state and write only what it has lost, which is
+ * nothing after a bus reset and everything after a power cycle. */
+static gboolean
+gst_flycap_reconnect (GstFlycapSrc * src)
+{
+	fc2PGRGuid guid;
+	FlycapReplayResult result;
+	GstClockTime t_start = gst_util_get_timestamp();
+
+	GST_DEBUG_OBJECT (src, "reconnect to camera %u", src->camInfo.serialNumber);
+
+	GST_OBJECT_LOCK(src);
+	src->camera_arrived = FALSE;   // wait for another arrival if this attempt fails
+	GST_OBJECT_UNLOCK(src);
+
+	// Errors are expected here, the camera has probably gone
+	if (src->acq_started){
+		fc2StopCapture(src->deviceContext);
+		src->acq_started = FALSE;
+	}
+	fc2Disconnect(src->deviceContext);
+	src->cameraPresent = FALSE;
+
+	FLYCAPEXECANDCHECK(fc2GetCameraFromSerialNumber(src->deviceContext, src->camInfo.serialNumber, &guid));
+	FLYCAPEXECANDCHECK(fc2Connect(src->deviceContext, &guid));
+	src->cameraPresent = TRUE;
+
+	if (!gst_flycap_apply_sdk_config(src))
+		goto fail;
+
+	flycap_state_replay(&src->applied, src->deviceContext, &result);
+	if (result.error != FC2_ERROR_OK)
+		GST_WARNING_OBJECT(src, "Restoring camera settings: %s", fc2ErrorToDescription(result.error));
+
+	FLYCAPEXECANDCHECK(fc2StartCapture(src->deviceContext));
+	src->acq_started = TRUE;
+
+	GST_OBJECT_LOCK(src);
+	src->camera_removed = FALSE;
+	src->reconnect_time = gst_util_get_timestamp() - t_start;
+	src->reconnect_writes = result.written;
+	GST_OBJECT_UNLOCK(src);
+
+	GST_INFO_OBJECT(src, "reconnected in %" GST_TIME_FORMAT ", %u of %u settings written",
+			GST_TIME_ARGS(src->reconnect_time), result.written, result.checked);
+
+	return TRUE;
+
+	fail:
+	return FALSE;
+}
+
+/* Wait before trying again, returns FALSE if unlock was called to flush or stop the element.
+ * The camera arriving back on the bus ends the wait early. */
+static gboolean
+gst_flycap_retry_wait (GstFlycapSrc * src, GstClockTime wait)
+{
+	gint64 end_time = g_get_monotonic_time () + GST_TIME_AS_USECONDS(wait);
+	gboolean flushing;
+
+	GST_OBJECT_LOCK(src);
+	while (!src->flushing && !src->camera_arrived && g_cond_wait_until(&src->retry_cond, GST_OBJECT_GET_LOCK(src), end_time))
+		;
+	flushing = src->flushing;
+	GST_OBJECT_UNLOCK(src);
+
+	return !flushing;
+}
+
+/* Decide what to do after fc2RetrieveBuffer fails, GST_FLOW_OK means try again.
+ * A timeout or a corrupt image is skipped and retried at once, other errors back off. After retry-limit
+ * failures in a row the camera is reconnected, and only when that fails reconnect-limit times does the
+ * pipeline get an error. */
+static GstFlowReturn
+gst_flycap_retrieve_failed (GstFlycapSrc * src, fc2Error error, gint *failures, gint *reconnects)
+{
+	gboolean removed, wait;
+
+	// Stopping, RetrieveBuffer failing is expected and not worth a retry or a reconnect
+	if (gst_flycap_is_flushing(src))
+		return GST_FLOW_FLUSHING;
+
+	if (error == FC2_ERROR_TIMEOUT)
+		src->total_timeouts++;
+	else if (error == FC2_ERROR_IMAGE_CONSISTENCY_ERROR)
+		src->consistency_errors++;
+	else
+		src->retrieve_errors++;
+
+	(*failures)++;
+	GST_WARNING_OBJECT(src, "fc2RetrieveBuffer() failed (%d of %d): %s", *failures, src->retry_limit, fc2ErrorToDescription(error));
+
+	GST_OBJECT_LOCK(src);
+	removed = src->camera_removed;
+	GST_OBJECT_UNLOCK(src);
+
+	// No point retrying if the bus has told us the camera has gone
+	if (*failures <= src->retry_limit && !removed){
+		if (error == FC2_ERROR_TIMEOUT || error == FC2_ERROR_IMAGE_CONSISTENCY_ERROR)
+			return GST_FLOW_OK;
+		if (!gst_flycap_retry_wait(src, MIN(RETRY_BACKOFF_MIN << (*failures - 1), RETRY_BACKOFF_MAX)))
+			return GST_FLOW_FLUSHING;
+		return GST_FLOW_OK;
+	}
+
+	// Retrying has not helped, start again with the camera
+	while (*reconnects < src->reconnect_limit){
+		// Wait between attempts, and for a camera that has gone to come back
+		GST_OBJECT_LOCK(src);
+		wait = (*reconnects > 0) || (src->camera_removed && !src->camera_arrived);
+		GST_OBJECT_UNLOCK(src);
+		if (wait && !gst_flycap_retry_wait(src, RETRY_BACKOFF_MAX))
+			return GST_FLOW_FLUSHING;
+		if (gst_flycap_is_flushing(src))
+			return GST_FLOW_FLUSHING;
+
+		(*reconnects)++;
+		if (gst_flycap_reconnect(src)){
+			src->reconnects++;
+			GST_ELEMENT_WARNING(src, RESOURCE, READ, ("Camera reconnected after %d failed retrieves.", *failures),
+					("last error: %s, reconnect attempt %d of %d", fc2ErrorToDescription(error), *reconnects, src->reconnect_limit));
+			*failures = 0;
+			return GST_FLOW_OK;
+		}
+		GST_WARNING_OBJECT(src, "reconnect attempt %d of %d failed", *reconnects, src->reconnect_limit);
+	}
+
+	GST_ELEMENT_ERROR(src, RESOURCE, READ, ("Could not get images from the camera."),
+			("fc2RetrieveBuffer: %s, after %d retries and %d reconnect attempts", fc2ErrorToDescription(error), src->retry_limit, *reconnects));
+	return GST_FLOW_ERROR;
 }
 
 static gboolean
@@ -1391,9 +3988,16 @@ gst_flycap_src_start (GstBaseSrc * bsrc)
 	GstFlycapSrc *src = GST_FLYCAP_SRC (bsrc);
     fc2PGRGuid guid;
     unsigned int numCameras = 0;
+	GstClockTime since = gst_util_get_timestamp();
+	GstStructure *startup;
+	gchar *str;
 
 	GST_DEBUG_OBJECT (src, "start");
 
+	memset(src->startup_time, 0, sizeof(src->startup_time));
+	src->startup_checked = 0;
+	src->startup_written = 0;
+
 	// Turn on automatic timestamping, if so we do not need to do it manually, BUT there is some evidence that automatic timestamping is laggy
 //	gst_base_src_set_do_timestamp(bsrc, TRUE);
 
@@ -1424,61 +4028,34 @@ gst_flycap_src_start (GstBaseSrc * bsrc)
 	FLYCAPEXECANDCHECK(fc2GetCameraInfo(src->deviceContext, &src->camInfo));
 	GST_DEBUG_OBJECT (src, "fc2GetCameraInfo: %s, %s", src->camInfo.sensorInfo, src->camInfo.sensorResolution);
 
-	// Set binning first which determines the video mode and image size etc.
-	gst_flycap_set_camera_binning(src);
+	gst_flycap_register_bus_callbacks(src);
+	gst_flycap_startup_phase_end(src, FLYCAP_STARTUP_CONNECT, &since);
+
+	// SDK buffering and timeout
+	if (!gst_flycap_apply_sdk_config(src))
+		goto fail;
 
 	// Alloc a buffer for the converted image, for use later
 	GST_DEBUG_OBJECT (src, "fc2CreateImage");
 	FLYCAPEXECANDCHECK(fc2CreateImage(&src->rawImage));
 	FLYCAPEXECANDCHECK(fc2CreateImage(&src->convertedImage));
 //	FLYCAPEXECANDCHECK(fc2CreateImage(&src->tempImage));
+	gst_flycap_startup_phase_end(src, FLYCAP_STARTUP_CONFIGURE, &since);
 
-//	GST_DEBUG_OBJECT (src, "gain %d, min %f, max %f", src->gain, src->cam_min_gain, src->cam_max_gain);
-	GST_DEBUG_OBJECT (src, "gain %d", src->gain);
-	GST_DEBUG_OBJECT (src, "exposure %f", src->exposure);
-	gst_flycap_set_camera_exposure(src, FLYCAP_UPDATE_CAMERA);
-	gst_flycap_set_camera_gain(src);
-	GST_DEBUG_OBJECT (src, "set blacklevel %d", src->blacklevel);
-	gst_flycap_set_property_val(src, FC2_BRIGHTNESS, src->blacklevel);
-	//gst_flycap_set_camera_whitebalance(src);  // moved to later as got property not present error here
-
-	gst_flycap_set_camera_saturation(src);
-
-	//is_SetRopEffect(src->hCam, IS_SET_ROP_MIRROR_LEFTRIGHT, src->hflip, 0);
-	//is_SetRopEffect(src->hCam, IS_SET_ROP_MIRROR_UPDOWN, src->vflip, 0);
-
-	setupStrobe(src);
-
-	// Calculate and preset both luts, and all channels on the camera
-	gst_flycap_calculate_luts(src, 0, 0);
-	gst_flycap_calculate_luts(src, 0, 1);
-	gst_flycap_calculate_luts(src, 0, 2);
-	gst_flycap_calculate_luts(src, 1, 0);
-	gst_flycap_calculate_luts(src, 1, 1);
-	gst_flycap_calculate_luts(src, 1, 2);
-	// Set default lut or gamma
-    gst_flycap_set_camera_lut(src);
-
-	// Set sharpness (think this has to come after setting LUT)
-	gst_flycap_set_property_on(src, FC2_SHARPNESS);
-	gst_flycap_set_camera_sharpness(src);
-
-	// Set default white balance
-	gst_flycap_set_camera_whitebalance(src);
-
-	// For debugging read these registers
-//	gst_flycap_Read_WB_Register(src);
-//	gst_flycap_Read_ROI_Register(src);
+	gst_flycap_apply_camera_settings(src, &since);
 
-	// Change the AE and WB ROI
-	gst_flycap_Write_ROI_Register(src);
-//	gst_flycap_Read_ROI_Register(src); // for debug only
+	startup = gst_flycap_startup_to_structure(src);
+	str = gst_structure_to_string(startup);
+	GST_INFO_OBJECT (src, "%s", str);
+	g_free(str);
+	gst_element_post_message(GST_ELEMENT(src), gst_message_new_element(GST_OBJECT(src), startup));
 
 	return TRUE;
 
 	fail:
 
 	if (src->deviceContext) {
+		gst_flycap_unregister_bus_callbacks(src);
 		fc2DestroyContext(src->deviceContext);
 		src->deviceContext = NULL;
 	}
@@ -1496,19 +4073,62 @@ gst_flycap_src_stop (GstBaseSrc * bsrc)
 
 	GstFlycapSrc *src = GST_FLYCAP_SRC (bsrc);
 
+	fc2Error error;
+
 	GST_DEBUG_OBJECT (src, "stop");
-	GST_DEBUG_OBJECT (src, "fc2StopCapture");
-	FLYCAPEXECANDCHECK(fc2StopCapture(src->deviceContext));
-	GST_DEBUG_OBJECT (src, "fc2Disconnect");
-	FLYCAPEXECANDCHECK(fc2Disconnect(src->deviceContext));
-	FLYCAPEXECANDCHECK(fc2DestroyContext(src->deviceContext));
+
+	// A failed reconnect has already stopped and disconnected, errors here are only logged so
+	// the bus callbacks, which have src as user data, and everything below are always released
+	if (src->deviceContext){
+		if (src->acq_started){
+			GST_DEBUG_OBJECT (src, "fc2StopCapture");
+			if ((error = fc2StopCapture(src->deviceContext)) != FC2_ERROR_OK)
+				GST_WARNING_OBJECT(src, "fc2StopCapture: %s", fc2ErrorToDescription(error));
+			src->acq_started = FALSE;
+		}
+		if (src->cameraPresent){
+			GST_DEBUG_OBJECT (src, "fc2Disconnect");
+			if ((error = fc2Disconnect(src->deviceContext)) != FC2_ERROR_OK)
+				GST_WARNING_OBJECT(src, "fc2Disconnect: %s", fc2ErrorToDescription(error));
+		}
+		gst_flycap_unregister_bus_callbacks(src);
+		if ((error = fc2DestroyContext(src->deviceContext)) != FC2_ERROR_OK)
+			GST_WARNING_OBJECT(src, "fc2DestroyContext: %s", fc2ErrorToDescription(error));
+	}
 
 	fc2DestroyImage(&src->rawImage);
 	fc2DestroyImage(&src->convertedImage);
 
 	gst_flycap_src_reset (src);
 
-	fail:   // Needed for FLYCAPEXECANDCHECK, does nothing in this case
+	return TRUE;
+}
+
+/* Wake create if it is waiting to retry, fc2RetrieveBuffer itself returns within retrieve-timeout */
+static gboolean
+gst_flycap_src_unlock (GstBaseSrc * bsrc)
+{
+	GstFlycapSrc *src = GST_FLYCAP_SRC (bsrc);
+
+	GST_DEBUG_OBJECT (src, "unlock");
+	GST_OBJECT_LOCK(src);
+	src->flushing = TRUE;
+	g_cond_broadcast(&src->retry_cond);
+	GST_OBJECT_UNLOCK(src);
+
+	return TRUE;
+}
+
+static gboolean
+gst_flycap_src_unlock_stop (GstBaseSrc * bsrc)
+{
+	GstFlycapSrc *src = GST_FLYCAP_SRC (bsrc);
+
+	GST_DEBUG_OBJECT (src, "unlock_stop");
+	GST_OBJECT_LOCK(src);
+	src->flushing = FALSE;
+	GST_OBJECT_UNLOCK(src);
+
 	return TRUE;
 }
 
@@ -1526,17 +4146,21 @@ gst_flycap_src_get_caps (GstBaseSrc * bsrc, GstCaps * filter)
     // Create video info 
     gst_video_info_init (&vinfo);
 
-    vinfo.width = src->nWidth;
-    vinfo.height = src->nHeight;
+    if (src->rotation == GST_ROTATION_90 || src->rotation == GST_ROTATION_270){
+        vinfo.width = src->nHeight;
+        vinfo.height = src->nWidth;
+    }
+    else{
+        vinfo.width = src->nWidth;
+        vinfo.height = src->nHeight;
+    }
 
-   	vinfo.fps_n = 0;  vinfo.fps_d = 1;  // Frames per second fraction n/d, 0/1 indicates a frame rate may vary
+    // What the camera reports, the caps are updated if it changes
+    gst_flycap_output_framerate(src, &vinfo.fps_n, &vinfo.fps_d);
     vinfo.interlace_mode = GST_VIDEO_INTERLACE_MODE_PROGRESSIVE;
 
     vinfo.finfo = gst_video_format_get_info (DEFAULT_GST_VIDEO_FORMAT);
 
-    // cannot do this for variable frame rate
-    //src->duration = gst_util_uint64_scale_int (GST_SECOND, vinfo.fps_d, vinfo.fps_n); // NB n and d are wrong way round to invert the fps into a duration.
-
     caps = gst_video_info_to_caps (&vinfo);
 
     // We can supply our max frame rate, but not sure how to do it or what effect it will have
@@ -1569,6 +4193,16 @@ gst_flycap_src_set_caps (GstBaseSrc * bsrc, GstCaps * caps)
 	GstVideoInfo vinfo;
 	//GstStructure *s = gst_caps_get_structure (caps, 0);
 
+	gst_video_info_from_caps (&vinfo, caps);
+
+	// Only the frame rate changed, see gst_flycap_update_caps_framerate
+	if (src->acq_started && GST_VIDEO_INFO_FORMAT (&vinfo) != GST_VIDEO_FORMAT_UNKNOWN
+			&& vinfo.width == src->out_width && vinfo.height == src->out_height){
+		src->fps_n = vinfo.fps_n;
+		src->fps_d = vinfo.fps_d;
+		return TRUE;
+	}
+
     if(src->acq_started == TRUE){
 		FLYCAPEXECANDCHECK(fc2StopCapture(src->deviceContext));
 		src->acq_started = FALSE;
@@ -1576,17 +4210,26 @@ gst_flycap_src_set_caps (GstBaseSrc * bsrc, GstCaps * caps)
 
 	GST_DEBUG_OBJECT (src, "The caps being set are %" GST_PTR_FORMAT, caps);
 
-	gst_video_info_from_caps (&vinfo, caps);
-
 	if (GST_VIDEO_INFO_FORMAT (&vinfo) != GST_VIDEO_FORMAT_UNKNOWN) {
 		g_assert (src->deviceContext != NULL);
 		//  src->vrm_stride = get_pitch (src->device);  // wait for image to arrive for this
 		src->gst_stride = GST_VIDEO_INFO_COMP_STRIDE (&vinfo, 0);
-		src->nHeight = vinfo.height;
+		src->out_width = vinfo.width;    // sensor size, but swapped if rotated
+		src->out_height = vinfo.height;
+		src->fps_n = vinfo.fps_n;
+		src->fps_d = vinfo.fps_d;
 	} else {
 		goto unsupported_caps;
 	}
 
+	gst_flycap_select_kernel(src);
+
+	if (!gst_flycap_pretrigger_alloc(src))
+		return FALSE;
+
+	gst_flycap_calibration_load(src);
+	gst_flycap_preview_configure(src);
+
 	// start freerun/continuous capture
 	GST_DEBUG_OBJECT (src, "fc2StartCapture");
 	FLYCAPEXECANDCHECK(fc2StartCapture(src->deviceContext));
@@ -1603,6 +4246,27 @@ gst_flycap_src_set_caps (GstBaseSrc * bsrc, GstCaps * caps)
 	return FALSE;
 }
 
+static gboolean
+gst_flycap_src_query (GstBaseSrc * bsrc, GstQuery * query)
+{
+	GstFlycapSrc *src = GST_FLYCAP_SRC (bsrc);
+	GstClockTime min, max;
+
+	switch (GST_QUERY_TYPE (query)) {
+	case GST_QUERY_LATENCY:
+		// Cannot answer until the camera is open
+		if (!src->deviceContext)
+			return FALSE;
+
+		gst_flycap_calculate_latency(src, &min, &max);
+		GST_DEBUG_OBJECT(src, "latency query min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT, GST_TIME_ARGS(min), GST_TIME_ARGS(max));
+		gst_query_set_latency(query, TRUE, min, max);
+		return TRUE;
+	default:
+		return GST_BASE_SRC_CLASS (gst_flycap_src_parent_class)->query (bsrc, query);
+	}
+}
+
 // Expect a raw16 image, before Bayer conversion, reduce this to a raw8 image
 // I have not worked out how this should do this conversion !!!!!!!!!!!!!
 // To try this, acquire in RAW16, retrieve into rawImage, use this fn to convert into tempImage, then Bayer convert into convertedImage
@@ -1627,114 +4291,6 @@ gst_flycap_src_set_caps (GstBaseSrc * bsrc, GstCaps * caps)
 //	return 0;
 //}
 
-/* Copy and duplicate data from the possibly binned image
- *  into the full size image
- */
-void
-copy_duplicate_data(GstFlycapSrc *src, GstMapInfo *minfo)
-{
-	guint i, j, ii;
-
-	// From the grabber source we get 1 progressive frame
-	// We expect src->nPitch = src->gst_stride but use separate vars for safety
-
-//	GST_DEBUG_OBJECT (src, "copy_duplicate_data: binning %d src->nRawWidth %d src->nRawHeight %d src->nRawPitch %d", src->binning, src->nRawWidth, src->nRawHeight, src->nRawPitch);
-
-	if (src->binning == 1){   // just copy the data into the buffer
-		for (i = 0; i < src->nHeight; i++) {
-			memcpy (minfo->data + i * src->gst_stride, src->convertedImage.pData + i * src->nPitch, src->nPitch);
-		}
-	}
-	else if (src->binning == 2){   // duplicate to expand by 2x
-		for (i = 0, ii = 0; i < src->nRawHeight; i++, ii+=2) {
-
-			// For every source row we need to fill 2 rows of the destination
-//			GST_DEBUG_OBJECT (src, "copy_duplicate_data: row %d,%d nBytesPerPixel %d", i, ii, src->nBytesPerPixel);
-
-			guint8 *s_ptr = src->convertedImage.pData + i * src->nRawPitch; // source ptr
-			guint8 *d_ptr  = minfo->data + ii * src->gst_stride; // destination ptr
-
-			for (j = 0; j < src->nRawWidth; j++){   // Work in source space (smaller), increment destination in the loop
-
-				// For every source pixel we must fill 2 destination pixels on each of 2 rows
-				memcpy(d_ptr, s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->nBytesPerPixel, s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->gst_stride, s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->gst_stride+src->nBytesPerPixel, s_ptr, src->nBytesPerPixel);
-
-				s_ptr += src->nBytesPerPixel;
-				d_ptr += src->nBytesPerPixel*2;
-			}
-
-		}
-	}
-	else if (src->binning == 4){   // interpolate to expand by 4x, take care of image size is it is not exactly 4x, do that by iterating over the source, not destination
-
-		// Set ii here in case centring loop becomes commented
-		ii = 0;
-
-		// With 4x4 bin image will be small, try to centre it by filling rows with black
-		// Because of the part of the sensor used, this may displace the image wrt other binning modes
-		// To uncentre comment this loop
-		int nlines = (src->nHeight - (4*src->nRawHeight))/2;
-		for (ii = 0; ii < nlines; ii++) {
-			memset (minfo->data + ii * src->gst_stride, 0, src->nPitch);
-		}
-
-		for (i = 0; i < src->nRawHeight; i++, ii+=4) {   // NB starting ii set by above loop
-
-			// For every source row we need to fill 4 rows of the destination
-//			GST_DEBUG_OBJECT (src, "copy_duplicate_data: row %d,%d nBytesPerPixel %d", i, ii, src->nBytesPerPixel);
-
-			guint8 *s_ptr = src->convertedImage.pData + i * src->nRawPitch; // source ptr
-			guint8 *d_ptr = minfo->data + ii * src->gst_stride; // destination ptr
-
-			for (j = 0; j < src->nRawWidth; j++){   // Work in source space (smaller), increment destination in the loop
-
-				// For every source pixel we must fill 4 destination pixels on each of 4 rows
-
-				memcpy(d_ptr, s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->nBytesPerPixel,   s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->nBytesPerPixel*2, s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->nBytesPerPixel*3, s_ptr, src->nBytesPerPixel);
-
-				memcpy(d_ptr+src->gst_stride,                       s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->gst_stride+src->nBytesPerPixel,   s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->gst_stride+src->nBytesPerPixel*2, s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->gst_stride+src->nBytesPerPixel*3, s_ptr, src->nBytesPerPixel);
-
-				memcpy(d_ptr+src->gst_stride*2,                       s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->gst_stride*2+src->nBytesPerPixel,   s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->gst_stride*2+src->nBytesPerPixel*2, s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->gst_stride*2+src->nBytesPerPixel*3, s_ptr, src->nBytesPerPixel);
-
-				memcpy(d_ptr+src->gst_stride*3,                       s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->gst_stride*3+src->nBytesPerPixel,   s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->gst_stride*3+src->nBytesPerPixel*2, s_ptr, src->nBytesPerPixel);
-				memcpy(d_ptr+src->gst_stride*3+src->nBytesPerPixel*3, s_ptr, src->nBytesPerPixel);
-
-				s_ptr += src->nBytesPerPixel;
-				d_ptr += src->nBytesPerPixel*4;
-			}
-
-			// With 4x4 bin there will be some pixels at end of row to fill, always 8 pixels
-			memset(d_ptr,                     0, src->nBytesPerPixel*8);
-			memset(d_ptr+src->gst_stride*1,   0, src->nBytesPerPixel*8);
-			memset(d_ptr+src->gst_stride*2,   0, src->nBytesPerPixel*8);
-			memset(d_ptr+src->gst_stride*3,   0, src->nBytesPerPixel*8);
-
-		}
-
-		// With 4x4 bin there will be some pixels at end of cols to fill, keep generic for different cameras
-		if(ii < src->nHeight){
-			for (; ii < src->nHeight; ii++) {
-				memset (minfo->data + ii * src->gst_stride, 0, src->nPitch);
-			}
-		}
-
-	}
-}
-
 /* Copy and interpolate data from the possibly binned image
  *  into the full size image.
  *  I believe for 2x2 this does work out to be bi-linear interpolation.
@@ -1846,22 +4402,158 @@ overlay_param_changed(GstFlycapSrc *src, GstMapInfo *minfo)
 
 //  This can override the push class create fn, it is the same as fill above but it forces the creation of a buffer here to copy into.
 #ifdef OVERRIDE_CREATE
+/* Expand the camera image, or the average, into the buffer, and do any per frame options, in one pass */
+static void
+gst_flycap_fill_buffer (GstFlycapSrc * src, GstBuffer * buf, const guint8 * image, guint image_stride)
+{
+	GstMapInfo minfo;
+	FlycapKernelFrame frame;
+	GstFlycapStatsMeta *stats_meta = NULL;
+	FlycapKernelFunc kernel;
+	guint ops;
+
+	// Chosen on other threads when stats, flips or rotation change, hist must match the kernel called
+	GST_OBJECT_LOCK(src);
+	kernel = src->copy_kernel;
+	ops = src->kernel_ops;
+	GST_OBJECT_UNLOCK(src);
+
+	gst_buffer_map (buf, &minfo, GST_MAP_WRITE);
+
+	frame.src = image;
+	frame.src_stride = image_stride;
+	frame.src_width = src->nRawWidth;
+	frame.src_height = src->nRawHeight;
+	frame.dst = minfo.data;
+	frame.dst_stride = src->gst_stride;
+	frame.dst_width = src->out_width;
+	frame.dst_height = src->out_height;
+	frame.bytes_per_pixel = src->nBytesPerPixel;
+	frame.hist = NULL;
+	if (ops & FLYCAP_KERNEL_OP_STATS){
+		// Pre-trigger ring buffers are reused, so they already have one
+		stats_meta = gst_buffer_get_flycap_stats_meta(buf);
+		if (stats_meta)
+			memset(stats_meta->histogram, 0, sizeof(stats_meta->histogram));
+		else
+			stats_meta = gst_buffer_add_flycap_stats_meta(buf);
+		frame.hist = stats_meta->histogram;
+	}
+
+	kernel(&frame);
+
+	if (stats_meta)
+		gst_flycap_stats_meta_finish(stats_meta);
+
+	//copy_interpolate_data(src, &minfo);  // NOT WORKING, SEE ABOVE
+
+	// Normally this is commented out, useful for timing investigation
+	//overlay_param_changed(src, &minfo);
+
+	gst_buffer_unmap (buf, &minfo);
+}
+
+static void
+gst_flycap_timestamp_buffer (GstFlycapSrc * src, GstBuffer * buf)
+{
+	GstClockTime duration = src->frame_interval * src->accumulate;   // an average spans its frames, skipped frames are added as they go
+	GstClock *clock;
+
+	// If we do not use gst_base_src_set_do_timestamp() we need to add timestamps manually
+	src->last_frame_time += duration;   // Get the timestamp for this frame
+	if(!gst_base_src_get_do_timestamp(GST_BASE_SRC(src))){
+		GST_BUFFER_PTS(buf) = src->last_frame_time;  // convert ms to ns
+		GST_BUFFER_DTS(buf) = src->last_frame_time;  // convert ms to ns
+	}
+	else if (src->pretrigger_armed && (clock = gst_element_get_clock(GST_ELEMENT(src)))){
+		// Held frames are pushed later, basesrc would stamp them with the time they are sent
+		GST_BUFFER_PTS(buf) = gst_clock_get_time(clock) - gst_element_get_base_time(GST_ELEMENT(src));
+		GST_BUFFER_DTS(buf) = GST_BUFFER_PTS(buf);
+		gst_object_unref(clock);
+	}
+	GST_BUFFER_DURATION(buf) = duration * src->decimation;   // until the next buffer
+	//GST_DEBUG_OBJECT(src, "pts, dts: %" GST_TIME_FORMAT ", duration: %d ms", GST_TIME_ARGS (src->last_frame_time), GST_TIME_AS_MSECONDS(src->duration));
+
+	// count frames
+	GST_BUFFER_OFFSET(buf) = src->n_frames;  // from videotestsrc
+	src->n_frames++;
+	GST_BUFFER_OFFSET_END(buf) = src->n_frames;  // from videotestsrc
+}
+
+/* Controlled properties, e.g. an exposure ramp, take their values for now in stream time before
+ * each camera frame is retrieved, so a change reaches the camera as early as it can. Unchanged
+ * values do not reach the camera, see gst_flycap_src_unchanged.
+ */
+static void
+gst_flycap_sync_controlled (GstFlycapSrc * src)
+{
+	GstClock *clock;
+	GstClockTime running_time = src->last_frame_time;
+
+	if (!gst_object_has_active_control_bindings(GST_OBJECT(src)))
+		return;
+
+	if ((clock = gst_element_get_clock(GST_ELEMENT(src)))){
+		running_time = gst_clock_get_time(clock) - gst_element_get_base_time(GST_ELEMENT(src));
+		gst_object_unref(clock);
+	}
+	g_atomic_pointer_set(&src->syncing_thread, g_thread_self());
+	gst_object_sync_values(GST_OBJECT(src),
+			gst_segment_to_stream_time(&GST_BASE_SRC(src)->segment, GST_FORMAT_TIME, running_time));
+	g_atomic_pointer_set(&src->syncing_thread, NULL);
+}
+
 static GstFlowReturn
 gst_flycap_src_create (GstPushSrc * psrc, GstBuffer ** buf)
 {
 	GstFlycapSrc *src = GST_FLYCAP_SRC (psrc);
-	GstMapInfo minfo;
 	fc2Error error;
+	GstClockTime t_enter, t_retrieved, t_copied;
+	gint failures = 0, reconnects = 0;
+	guint8 *image;
+	guint image_stride;
+	guint64 frame_number;
+	gboolean hold;
+
+	// If we were asked for a specific number of buffers, stop when complete. Only buffers pushed
+	// count, held frames that were overwritten before the trigger do not.
+	if (psrc->parent.num_buffers > 0 && G_UNLIKELY(src->frames_delivered >= (guint64)psrc->parent.num_buffers))
+		return GST_FLOW_EOS;
+
+	// Frames held from before the trigger go first, oldest first, the SDK buffers new ones meanwhile
+	if (G_UNLIKELY(src->pretrigger_held > 0 && !src->pretrigger_armed)){
+		*buf = gst_flycap_pretrigger_pop(src);
+		GST_OBJECT_LOCK(src);
+		src->frames_delivered++;
+		GST_OBJECT_UNLOCK(src);
+		return GST_FLOW_OK;
+	}
+
+	do {
+		// A few ns each, always taken for the health counters
+		t_enter = gst_util_get_timestamp();
 
-	// Get image
+		gst_flycap_sync_controlled(src);
+
+		// Get image, skipping, retrying and reconnecting as needed so a lost image does not stop the pipeline
 //	GST_DEBUG_OBJECT (src, "fc2RetrieveBuffer");
 //	error = fc2RetrieveBuffer(src->deviceContext, &src->rawImage);
-	error = fc2RetrieveBuffer(src->deviceContext, &src->convertedImage);
+		while (G_UNLIKELY((error = fc2RetrieveBuffer(src->deviceContext, &src->convertedImage)) != FC2_ERROR_OK)){
+			GstFlowReturn ret = gst_flycap_retrieve_failed(src, error, &failures, &reconnects);
+			if (ret != GST_FLOW_OK)
+				return ret;
+		}
+
+		t_retrieved = gst_util_get_timestamp();
 
-	if(G_LIKELY(error == FC2_ERROR_OK))
-	{
 		//  successfully returned an image
 		// ----------------------------------------------------------
+		src->frames_retrieved++;
+		gst_flycap_measure_interval(src, t_retrieved);
+		if (src->embedded_info)
+			gst_flycap_embedded_info_decode(src);
+		if (G_UNLIKELY(g_atomic_int_get(&src->framerate_changed)))
+			gst_flycap_update_caps_framerate(src);
 
 //		reduce_raw16_bitdepth(&src->rawImage,  &src->tempImage);
 
@@ -1869,68 +4561,107 @@ gst_flycap_src_create (GstPushSrc * psrc, GstBuffer ** buf)
 		//GST_DEBUG_OBJECT (src, "fc2ConvertImageTo");
 //        error = fc2ConvertImageTo(FC2_PIXEL_FORMAT_BGR, &src->rawImage, &src->convertedImage);
 //        error = fc2ConvertImageTo(FC2_PIXEL_FORMAT_RGB, &src->tempImage, &src->convertedImage);
-        if ( error != FC2_ERROR_OK )
-        {
-    		GST_ERROR_OBJECT(src, "fc2ConvertImageTo() failed with a error: %d", error);
-    		return GST_FLOW_ERROR;
-        }
 
-        //GST_DEBUG_OBJECT (src, "rawImage format %x bayer %d", src->rawImage.format, src->rawImage.bayerFormat);
-        //GST_DEBUG_OBJECT (src, "convertedImage format %x bayer %d", src->convertedImage.format, src->convertedImage.bayerFormat);
+		//GST_DEBUG_OBJECT (src, "rawImage format %x bayer %d", src->rawImage.format, src->rawImage.bayerFormat);
+		//GST_DEBUG_OBJECT (src, "convertedImage format %x bayer %d", src->convertedImage.format, src->convertedImage.bayerFormat);
+
+		if (G_UNLIKELY(g_atomic_int_get(&src->calib_capture) >= 0))
+			gst_flycap_calibration_capture(src);
+
+		// Decimation, frames not used cost only the retrieve, their time still counts.
+		// Every camera frame is counted, so the phase holds from the start even if decimation was 1 until now.
+		frame_number = src->decimation_count++;
+		if (src->decimation > 1
+				&& frame_number % src->decimation != (guint64)(src->decimation_phase % src->decimation)){
+			src->last_frame_time += src->frame_interval;
+			if (gst_flycap_is_flushing(src))
+				return GST_FLOW_FLUSHING;
+			*buf = NULL;
+			failures = reconnects = 0;
+			continue;
+		}
 
-		// Create a new buffer for the image
-		*buf = gst_buffer_new_and_alloc (src->nHeight * src->gst_stride);
+		image = src->convertedImage.pData;
+		image_stride = src->nRawPitch;
+		if (src->accumulate > 1){
+			if (!gst_flycap_accumulate(src)){
+				if (gst_flycap_is_flushing(src))
+					return GST_FLOW_FLUSHING;
+				*buf = NULL;
+				failures = reconnects = 0;
+				continue;
+			}
+			image = src->acc_image;
+			image_stride = src->nRawWidth * src->nBytesPerPixel;
+		}
 
-		gst_buffer_map (*buf, &minfo, GST_MAP_WRITE);
+		if (src->calibration && (src->calib.dark || src->calib.gain)
+				&& flycap_calibration_matches(&src->calib, src->nRawWidth, src->nRawHeight, src->nBytesPerPixel))
+			flycap_kernel_calibrate(image, image_stride, src->nRawWidth * src->nBytesPerPixel, src->nRawHeight,
+					src->calib.dark, src->calib.gain);
+
+		// Hot pixels, only those listed are touched
+		if (src->calib.n_defects > 0
+				&& flycap_calibration_matches(&src->calib, src->nRawWidth, src->nRawHeight, src->nBytesPerPixel))
+			flycap_kernel_patch_defects(image, image_stride, src->nRawWidth, src->nRawHeight, src->nBytesPerPixel,
+					src->calib.defects, src->calib.n_defects);
+
+		// Copy into the next ring buffer while waiting for the trigger, or a new buffer to push
+		hold = src->pretrigger_armed;
+		if (G_UNLIKELY(hold))
+			*buf = gst_flycap_pretrigger_slot(src);
+		else
+			*buf = gst_buffer_new_and_alloc (src->out_height * src->gst_stride);
 
-		copy_duplicate_data(src, &minfo);
-		//copy_interpolate_data(src, &minfo);  // NOT WORKING, SEE ABOVE
+		gst_flycap_fill_buffer(src, *buf, image, image_stride);
+		if (src->embedded_info)
+			gst_flycap_embedded_info_attach(src, *buf);
 
-		// Normally this is commented out, useful for timing investigation
-		//overlay_param_changed(src, &minfo);
+		t_copied = gst_util_get_timestamp();
 
-		gst_buffer_unmap (*buf, &minfo);
+		gst_flycap_timestamp_buffer(src, *buf);
 
-		// If we do not use gst_base_src_set_do_timestamp() we need to add timestamps manually
-		src->last_frame_time += src->duration;   // Get the timestamp for this frame
-		if(!gst_base_src_get_do_timestamp(GST_BASE_SRC(psrc))){
-			GST_BUFFER_PTS(*buf) = src->last_frame_time;  // convert ms to ns
-			GST_BUFFER_DTS(*buf) = src->last_frame_time;  // convert ms to ns
-		}
-		GST_BUFFER_DURATION(*buf) = src->duration;
-		//GST_DEBUG_OBJECT(src, "pts, dts: %" GST_TIME_FORMAT ", duration: %d ms", GST_TIME_ARGS (src->last_frame_time), GST_TIME_AS_MSECONDS(src->duration));
+		if (G_UNLIKELY(src->preview_pad != NULL))
+			gst_flycap_preview_push(src, image, image_stride, *buf);
 
-		// count frames, and send EOS when required frame number is reached
-		GST_BUFFER_OFFSET(*buf) = src->n_frames;  // from videotestsrc
-		src->n_frames++;
-		GST_BUFFER_OFFSET_END(*buf) = src->n_frames;  // from videotestsrc
-		if (psrc->parent.num_buffers>0)  // If we were asked for a specific number of buffers, stop when complete
-			if (G_UNLIKELY(src->n_frames >= psrc->parent.num_buffers))
-				return GST_FLOW_EOS;
-	}
-	else
-	{
-		// did not return an image. why?
-		// ----------------------------------------------------------
-		GST_ERROR_OBJECT(src, "fc2RetrieveBuffer() failed with a error: %d", error);
-		return GST_FLOW_ERROR;
-	}
+		if (src->host_ae)
+			gst_flycap_host_ae_update(src);
 
-	if (G_UNLIKELY(src->WB_in_progress)){
-		if (gst_flycap_check_WB_onepush(src, NULL, NULL)==FALSE){
-			src->WB_in_progress = FALSE;
-			src->WB_progress=0;
+		if (G_UNLIKELY(src->WB_in_progress)){
+			if (gst_flycap_check_WB_onepush(src, NULL, NULL)==FALSE){
+				src->WB_in_progress = FALSE;
+				src->WB_progress=0;
+			}
+			else
+				src->WB_progress--;
+
+			if (src->WB_progress<0){
+				// Try to abort the WB, next gst_flycap_check_WB_onepush should return FALSE
+				// This will reset the WB to the default
+				GST_DEBUG_OBJECT (src, "Aborting WB");
+				gst_flycap_set_property_WB_manual(src);
+			}
 		}
-		else
-			src->WB_progress--;
 
-		if (src->WB_progress<0){
-			// Try to abort the WB, next gst_flycap_check_WB_onepush should return FALSE
-			// This will reset the WB to the default
-			GST_DEBUG_OBJECT (src, "Aborting WB");
-			gst_flycap_set_property_WB_manual(src);
+		if (G_UNLIKELY(hold)){
+			GstFlowReturn ret;
+
+			// The ring keeps the buffer, until the trigger there is nothing to push
+			*buf = NULL;
+			ret = gst_flycap_pretrigger_check(src);
+			if (ret != GST_FLOW_OK)
+				return ret;
+			failures = reconnects = 0;
+			if (!src->pretrigger_armed){
+				*buf = gst_flycap_pretrigger_pop(src);
+				t_copied = gst_util_get_timestamp();
+			}
 		}
-	}
+	} while (G_UNLIKELY(*buf == NULL));
+
+	gst_flycap_health_update(src, t_enter, t_retrieved, t_copied);
+	if (src->latency_tracing)
+		gst_flycap_latency_update(src, t_enter, t_retrieved, t_copied);
 
 	return GST_FLOW_OK;
 }
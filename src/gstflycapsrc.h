@@ -24,6 +24,11 @@
 
 #include "FlyCapture2_C.h"
 
+#include "gstflycapkernel.h"
+#include "gstflycaplatency.h"
+#include "gstflycapstate.h"
+#include "gstflycapcalib.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_FLYCAP_SRC   (gst_flycap_src_get_type())
@@ -50,6 +55,38 @@ typedef enum
 	GST_LUT_GAMMA
 } LUTType;
 
+typedef enum
+{
+	GST_ROTATION_0,
+	GST_ROTATION_90,
+	GST_ROTATION_180,
+	GST_ROTATION_270
+} RotationType;
+
+// Parts of gst_flycap_src_start that are timed, see the startup-stats property
+typedef enum
+{
+	FLYCAP_STARTUP_CONNECT,     // find and connect the camera
+	FLYCAP_STARTUP_CONFIGURE,   // SDK configuration and image buffers
+	FLYCAP_STARTUP_PROFILE,     // restore the profile memory channel
+	FLYCAP_STARTUP_READ,        // read the camera's property values
+	FLYCAP_STARTUP_MODE,        // Format7 video mode for the binning
+	FLYCAP_STARTUP_CONTROLS,    // properties, strobe, mirror and ROI registers
+	FLYCAP_STARTUP_LUTS,        // LUT tables and bank
+	FLYCAP_STARTUP_N
+} FlycapStartupPhase;
+
+// A setting the camera embeds in each frame, see gst_flycap_embedded_info_decode
+typedef struct
+{
+  guint32 raw;                 // register value the frames show, 12 bits
+  gfloat value;                // and what it means, exposure ms or linear gain
+  gboolean pending;            // written, no frame has it yet
+  guint32 pending_raw;
+  gfloat pending_value;
+  guint32 written_at;          // the last camera frame before the write
+} FlycapEmbeddedSetting;
+
 struct _GstFlycapSrc
 {
   GstPushSrc base_flycap_src;
@@ -73,10 +110,18 @@ struct _GstFlycapSrc
   unsigned int nRawPitch;  // because of binning the raw image size may be smaller than nHeight
 
   gint gst_stride;  // Stride/pitch for the GStreamer buffer
+  unsigned int out_width;   // negotiated image size, width and height are swapped from nWidth and nHeight when rotated by 90 or 270
+  unsigned int out_height;
+
+  FlycapKernelFunc copy_kernel;  // copy specialisation for the binning, pixel size and options, see gst_flycap_select_kernel
+  guint kernel_ops;              // FlycapKernelOps the kernel was chosen for
 
   // gst properties
   gint pixelclock;
   gfloat exposure;     // ms
+  gfloat exposure_requested;   // last set, exposure is what the camera made of it
+  gfloat exposure_written;     // exposure after that, see gst_flycap_src_unchanged
+  gpointer syncing_thread;     // GThread syncing controlled properties, atomic, see gst_flycap_src_unchanged
   gfloat framerate;
   gfloat maxframerate;
   gint gain;           // dB
@@ -87,8 +132,10 @@ struct _GstFlycapSrc
   gint binning;
   gint saturation;
   gint sharpness;
-  gint vflip;
-  gint hflip;
+  gboolean vflip;
+  gboolean hflip;
+  gboolean hflip_in_camera;  // hflip is done by the camera mirror register, not in the copy
+  RotationType rotation;
   WhiteBalanceType whitebalance;
   gboolean WB_in_progress;   // will be >0 when WB in progress, value will be number of frames until we abort WB
   gint WB_progress;   // will be >0 when WB in progress, value will be number of frames until we abort WB
@@ -100,6 +147,105 @@ struct _GstFlycapSrc
   gdouble lut_linearcutoff[2];
   gdouble lut_outputoffset[2];
   gfloat gamma;
+  gint ae_roi_left;    // AE/WB region of interest in sensor pixels
+  gint ae_roi_top;
+  gint ae_roi_width;   // 0 = central fifth of the frame
+  gint ae_roi_height;
+  unsigned int roi_base;  // cached offset to the ROI registers, 0 until read from 0x1A74
+  unsigned int roi_left_unit, roi_top_unit, roi_width_unit, roi_height_unit;
+
+  // host side auto exposure
+  gboolean host_ae;
+  gint host_ae_target;         // 8-bit level for the percentile
+  gdouble host_ae_percentile;
+  gfloat host_ae_max_exposure; // ms, gain is raised beyond this
+  gint host_ae_interval;       // ms between camera writes
+  gint64 host_ae_last_write;   // monotonic time (us) of the last write
+  gint host_ae_settle;         // frames to skip while a change lands
+
+  gboolean stats;              // attach GstFlycapStatsMeta to each buffer
+
+  // pre-trigger ring, see gst_flycap_pretrigger_alloc
+  gdouble pretrigger_seconds;  // 0 for off
+  GstBuffer **pretrigger_ring; // allocated with the caps, frames are copied into these while armed
+  guint pretrigger_slots;
+  guint pretrigger_next;       // slot for the next frame
+  guint pretrigger_held;       // frames in the ring
+  guint64 pretrigger_bytes;
+  gboolean pretrigger_armed;   // holding frames, nothing is pushed
+  gboolean triggered;          // from the trigger signal, protected by the object lock
+
+  // frame averaging, see gst_flycap_accumulate
+  gint accumulate;             // camera frames in each buffer, 1 for off
+  guint16 *acc;                // sums of the camera images so far, no row padding
+  guint8 *acc_image;           // the average, in the camera image layout
+  gsize acc_size;              // samples in acc
+  gint acc_count;              // frames in acc
+
+  // frame decimation, see gst_flycap_src_create
+  gint decimation;             // one camera frame in this many is used
+  gint decimation_phase;       // which one
+  guint64 decimation_count;    // camera frames since the start
+
+  // dark and flat field correction, see gst_flycap_calibration_capture
+  gboolean calibration;        // apply the references there are
+  gint calibration_frames;     // camera frames averaged into a reference
+  gchar *calibration_dir;      // NULL for the user data directory
+  FlycapCalibration calib;     // for the current camera and binning
+  guint defect_threshold;      // levels above the dark mean for a hot pixel, 0 for off
+  gint calib_capture;          // FlycapCalibrationType being captured, -1 for none, atomic
+  guint16 *calib_acc;          // sums of the camera images for the reference
+  gsize calib_acc_size;
+  gint calib_count;
+
+  // preview request pad, see gst_flycap_preview_push
+  GstPad *preview_pad;         // NULL until requested, protected by the object lock
+  gulong preview_probe;        // on the main pad, passes EOS and flushes on
+  gint preview_scale;          // of the sensor size, a power of two
+  gdouble preview_framerate;   // maximum, 0 for every buffer
+  GstCaps *preview_caps;       // protected by the object lock
+  guint preview_width;
+  guint preview_height;
+  gint preview_stride;
+  guint preview_factor;        // box filter of the camera image, 1 for none
+  guint preview_kernel_binning;
+  FlycapKernelFunc preview_kernel;
+  guint8 *preview_image;       // the box filtered camera image
+  guint16 *preview_row;        // row sums for the box filter
+  gboolean preview_started;    // stream-start sent
+  gboolean preview_caps_sent;  // caps and segment sent
+  GstClockTime preview_last;   // when the last preview was pushed
+  GstBuffer *preview_pending;  // made in create, pushed by the preview pad's task, protected by the object lock
+  gboolean preview_eos;        // pushed by the task after any pending buffer
+  gboolean preview_flushing;   // the task stops waiting and pauses
+  GCond preview_cond;          // with the object lock, wakes the preview task
+
+  // per stage timing, see gstflycaplatency.h
+  gboolean latency_tracing;
+  gint latency_interval;       // ms between flycap-latency element messages, 0 for none
+  FlycapLatencyHistogram latency_hist[FLYCAP_STAGE_N];   // protected by the object lock, retrieve and copy are always filled for the health counters
+  GstClockTime latency_window_start;
+  GstClockTime last_create_exit;   // when create last returned a buffer, GST_CLOCK_TIME_NONE at the start
+  GstStructure *latency_last;      // the last complete interval, for the latency-stats property
+
+  // throughput and health counters, see gst_flycap_health_update
+  gint health_interval;        // ms between flycap-health messages, 0 for none
+  guint64 frames_retrieved;    // fc2RetrieveBuffer returned an image
+  guint64 frames_delivered;    // buffers returned from create
+  guint64 retrieve_errors;     // fc2RetrieveBuffer failures, other than consistency errors
+  guint64 consistency_errors;  // FC2_ERROR_IMAGE_CONSISTENCY_ERROR, an incomplete image
+  fc2CameraStats camera_stats; // from fc2GetStats at the last update
+  GstClockTime health_window_start;
+  guint64 health_window_frames;
+  gdouble fps;                 // measured over the last window
+  GstStructure *health_last;   // the last complete window, for the health property
+
+  // latency reported to the pipeline, see gst_flycap_update_latency
+  gdouble transfer_rate;       // bytes/s the camera sends at the current packet size
+  unsigned int sdk_buffers;    // frames the SDK can hold, from fc2GetConfiguration
+  gboolean sdk_drop_frames;    // FC2_DROP_FRAMES grab mode, only the newest frame is kept
+  GstClockTime min_latency;
+  GstClockTime max_latency;
 
   gboolean exposure_just_changed;
   gboolean gain_just_changed;
@@ -108,14 +254,65 @@ struct _GstFlycapSrc
   // stream
   gboolean acq_started;
   gint n_frames;
-  gint total_timeouts;
-  GstClockTime duration;
+  guint64 total_timeouts;      // fc2RetrieveBuffer gave up waiting for an image
+
+  // recovery from retrieve failures, see gst_flycap_retrieve_failed
+  gint retrieve_timeout;       // ms the SDK waits for an image, -1 for ever
+  gint grab_timeout;           // ms, as last set in the SDK, see gst_flycap_update_grab_timeout
+  gint retry_limit;            // failures in a row before reconnecting
+  gint reconnect_limit;        // reconnect attempts before giving up
+  guint64 reconnects;
+  gboolean flushing;           // unlock was called, stop waiting to retry
+  GCond retry_cond;            // with the object lock, wakes the retry wait on unlock or camera arrival
+  FlycapCameraState applied;   // everything written to the camera, replayed after a reconnect
+  fc2CallbackHandle arrival_callback;
+  fc2CallbackHandle removal_callback;
+  gboolean camera_removed;     // from the bus callbacks, protected by the object lock
+  gboolean camera_arrived;
+  GstClockTime reconnect_time; // how long the last reconnect took
+  guint reconnect_writes;      // and how many settings the camera had lost
+
+  // startup, see gst_flycap_apply_camera_settings
+  gint profile;                // memory channel restored on start, 0 to send every setting from the host
+  gboolean starting;           // settings are compared with the camera before they are written
+  FlycapPropertyCache camera_props;   // the camera's own values, only held while starting
+  GstClockTime startup_time[FLYCAP_STARTUP_N];
+  guint startup_checked;       // settings compared with the camera
+  guint startup_written;       // of those, the ones it did not already have
+  GstClockTime duration;       // nominal, from the frame rate the camera reports
   GstClockTime last_frame_time;
+
+  // frame rate, see gst_flycap_read_framerate
+  GstClockTime frame_interval; // measured between camera frames, smoothed
+  GstClockTime last_retrieved; // host time of the last camera frame
+  guint interval_outliers;     // frame intervals in a row too far from frame_interval to use
+  gint fps_n;                  // in the caps
+  gint fps_d;
+  gint framerate_changed;      // the caps may need updating, atomic
+  gfloat reported_framerate;   // last read from the camera
+  GstClockTime caps_update_time;   // host time of the last frame rate caps event
+
+  // embedded image information, see gst_flycap_embedded_info_enable
+  gboolean embedded_info;      // decode it and attach GstFlycapInfoMeta
+  gint info_shutter_word;      // 32-bit word of the image it is in, -1 if the camera does not embed it
+  gint info_gain_word;
+  gint info_counter_word;
+  guint32 info_frame;          // camera frame counter of the last frame retrieved
+  FlycapEmbeddedSetting info_shutter;   // protected by the object lock
+  FlycapEmbeddedSetting info_gain;
+  guint settle_frames;         // camera frames the last change took to reach a frame
 };
 
 struct _GstFlycapSrcClass
 {
   GstPushSrcClass base_flycap_src_class;
+
+  // action signals
+  gboolean (*save_profile) (GstFlycapSrc * src, guint channel);
+  gboolean (*load_profile) (GstFlycapSrc * src, guint channel);
+  gboolean (*trigger) (GstFlycapSrc * src);
+  gboolean (*capture_dark) (GstFlycapSrc * src);
+  gboolean (*capture_flat) (GstFlycapSrc * src);
 };
 
 GType gst_flycap_src_get_type (void);
@@ -0,0 +1,374 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015-2016 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ *
+ */
+/*
+ * Snapshot of the camera configuration flycapsrc has applied.
+ * Every write to the camera is recorded here as well, replaying reads each setting
+ * back from the camera and only writes the ones that differ. A camera that has only
+ * seen a bus reset needs no writes, one that has been power cycled gets everything.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h> // for memset, memcmp
+
+#include "gstflycapstate.h"
+
+void
+flycap_state_reset (FlycapCameraState *state)
+{
+	memset (state, 0, sizeof (*state));
+}
+
+/* Restoring a memory channel sets every property and the strobe, so what was recorded
+ * before it no longer applies. Video mode, LUTs and registers are not in the channel. */
+void
+flycap_state_set_profile (FlycapCameraState *state, unsigned int channel)
+{
+	state->profile = channel;
+	memset (state->prop_fields, 0, sizeof (state->prop_fields));
+	state->n_props = 0;
+	state->strobe_set = FALSE;
+}
+
+void
+flycap_state_set_property (FlycapCameraState *state, const fc2Property *prop, guint fields)
+{
+	guint type = prop->type, i;
+
+	g_return_if_fail (type < FLYCAP_STATE_N_PROPERTIES);
+
+	// Move it to the end of the order, it was set after everything else
+	for (i = 0; i < state->n_props; i++) {
+		if (state->prop_order[i] == type) {
+			memmove (&state->prop_order[i], &state->prop_order[i + 1], state->n_props - i - 1);
+			state->n_props--;
+			break;
+		}
+	}
+	state->prop_order[state->n_props++] = type;
+
+	state->props[type] = *prop;
+	state->prop_fields[type] = fields;
+}
+
+/* Copy the fields we set from want into prop, leaving the rest as the camera has them */
+void
+flycap_state_merge_property (fc2Property *prop, const fc2Property *want, guint fields)
+{
+	prop->type = want->type;
+	if (fields & FLYCAP_FIELD_ON_OFF)
+		prop->onOff = want->onOff;
+	if (fields & FLYCAP_FIELD_AUTO)
+		prop->autoManualMode = want->autoManualMode;
+	if (fields & FLYCAP_FIELD_ABS_CONTROL)
+		prop->absControl = want->absControl;
+	if (fields & FLYCAP_FIELD_ABS_VALUE)
+		prop->absValue = want->absValue;
+	if (fields & FLYCAP_FIELD_VALUE_A)
+		prop->valueA = want->valueA;
+	if (fields & FLYCAP_FIELD_VALUE_B)
+		prop->valueB = want->valueB;
+	prop->onePush = FALSE;
+}
+
+/* Absolute values come back rounded to what the camera can do, so allow a little */
+static gboolean
+abs_value_equal (float a, float b)
+{
+	return fabs (a - b) <= 1e-4 + 1e-4 * fabs (b);
+}
+
+gboolean
+flycap_state_property_matches (const fc2Property *prop, const fc2Property *want, guint fields)
+{
+	if ((fields & FLYCAP_FIELD_ON_OFF) && !prop->onOff != !want->onOff)
+		return FALSE;
+	if ((fields & FLYCAP_FIELD_AUTO) && !prop->autoManualMode != !want->autoManualMode)
+		return FALSE;
+	if ((fields & FLYCAP_FIELD_ABS_CONTROL) && !prop->absControl != !want->absControl)
+		return FALSE;
+	// Values do not matter while the camera is adjusting them itself
+	if (want->autoManualMode && (fields & FLYCAP_FIELD_AUTO))
+		return TRUE;
+	if ((fields & FLYCAP_FIELD_ABS_VALUE) && !abs_value_equal (prop->absValue, want->absValue))
+		return FALSE;
+	if ((fields & FLYCAP_FIELD_VALUE_A) && prop->valueA != want->valueA)
+		return FALSE;
+	if ((fields & FLYCAP_FIELD_VALUE_B) && prop->valueB != want->valueB)
+		return FALSE;
+
+	return TRUE;
+}
+
+gboolean
+flycap_state_format7_matches (const fc2Format7ImageSettings *a, unsigned int a_packet_size,
+		const fc2Format7ImageSettings *b, unsigned int b_packet_size)
+{
+	return a->mode == b->mode
+			&& a->offsetX == b->offsetX && a->offsetY == b->offsetY
+			&& a->width == b->width && a->height == b->height
+			&& a->pixelFormat == b->pixelFormat
+			&& a_packet_size == b_packet_size;
+}
+
+void
+flycap_state_set_register (FlycapCameraState *state, unsigned int address, unsigned int value)
+{
+	guint i;
+
+	for (i = 0; i < state->n_regs; i++) {
+		if (state->regs[i].address == address) {
+			state->regs[i].value = value;
+			return;
+		}
+	}
+
+	g_return_if_fail (state->n_regs < FLYCAP_STATE_N_REGISTERS);
+	state->regs[state->n_regs].address = address;
+	state->regs[state->n_regs].value = value;
+	state->n_regs++;
+}
+
+void
+flycap_state_set_format7 (FlycapCameraState *state, const fc2Format7ImageSettings *settings, unsigned int packet_size)
+{
+	state->format7_set = TRUE;
+	state->format7 = *settings;
+	state->packet_size = packet_size;
+}
+
+void
+flycap_state_set_lut (FlycapCameraState *state, guint bank, guint channel, const unsigned int *lut)
+{
+	g_return_if_fail (bank < 2 && channel < 3);
+
+	memcpy (state->lut[bank][channel], lut, sizeof (state->lut[bank][channel]));
+	state->lut_set |= 1 << (bank * 3 + channel);
+}
+
+void
+flycap_state_set_lut_bank (FlycapCameraState *state, gboolean enabled, unsigned int bank)
+{
+	state->lut_bank_set = TRUE;
+	state->lut_enabled = enabled;
+	state->lut_bank = bank;
+}
+
+void
+flycap_state_set_strobe (FlycapCameraState *state, const fc2StrobeControl *strobe)
+{
+	state->strobe_set = TRUE;
+	state->strobe = *strobe;
+}
+
+void
+flycap_property_cache_reset (FlycapPropertyCache *cache)
+{
+	cache->valid = 0;
+}
+
+/* Read the given properties in one pass, returns how many the camera has */
+guint
+flycap_property_cache_read (FlycapPropertyCache *cache, fc2Context context, const fc2PropertyType *types, guint n_types)
+{
+	fc2Property prop;
+	guint i, n = 0;
+
+	for (i = 0; i < n_types; i++) {
+		memset (&prop, 0, sizeof (prop));
+		prop.type = types[i];
+		prop.absControl = TRUE;   // as gst_flycap_get_property_absVal, so absValue is filled in
+		if (fc2GetProperty (context, &prop) != FC2_ERROR_OK || !prop.present)
+			continue;
+		flycap_property_cache_store (cache, &prop);
+		n++;
+	}
+
+	return n;
+}
+
+const fc2Property *
+flycap_property_cache_lookup (const FlycapPropertyCache *cache, fc2PropertyType type)
+{
+	if (type >= FLYCAP_STATE_N_PROPERTIES || !(cache->valid & (1u << type)))
+		return NULL;
+
+	return &cache->props[type];
+}
+
+void
+flycap_property_cache_store (FlycapPropertyCache *cache, const fc2Property *prop)
+{
+	g_return_if_fail (prop->type < FLYCAP_STATE_N_PROPERTIES);
+
+	cache->props[prop->type] = *prop;
+	cache->valid |= 1u << prop->type;
+}
+
+void
+flycap_property_cache_drop (FlycapPropertyCache *cache, fc2PropertyType type)
+{
+	if (type < FLYCAP_STATE_N_PROPERTIES)
+		cache->valid &= ~(1u << type);
+}
+
+// Count the write and keep the first error, carry on so as much as possible is restored
+#define REPLAY_WRITE(result, function) \
+{\
+	fc2Error err = function;\
+	(result)->written++;\
+	if (err != FC2_ERROR_OK && (result)->error == FC2_ERROR_OK)\
+		(result)->error = err;\
+}
+
+static void
+replay_format7 (const FlycapCameraState *state, fc2Context context, FlycapReplayResult *result)
+{
+	fc2Format7ImageSettings current;
+	unsigned int packet_size = 0;
+	float percentage;
+
+	if (!state->format7_set)
+		return;
+
+	result->checked++;
+	if (fc2GetFormat7Configuration (context, &current, &packet_size, &percentage) == FC2_ERROR_OK
+			&& flycap_state_format7_matches (&current, packet_size, &state->format7, state->packet_size))
+		return;
+
+	REPLAY_WRITE (result, fc2SetFormat7ConfigurationPacket (context, (fc2Format7ImageSettings *) &state->format7, state->packet_size));
+}
+
+static void
+replay_luts (const FlycapCameraState *state, fc2Context context, FlycapReplayResult *result)
+{
+	unsigned int lut[FLYCAP_STATE_LUT_ENTRIES], bank, channel;
+	fc2LUTData info;
+
+	for (bank = 0; bank < 2; bank++) {
+		for (channel = 0; channel < 3; channel++) {
+			if (!(state->lut_set & (1 << (bank * 3 + channel))))
+				continue;
+
+			result->checked++;
+			if (fc2GetLUTChannel (context, bank, channel, FLYCAP_STATE_LUT_ENTRIES, lut) == FC2_ERROR_OK
+					&& memcmp (lut, state->lut[bank][channel], sizeof (lut)) == 0)
+				continue;
+
+			REPLAY_WRITE (result, fc2SetLUTChannel (context, bank, channel, FLYCAP_STATE_LUT_ENTRIES,
+					(unsigned int *) state->lut[bank][channel]));
+		}
+	}
+
+	if (state->lut_bank_set) {
+		result->checked++;
+		if (fc2GetLUTInfo (context, &info) != FC2_ERROR_OK || !info.enabled != !state->lut_enabled)
+			REPLAY_WRITE (result, fc2EnableLUT (context, state->lut_enabled));
+
+		if (state->lut_enabled) {
+			result->checked++;
+			if (fc2GetActiveLUTBank (context, &bank) != FC2_ERROR_OK || bank != state->lut_bank)
+				REPLAY_WRITE (result, fc2SetActiveLUTBank (context, state->lut_bank));
+		}
+	}
+}
+
+static void
+replay_properties (const FlycapCameraState *state, fc2Context context, FlycapReplayResult *result)
+{
+	fc2Property prop;
+	guint i, type, fields;
+
+	for (i = 0; i < state->n_props; i++) {
+		type = state->prop_order[i];
+		fields = state->prop_fields[type];
+
+		result->checked++;
+		memset (&prop, 0, sizeof (prop));
+		prop.type = type;
+		if (fc2GetProperty (context, &prop) == FC2_ERROR_OK
+				&& flycap_state_property_matches (&prop, &state->props[type], fields))
+			continue;
+
+		flycap_state_merge_property (&prop, &state->props[type], fields);
+		REPLAY_WRITE (result, fc2SetProperty (context, &prop));
+	}
+}
+
+static void
+replay_strobe (const FlycapCameraState *state, fc2Context context, FlycapReplayResult *result)
+{
+	fc2StrobeControl current;
+
+	if (!state->strobe_set)
+		return;
+
+	result->checked++;
+	memset (&current, 0, sizeof (current));
+	current.source = state->strobe.source;
+	if (fc2GetStrobe (context, &current) == FC2_ERROR_OK
+			&& !current.onOff == !state->strobe.onOff
+			&& current.polarity == state->strobe.polarity
+			&& abs_value_equal (current.delay, state->strobe.delay)
+			&& abs_value_equal (current.duration, state->strobe.duration))
+		return;
+
+	REPLAY_WRITE (result, fc2SetStrobe (context, (fc2StrobeControl *) &state->strobe));
+}
+
+static void
+replay_registers (const FlycapCameraState *state, fc2Context context, FlycapReplayResult *result)
+{
+	unsigned int value;
+	guint i;
+
+	for (i = 0; i < state->n_regs; i++) {
+		result->checked++;
+		if (fc2ReadRegister (context, state->regs[i].address, &value) == FC2_ERROR_OK
+				&& value == state->regs[i].value)
+			continue;
+
+		REPLAY_WRITE (result, fc2WriteRegister (context, state->regs[i].address, state->regs[i].value));
+	}
+}
+
+/* Bring the camera back to the snapshot, writing only what differs. Call with capture stopped,
+ * in the order the element first applies things: profile, video mode, LUTs, properties, strobe, registers.
+ * A profile cannot be compared, it is always restored. */
+void
+flycap_state_replay (const FlycapCameraState *state, fc2Context context, FlycapReplayResult *result)
+{
+	memset (result, 0, sizeof (*result));
+	result->error = FC2_ERROR_OK;
+
+	if (state->profile) {
+		result->checked++;
+		REPLAY_WRITE (result, fc2RestoreFromMemoryChannel (context, state->profile));
+	}
+
+	replay_format7 (state, context, result);
+	replay_luts (state, context, result);
+	replay_properties (state, context, result);
+	replay_strobe (state, context, result);
+	replay_registers (state, context, result);
+}
@@ -0,0 +1,120 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _GST_FLYCAP_STATE_H_
+#define _GST_FLYCAP_STATE_H_
+
+#include <glib.h>
+
+#include "FlyCapture2_C.h"
+
+G_BEGIN_DECLS
+
+#define FLYCAP_STATE_N_PROPERTIES  FC2_UNSPECIFIED_PROPERTY_TYPE
+#define FLYCAP_STATE_N_REGISTERS   8     // the mirror and ROI registers are all we write
+#define FLYCAP_STATE_LUT_ENTRIES   512
+
+// Which fields of an fc2Property we set, the camera owns the rest
+typedef enum
+{
+	FLYCAP_FIELD_ON_OFF      = (1 << 0),
+	FLYCAP_FIELD_AUTO        = (1 << 1),
+	FLYCAP_FIELD_ABS_CONTROL = (1 << 2),
+	FLYCAP_FIELD_ABS_VALUE   = (1 << 3),
+	FLYCAP_FIELD_VALUE_A     = (1 << 4),
+	FLYCAP_FIELD_VALUE_B     = (1 << 5)
+} FlycapPropertyFields;
+
+typedef struct
+{
+	unsigned int address;
+	unsigned int value;
+} FlycapRegister;
+
+/* What the element has asked the camera for, so a reconnected camera can be brought back
+ * by writing only what it does not already have. Properties keep the order they were set in,
+ * some depend on others, e.g. the shutter range depends on the frame rate being off.
+ */
+typedef struct
+{
+	unsigned int profile;         // memory channel restored first, 0 if none
+
+	fc2Property props[FLYCAP_STATE_N_PROPERTIES];
+	guint prop_fields[FLYCAP_STATE_N_PROPERTIES];   // 0 if not set
+	guint8 prop_order[FLYCAP_STATE_N_PROPERTIES];
+	guint n_props;
+
+	FlycapRegister regs[FLYCAP_STATE_N_REGISTERS];
+	guint n_regs;
+
+	gboolean format7_set;
+	fc2Format7ImageSettings format7;
+	unsigned int packet_size;
+
+	guint lut_set;                // bit per bank * 3 + channel
+	unsigned int lut[2][3][FLYCAP_STATE_LUT_ENTRIES];
+	gboolean lut_bank_set;
+	gboolean lut_enabled;
+	unsigned int lut_bank;
+
+	gboolean strobe_set;
+	fc2StrobeControl strobe;
+} FlycapCameraState;
+
+/* The camera's own property values, read once at startup so each setting can be compared with
+ * the camera without another read. Entries are dropped when written, the camera may round them.
+ */
+typedef struct
+{
+	fc2Property props[FLYCAP_STATE_N_PROPERTIES];
+	guint32 valid;    // bit per property type
+} FlycapPropertyCache;
+
+// What a replay did
+typedef struct
+{
+	guint checked;    // settings compared with the camera
+	guint written;    // of those, the ones that differed
+	fc2Error error;   // the first error, FC2_ERROR_OK if none
+} FlycapReplayResult;
+
+void flycap_state_reset (FlycapCameraState *state);
+void flycap_state_set_profile (FlycapCameraState *state, unsigned int channel);
+void flycap_state_set_property (FlycapCameraState *state, const fc2Property *prop, guint fields);
+void flycap_state_merge_property (fc2Property *prop, const fc2Property *want, guint fields);
+gboolean flycap_state_property_matches (const fc2Property *prop, const fc2Property *want, guint fields);
+gboolean flycap_state_format7_matches (const fc2Format7ImageSettings *a, unsigned int a_packet_size,
+		const fc2Format7ImageSettings *b, unsigned int b_packet_size);
+void flycap_state_set_register (FlycapCameraState *state, unsigned int address, unsigned int value);
+void flycap_state_set_format7 (FlycapCameraState *state, const fc2Format7ImageSettings *settings, unsigned int packet_size);
+void flycap_state_set_lut (FlycapCameraState *state, guint bank, guint channel, const unsigned int *lut);
+void flycap_state_set_lut_bank (FlycapCameraState *state, gboolean enabled, unsigned int bank);
+void flycap_state_set_strobe (FlycapCameraState *state, const fc2StrobeControl *strobe);
+
+void flycap_property_cache_reset (FlycapPropertyCache *cache);
+guint flycap_property_cache_read (FlycapPropertyCache *cache, fc2Context context, const fc2PropertyType *types, guint n_types);
+const fc2Property *flycap_property_cache_lookup (const FlycapPropertyCache *cache, fc2PropertyType type);
+void flycap_property_cache_store (FlycapPropertyCache *cache, const fc2Property *prop);
+void flycap_property_cache_drop (FlycapPropertyCache *cache, fc2PropertyType type);
+
+void flycap_state_replay (const FlycapCameraState *state, fc2Context context, FlycapReplayResult *result);
+
+G_END_DECLS
+
+#endif
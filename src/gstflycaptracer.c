@@ -0,0 +1,116 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015-2016 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ *
+ */
+/*
+ * flycaplatency tracer, writes the flycapsrc stage timing into the tracer log
+ * so it sits alongside the latency and stats tracers from GStreamer core.
+ * The element does the measuring, this only watches for its element messages.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstflycaptracer.h"
+
+#ifdef FLYCAP_HAVE_TRACER
+
+#include "gstflycaplatency.h"
+
+G_DEFINE_TYPE (GstFlycapLatencyTracer, gst_flycap_latency_tracer, GST_TYPE_TRACER);
+
+static GstTracerRecord *tr_stage;
+
+static void
+do_post_message_pre (GstTracer * self, guint64 ts, GstElement * element, GstMessage * message)
+{
+	const GstStructure *s;
+	gchar *name;
+	guint stage;
+
+	if (GST_MESSAGE_TYPE (message) != GST_MESSAGE_ELEMENT)
+		return;
+
+	s = gst_message_get_structure (message);
+	if (!gst_structure_has_name (s, FLYCAP_LATENCY_STRUCTURE_NAME))
+		return;
+
+	name = gst_object_get_name (GST_OBJECT (element));
+
+	for (stage = 0; stage < FLYCAP_STAGE_N; stage++) {
+		const gchar *stage_name = flycap_latency_stage_name (stage);
+		guint64 count = 0, mean = 0, p50 = 0, p99 = 0, max = 0;
+		gchar field[64];
+
+#define GET_FIELD(f, val) \
+		g_snprintf (field, sizeof (field), "%s-" f, stage_name); \
+		gst_structure_get_uint64 (s, field, &val);
+
+		GET_FIELD ("count", count);
+		GET_FIELD ("mean", mean);
+		GET_FIELD ("p50", p50);
+		GET_FIELD ("p99", p99);
+		GET_FIELD ("max", max);
+
+#undef GET_FIELD
+
+		if (count)
+			gst_tracer_record_log (tr_stage, name, stage_name, count, mean, p50, p99, max);
+	}
+
+	g_free (name);
+}
+
+#define VALUE_FIELD(desc) \
+	GST_TYPE_STRUCTURE, gst_structure_new ("value", \
+		"type", G_TYPE_GTYPE, G_TYPE_UINT64, \
+		"description", G_TYPE_STRING, desc, \
+		"min", G_TYPE_UINT64, G_GUINT64_CONSTANT (0), \
+		"max", G_TYPE_UINT64, G_MAXUINT64, \
+		NULL)
+
+static void
+gst_flycap_latency_tracer_class_init (GstFlycapLatencyTracerClass * klass)
+{
+	tr_stage = gst_tracer_record_new ("flycap-latency.class",
+		"element", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+			"type", G_TYPE_GTYPE, G_TYPE_STRING,
+			"related-to", GST_TYPE_TRACER_VALUE_SCOPE, GST_TRACER_VALUE_SCOPE_ELEMENT,
+			NULL),
+		"stage", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+			"type", G_TYPE_GTYPE, G_TYPE_STRING,
+			"description", G_TYPE_STRING, "retrieve, copy, create or downstream",
+			NULL),
+		"count", VALUE_FIELD ("frames in the interval"),
+		"mean", VALUE_FIELD ("mean time in ns"),
+		"p50", VALUE_FIELD ("median time in ns"),
+		"p99", VALUE_FIELD ("99th percentile time in ns"),
+		"max", VALUE_FIELD ("maximum time in ns"),
+		NULL);
+	GST_OBJECT_FLAG_SET (tr_stage, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+}
+
+static void
+gst_flycap_latency_tracer_init (GstFlycapLatencyTracer * self)
+{
+	gst_tracing_register_hook (GST_TRACER (self), "element-post-message-pre",
+		G_CALLBACK (do_post_message_pre));
+}
+
+#endif // FLYCAP_HAVE_TRACER
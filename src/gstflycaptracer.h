@@ -0,0 +1,59 @@
+/* GStreamer Flycap Plugin
+ * Copyright (C) 2015 Gray Cancer Institute
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _GST_FLYCAP_TRACER_H_
+#define _GST_FLYCAP_TRACER_H_
+
+#include <gst/gst.h>
+
+// Tracers need GStreamer 1.8 and the tracer hooks, without them the plugin just has no tracer
+#if GST_CHECK_VERSION(1, 8, 0) && !defined(GST_DISABLE_GST_TRACER_HOOKS)
+#define FLYCAP_HAVE_TRACER 1
+#endif
+
+#ifdef FLYCAP_HAVE_TRACER
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_FLYCAP_LATENCY_TRACER   (gst_flycap_latency_tracer_get_type())
+#define GST_FLYCAP_LATENCY_TRACER(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_FLYCAP_LATENCY_TRACER,GstFlycapLatencyTracer))
+
+typedef struct _GstFlycapLatencyTracer GstFlycapLatencyTracer;
+typedef struct _GstFlycapLatencyTracerClass GstFlycapLatencyTracerClass;
+
+/* Logs the per stage timing that flycapsrc posts in its flycap-latency element messages,
+ * use with GST_TRACERS=flycaplatency GST_DEBUG=GST_TRACER:7
+ */
+struct _GstFlycapLatencyTracer
+{
+  GstTracer parent;
+};
+
+struct _GstFlycapLatencyTracerClass
+{
+  GstTracerClass parent_class;
+};
+
+GType gst_flycap_latency_tracer_get_type (void);
+
+G_END_DECLS
+
+#endif
+
+#endif
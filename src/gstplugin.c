@@ -3,6 +3,8 @@
 #endif
 
 #include "gstflycapsrc.h"
+#include "gstflycaprawsink.h"
+#include "gstflycaptracer.h"
 
 #define GST_CAT_DEFAULT gst_gstflycap_debug
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -18,6 +20,18 @@ plugin_init (GstPlugin * plugin)
     return FALSE;
   }
 
+  if (!gst_element_register (plugin, "flycaprawsink", GST_RANK_NONE,
+          GST_TYPE_FLYCAP_RAW_SINK)) {
+    return FALSE;
+  }
+
+#ifdef FLYCAP_HAVE_TRACER
+  if (!gst_tracer_register (plugin, "flycaplatency",
+          GST_TYPE_FLYCAP_LATENCY_TRACER)) {
+    return FALSE;
+  }
+#endif
+
   return TRUE;
 }
 